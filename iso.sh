@@ -7,13 +7,23 @@ mkdir -p isodir/boot
 mkdir -p isodir/boot/grub
 
 cp sysroot/boot/ahos.kernel isodir/boot/ahos.kernel
-cp sysroot/boot/symbols.map isodir/boot/symbols.map
 
 cat > isodir/boot/grub/grub.cfg << EOF
 set timeout=0
 menuentry "Ah!OS" {
 	multiboot /boot/ahos.kernel
-	module /boot/symbols.map
+}
+menuentry "Ah!OS (benchmarks)" {
+	multiboot /boot/ahos.kernel bench
+}
+menuentry "Ah!OS (benchmarks, no SSE)" {
+	multiboot /boot/ahos.kernel bench nosse
+}
+menuentry "Ah!OS (profiler)" {
+	multiboot /boot/ahos.kernel profile profile_callchain
+}
+menuentry "Ah!OS (trace)" {
+	multiboot /boot/ahos.kernel trace
 }
 EOF
 
@@ -101,6 +101,45 @@ static inline void atomic_dec(atomic_t *v)
 	asm volatile ("lock decl %0" : "+m" (v->value));
 }
 
+// ----------------------------------------------------------------------------
+
+/*
+ * Decrements @v and returns true if the result is zero.
+ */
+
+__attribute__((always_inline))
+static inline bool atomic_dec_and_test(atomic_t *v)
+{
+	uint8_t zero;
+
+	asm volatile ("lock decl %0; sete %1"
+				  : "+m" (v->value), "=qm" (zero)
+				  : /* no input */
+				  : "memory");
+
+	return zero != 0;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Sets @v to @new_val if it is equal to @old. Returns the previous value (the
+ * exchange happened if it is @old).
+ */
+
+__attribute__((always_inline))
+static inline int32_t atomic_cmpxchg(atomic_t *v, int32_t old, int32_t new_val)
+{
+	int32_t prev;
+
+	asm volatile ("lock cmpxchgl %2, %1"
+				  : "=a" (prev), "+m" (v->value)
+				  : "r" (new_val), "0" (old)
+				  : "memory");
+
+	return prev;
+}
+
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
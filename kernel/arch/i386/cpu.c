@@ -0,0 +1,152 @@
+/*
+ * cpu.c
+ *
+ * Processor features probed at boot (CPUID).
+ *
+ * If the processor supports SSE2, SSE is enabled and the SSE2 variants of
+ * memcpy(), memset(), memcmp() (libc) and clear_page() are selected, unless
+ * the "nosse" boot option is set. Those functions jump through a pointer to
+ * their current variant.
+ *
+ * The kernel itself is not compiled for SSE (the FPU/SSE state is never saved
+ * on interrupts), so the SSE2 variants save and restore every XMM register
+ * they use. Hence, they can be interrupted, and used from interrupt handlers.
+ *
+ * Documentation:
+ * - Intel (volume 3A, "System Programming For Instruction Set Extensions And
+ *   Processor Extended States")
+ */
+
+#include <kernel/init.h>
+#include <kernel/log.h>
+
+#include <arch/cpu.h>
+#include <arch/cpuid.h>
+
+#include <string.h>
+
+#include "registers.h"
+
+#define LOG_MODULE "cpu"
+
+#define DEFAULT_CACHE_SIZE (1024 * 1024) // when it cannot be probed
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+// implemented in [arch/i386/clear_page.S]
+extern void clear_page_stos(void *page);
+extern void clear_page_sse2(void *page);
+
+void (*clear_page_impl)(void *page) = clear_page_stos;
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Enables the SSE instructions (no x87 emulation, FXSAVE/FXRSTOR support and
+ * unmasked SIMD floating-point exceptions reported with #XM).
+ */
+
+static void enable_sse(void)
+{
+	reg_t cr0 = read_cr0();
+	reg_t cr4 = read_cr4();
+
+	cr0.cr0.em = 0;
+	cr0.cr0.mp = 1;
+	cr0.cr0.ts = 0;
+	write_cr0(cr0);
+
+	cr4.cr4.osfxsr = 1;
+	cr4.cr4.osxmmexcpt = 1;
+	write_cr4(cr4);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns the size of the last level cache (in bytes), or zero if it is not
+ * reported (Intel deterministic cache parameters, or AMD extended leaf).
+ */
+
+static uint32_t last_level_cache_size(void)
+{
+	struct cpuid_regs regs;
+	uint32_t size = 0;
+
+	cpuid(CPUID_LEAF_MAX, &regs);
+	if (regs.eax >= CPUID_LEAF_CACHES) {
+		for (uint32_t i = 0; i < 16; ++i) {
+			cpuid_subleaf(CPUID_LEAF_CACHES, i, &regs);
+			if ((regs.eax & 0x1f) == 0) {
+				break; // no more caches
+			}
+			if ((regs.eax & 0x1f) == 1) {
+				continue; // instruction cache
+			}
+
+			// ways * partitions * line size * sets (the last is the largest)
+			size = (((regs.ebx >> 22) & 0x3ff) + 1) *
+				(((regs.ebx >> 12) & 0x3ff) + 1) *
+				((regs.ebx & 0xfff) + 1) * (regs.ecx + 1);
+		}
+		if (size > 0) {
+			return size;
+		}
+	}
+
+	cpuid(CPUID_LEAF_EXT_MAX, &regs);
+	if (regs.eax >= CPUID_LEAF_EXT_CACHES) {
+		cpuid(CPUID_LEAF_EXT_CACHES, &regs);
+		if ((regs.edx >> 18) != 0) {
+			return (regs.edx >> 18) * 512 * 1024; // L3, 512KB units
+		}
+		return (regs.ecx >> 16) * 1024; // L2, KB units
+	}
+
+	return 0;
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Probes the processor features and selects the string functions variants.
+ * Must be called before interrupts are enabled.
+ */
+
+void cpu_setup(void)
+{
+	uint32_t cache_size = 0;
+
+	if (cpu_has_sse2() == false) {
+		info("no SSE2 support, using the generic string functions");
+		return;
+	}
+
+	if (cmdline_has("nosse")) {
+		info("SSE disabled by the boot command line");
+		return;
+	}
+
+	if ((cache_size = last_level_cache_size()) == 0) {
+		cache_size = DEFAULT_CACHE_SIZE;
+	}
+
+	enable_sse();
+
+	// larger copies and fills would evict the whole cache anyway
+	__string_use_sse2(cache_size);
+	clear_page_impl = clear_page_sse2;
+
+	success("SSE2 string functions enabled (non-temporal from %uKB)",
+		cache_size / 1024);
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
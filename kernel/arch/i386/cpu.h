@@ -0,0 +1,25 @@
+/*
+ * cpu.h
+ *
+ * Processor features probed at boot, and the routines selected accordingly.
+ */
+
+#ifndef ARCH_I386_CPU_H_
+#define ARCH_I386_CPU_H_
+
+#include <kernel/types.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+void cpu_setup(void);
+
+// fills the (page aligned) @page with zeros, bypassing the caches with SSE2
+void clear_page(void *page);
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* !ARCH_I386_CPU_H_ */
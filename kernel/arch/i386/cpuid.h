@@ -0,0 +1,147 @@
+/*
+ * cpuid.h
+ *
+ * Helpers for the CPUID instruction (processor identification).
+ *
+ * Documentation:
+ * - Intel (volume 2A, "CPUID - CPU Identification")
+ */
+
+#ifndef ARCH_I386_CPUID_H_
+#define ARCH_I386_CPUID_H_
+
+#include <kernel/types.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#define CPUID_LEAF_MAX			(0x00000000)
+#define CPUID_LEAF_FEATURES		(0x00000001)
+#define CPUID_LEAF_CACHES		(0x00000004) // Intel, a sub-leaf per cache
+#define CPUID_LEAF_EXT_MAX		(0x80000000)
+#define CPUID_LEAF_EXT_FEATURES	(0x80000001)
+#define CPUID_LEAF_EXT_CACHES	(0x80000006) // AMD L2/L3 caches
+
+// CPUID_LEAF_FEATURES (edx)
+#define CPUID_EDX_PSE			(1 << 3) // Page Size Extension
+#define CPUID_EDX_MSR			(1 << 5) // RDMSR/WRMSR instructions
+#define CPUID_EDX_PAE			(1 << 6) // Physical Address Extension
+#define CPUID_EDX_FXSR			(1 << 24) // FXSAVE/FXRSTOR instructions
+#define CPUID_EDX_SSE			(1 << 25) // Streaming SIMD Extensions
+#define CPUID_EDX_SSE2			(1 << 26) // Streaming SIMD Extensions 2
+
+// CPUID_LEAF_EXT_FEATURES (edx)
+#define CPUID_EXT_EDX_NX		(1 << 20) // Execute Disable Bit
+
+// ----------------------------------------------------------------------------
+
+struct cpuid_regs {
+	uint32_t eax;
+	uint32_t ebx;
+	uint32_t ecx;
+	uint32_t edx;
+};
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Executes CPUID for @leaf and @subleaf, and stores the result in @regs.
+ *
+ * NOTE: The CPUID instruction is assumed to be available (i.e. i586+).
+ */
+
+static inline void cpuid_subleaf(uint32_t leaf, uint32_t subleaf,
+								 struct cpuid_regs *regs)
+{
+	asm volatile("cpuid"
+				 : "=a"(regs->eax), "=b"(regs->ebx),
+				   "=c"(regs->ecx), "=d"(regs->edx)
+				 : "a"(leaf), "c"(subleaf));
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Executes CPUID for @leaf (sub-leaf zero) and stores the result in @regs.
+ */
+
+static inline void cpuid(uint32_t leaf, struct cpuid_regs *regs)
+{
+	cpuid_subleaf(leaf, 0, regs);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns true if the processor supports 4MB pages (PSE), false otherwise.
+ */
+
+static inline bool cpu_has_pse(void)
+{
+	struct cpuid_regs regs;
+
+	cpuid(CPUID_LEAF_FEATURES, &regs);
+
+	return !!(regs.edx & CPUID_EDX_PSE);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns true if the processor supports the PAE paging mode, false otherwise.
+ */
+
+static inline bool cpu_has_pae(void)
+{
+	struct cpuid_regs regs;
+
+	cpuid(CPUID_LEAF_FEATURES, &regs);
+
+	return !!(regs.edx & CPUID_EDX_PAE);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns true if the processor supports SSE2 (and FXSAVE/FXRSTOR, required to
+ * enable SSE), false otherwise.
+ */
+
+static inline bool cpu_has_sse2(void)
+{
+	const uint32_t mask = CPUID_EDX_FXSR | CPUID_EDX_SSE | CPUID_EDX_SSE2;
+	struct cpuid_regs regs;
+
+	cpuid(CPUID_LEAF_FEATURES, &regs);
+
+	return ((regs.edx & mask) == mask);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns true if the processor supports no-execute pages, false otherwise.
+ */
+
+static inline bool cpu_has_nx(void)
+{
+	struct cpuid_regs regs;
+
+	cpuid(CPUID_LEAF_EXT_MAX, &regs);
+	if (regs.eax < CPUID_LEAF_EXT_FEATURES) {
+		return false;
+	}
+
+	cpuid(CPUID_LEAF_EXT_FEATURES, &regs);
+
+	return !!(regs.edx & CPUID_EXT_EDX_NX);
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* !ARCH_I386_CPUID_H_ */
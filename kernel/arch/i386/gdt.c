@@ -4,11 +4,23 @@
  * Global Descriptor Table management.
  *
  * The memory model is the classical "flat memory" model.
+ *
+ * Tasks are not used, but two Task-State Segments are required to handle
+ * double faults with a task gate: the kernel TSS (loaded in TR) receives the
+ * faulting context, while the double fault TSS describes a "task" running
+ * double_fault_task() on its own stack. That way a double fault caused by a
+ * stack overflow can still be reported.
  */
 
 #include <kernel/types.h>
 #include <kernel/interrupt.h>
 
+#include <arch/gdt.h>
+
+#include <string.h>
+
+#include "registers.h"
+
 #define LOG_MODULE "gdt"
 
 // ============================================================================
@@ -16,6 +28,7 @@
 // ============================================================================
 
 extern void asm_reset_segment_selectors(); // implemented in [arch/i386/boot.S]
+extern void double_fault_task(void); // implemented in [arch/i386/idt.c]
 
 // ----------------------------------------------------------------------------
 
@@ -25,9 +38,18 @@ static uint64_t gdt[] = {
 	0x00CF9A000000FFFF, // kernel code segment
 	0x00CF92000000FFFF, // kernel data segment
 	0x00CFFA000000FFFF, // user code segment
-	0x00CFF2000000FFFF  // user data segment
+	0x00CFF2000000FFFF, // user data segment
+	0x0000000000000000, // kernel TSS (filled by tss_setup())
+	0x0000000000000000  // double fault TSS (filled by tss_setup())
 };
 
+#define DOUBLE_FAULT_STACK_SIZE 4096
+
+struct tss kernel_tss;
+static struct tss double_fault_tss;
+static uint8_t double_fault_stack[DOUBLE_FAULT_STACK_SIZE]
+	__attribute__((aligned(16)));
+
 struct gdtr_reg
 {
 	uint16_t limit;
@@ -53,6 +75,64 @@ void gdt_setup(void)
 	asm_reset_segment_selectors();
 }
 
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns a present, ring-0, 32-bit available TSS descriptor.
+ */
+
+static uint64_t tss_descriptor(struct tss *tss)
+{
+	const uint32_t base = (uint32_t) tss;
+	const uint32_t limit = sizeof(*tss) - 1;
+	uint64_t desc = 0;
+
+	desc |= (uint64_t) (limit & 0xffff);
+	desc |= (uint64_t) (base & 0xffffff) << 16;
+	desc |= (uint64_t) 0x89 << 40; // P=1, DPL=0, type=1001b
+	desc |= (uint64_t) ((limit >> 16) & 0xf) << 48;
+	desc |= (uint64_t) (base >> 24) << 56;
+
+	return desc;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Installs the kernel and double fault TSS, and loads the task register.
+ *
+ * Must be called once paging is enabled (the double fault task switches to
+ * the current CR3) and before the IDT is setup.
+ */
+
+void tss_setup(void)
+{
+	memset(&kernel_tss, 0, sizeof(kernel_tss));
+	kernel_tss.iomap_base = sizeof(kernel_tss); // no I/O permission bitmap
+
+	memset(&double_fault_tss, 0, sizeof(double_fault_tss));
+	double_fault_tss.cr3 = read_cr3().val;
+	double_fault_tss.eip = (uint32_t) double_fault_task;
+	double_fault_tss.eflags = 0x2; // reserved bit, interrupts disabled
+	double_fault_tss.esp = (uint32_t) double_fault_stack +
+		sizeof(double_fault_stack);
+	double_fault_tss.cs = GDT_KERNEL_CODE_SELECTOR;
+	double_fault_tss.ss = GDT_KERNEL_DATA_SELECTOR;
+	double_fault_tss.ds = GDT_KERNEL_DATA_SELECTOR;
+	double_fault_tss.es = GDT_KERNEL_DATA_SELECTOR;
+	double_fault_tss.fs = GDT_KERNEL_DATA_SELECTOR;
+	double_fault_tss.gs = GDT_KERNEL_DATA_SELECTOR;
+	double_fault_tss.iomap_base = sizeof(double_fault_tss);
+
+	gdt[GDT_KERNEL_TSS_SELECTOR / 8] = tss_descriptor(&kernel_tss);
+	gdt[GDT_DOUBLE_FAULT_TSS_SELECTOR / 8] = tss_descriptor(&double_fault_tss);
+
+	asm volatile("ltr %0"
+			: /* no output */
+			: "r"((uint16_t) GDT_KERNEL_TSS_SELECTOR)
+			: "memory");
+}
+
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
@@ -18,11 +18,17 @@
 #include <kernel/types.h>
 #include <kernel/interrupt.h>
 #include <kernel/log.h>
+#include <kernel/trace.h>
 
 #include <drivers/ps2ctrl.h>
 #include <drivers/clock.h>
 
 #include <mem/memory.h>
+#include <mem/kstack.h>
+
+#include <arch/gdt.h>
+
+#include "registers.h"
 
 #define LOG_MODULE "idt"
 
@@ -75,15 +81,19 @@ struct idt_entry
 		.offset_hi = ((uint32_t)isr_ptr >> 16) & 0xffff \
 	}
 
-#if 0
-#define task_gate(isr_ptr) \
+/*
+ * Task gates switch to the task described by the @tss_selector TSS, its stack
+ * included. This is the only way to handle a fault once the current stack is
+ * unusable (e.g. overflowed).
+ */
+
+#define task_gate(tss_selector) \
 	(struct idt_entry){\
 		.offset_lo = 0x0, \
-		.segment_selector = 0x0, /* FIXME: TSS */ \
+		.segment_selector = (tss_selector), \
 		.flags = 0b1000010100000000, \
 		.offset_hi = 0x0 \
 	}
-#endif
 
 /*
  * In theory, only the 'P' flag (PRESENT) should be set to 0, otherfields
@@ -139,11 +149,37 @@ static void invalid_opcode_handler(void)
 
 // ----------------------------------------------------------------------------
 
-static void double_fault_handler(void)
+/*
+ * Double fault task entry point (see tss_setup()), the faulting context has
+ * been saved in 'kernel_tss'.
+ *
+ * The error code (always zero) sits on top of the stack instead of a return
+ * address: this must never return.
+ */
+
+__attribute__((__noreturn__))
+void double_fault_task(void)
 {
+	const uint32_t fault_addr = read_cr2().val;
+	const char *owner = NULL;
+
 	info("\"Double Fault\" exception detected!");
-	// TODO
-	unhandled_exception();
+	info("");
+
+	info("faulty address: 0x%p", fault_addr);
+	info("EIP: 0x%p", kernel_tss.eip);
+	info("ESP: 0x%p", kernel_tss.esp);
+	info("");
+
+	// the page fault could not be delivered on an overflowed stack
+	if (((owner = kstack_guard_owner(fault_addr)) != NULL) ||
+		((owner = kstack_guard_owner(kernel_tss.esp)) != NULL))
+	{
+		panic("stack overflow in %s", owner);
+	}
+
+	panic("unhandled exception!");
+	__builtin_unreachable();
 }
 
 // ----------------------------------------------------------------------------
@@ -168,22 +204,38 @@ static void user_defined_interrupt_handler(void)
 // ----------------------------------------------------------------------------
 // ============================================================================
 
+// built by isr_common_stub, right above the registers saved by 'pushal'
 struct interrupt_stack
 {
 	int isr_num;
 	int error_code;
+	uint32_t eip; // pushed by the cpu
+	uint32_t cs;
+	uint32_t eflags;
 };
 
+// EBP of the interrupted code, saved by 'pushal' (EDI, ESI, EBP, ...)
+#define INTERRUPTED_EBP(stack) (((uint32_t*)(stack))[-6])
+
+volatile uint32_t g_interrupt_depth = 0;
+
 void isr_handler(struct interrupt_stack *stack)
 {
+	g_interrupt_depth++;
+
+	// the clock would flood the trace buffers
+	if (stack->isr_num != 32) {
+		trace("isr %d eip=0x%x error=0x%x", stack->isr_num, stack->eip,
+			stack->error_code);
+	}
+
 	switch (stack->isr_num)
 	{
 		case 0: divide_error_handler(); break;
 		case 6: invalid_opcode_handler(); break;
-		case 8: double_fault_handler(); break;
 		case 13: general_protection_fault_handler(); break;
 		case 14: page_fault_handler(stack->error_code); break;
-		case 32: clock_irq_handler(); break;
+		case 32: clock_irq_handler(stack->eip, INTERRUPTED_EBP(stack)); break;
 		case 33: ps2ctrl_irq1_handler(); break;
 		case 34: user_defined_interrupt_handler(); break;
 		case 44: ps2ctrl_irq12_handler(); break;
@@ -191,6 +243,8 @@ void isr_handler(struct interrupt_stack *stack)
 			unhandled_interrupt();
 			break;
 	}
+
+	g_interrupt_depth--;
 }
 
 // ============================================================================
@@ -274,7 +328,7 @@ void setup_idt(void)
 	idt[5]  = int_gate(isr5); // bound range exceeded
 	idt[6]  = int_gate(isr6); // invalid/undefined opcode (UD2 !)
 	idt[7]  = int_gate(isr7); // device not available (no math coprocessor)
-	idt[8]  = int_gate(isr8); // double fault
+	idt[8]  = task_gate(GDT_DOUBLE_FAULT_TSS_SELECTOR); // double fault
 	idt[9]  = int_gate(isr9); // coprocessor segment overrun (reserved)
 	idt[10] = int_gate(isr10); // invalid tss
 	idt[11] = int_gate(isr11); // segment not present
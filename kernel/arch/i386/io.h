@@ -44,6 +44,21 @@ inline uint8_t inb(uint16_t port)
 	return res;
 }
 
+// ----------------------------------------------------------------------------
+
+/*
+ * Writes the @len bytes at @data to @port, with a single instruction.
+ */
+
+inline void outsb(uint16_t port, const void *data, size_t len)
+{
+	asm volatile("rep outsb"
+				: "+S"(data), "+c"(len) /* output */
+				: "d"(port) /* input */
+				: "memory"
+				);
+}
+
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
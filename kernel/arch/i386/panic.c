@@ -7,6 +7,8 @@
 #include <kernel/types.h>
 #include <kernel/symbol.h>
 #include <kernel/interrupt.h>
+#include <kernel/crashdump.h>
+#include <kernel/log.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -19,29 +21,126 @@
 // ----------------------------------------------------------------------------
 // ============================================================================
 
+/*
+ * Saves the general purpose and segment registers in @regs. The caller fills
+ * the remaining ones.
+ */
+
+static inline void save_registers(struct crashdump_regs *regs)
+{
+	asm volatile("mov %%eax, 0(%0)\n"
+				 "mov %%ebx, 4(%0)\n"
+				 "mov %%ecx, 8(%0)\n"
+				 "mov %%edx, 12(%0)\n"
+				 "mov %%esi, 16(%0)\n"
+				 "mov %%edi, 20(%0)\n"
+				 "pushf\n"
+				 "popl 36(%0)\n"
+				 : /* no output */
+				 : "r"(regs)
+				 : "memory");
+
+	asm volatile("mov %%cs, %0" : "=r"(regs->cs));
+	asm volatile("mov %%ds, %0" : "=r"(regs->ds));
+	asm volatile("mov %%es, %0" : "=r"(regs->es));
+	asm volatile("mov %%fs, %0" : "=r"(regs->fs));
+	asm volatile("mov %%gs, %0" : "=r"(regs->gs));
+	asm volatile("mov %%ss, %0" : "=r"(regs->ss));
+
+	regs->cr0 = read_cr0().val;
+	regs->cr2 = read_cr2().val;
+	regs->cr3 = read_cr3().val;
+	regs->cr4 = read_cr4().val;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Walks the frame pointer chain from @ebp and fills up to @max @frames.
+ *
+ * A frame in @isr_handler_sym (i.e. isr_common_stub) is followed by the
+ * interrupted one.
+ *
+ * Returns the number of frames.
+ */
+
+static size_t collect_frames(reg_t *ebp, struct symbol *isr_handler_sym,
+							 struct crashdump_frame *frames, size_t max)
+{
+	size_t nb_frames = 0;
+
+	while (nb_frames < max) {
+		reg_t eip = ebp[1];
+
+		if ((eip.val == 0) || (ebp[0].val == 0)) {
+			// no more caller
+			break;
+		}
+
+		frames[nb_frames].ebp = ebp[0].val;
+		frames[nb_frames].eip = eip.val;
+		nb_frames++;
+
+		// special treatment for panic in ISR / context switch
+		if (((void*)eip.val >= isr_handler_sym->addr) &&
+			(eip.val < ((size_t)isr_handler_sym->addr + isr_handler_sym->len)) &&
+			(nb_frames < max))
+		{
+			// TODO: handle the privilege change / context switch case
+
+			// any change in isr_common_stub stack layout must be reflected here
+			frames[nb_frames].ebp = ebp[0].val;
+			frames[nb_frames].eip = ebp[13].val;
+			nb_frames++;
+		}
+
+		ebp = (reg_t*) ebp[0].val;
+	}
+
+	return nb_frames;
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
 /*
  * Panic handler entry point.
+ *
+ * A binary crash dump is streamed over the serial port first (see
+ * crashdump_write()), then the human readable report is printed.
  */
 
 __attribute__((__noreturn__))
 void panic(char *msg, ...)
 {
+	static struct crashdump_frame frames[CRASHDUMP_MAX_FRAMES];
+	struct crashdump_regs regs;
 	struct symbol isr_handler_sym;
 	char error_buf[256];
+	size_t nb_frames = 0;
 	va_list args;
 
+	// before anything else clobbers them
+	save_registers(&regs);
+
 	// disable interrupts as soon as possible
 	disable_interrupts();
 
 	/*
-	 * The stack layout is (low addresses first):
-	 * - second arg
-	 * - first arg
-	 * - return address of calling function
+	 * Our frame (low addresses first):
 	 * - EBP of calling function
+	 * - return address of calling function
+	 * - first arg
+	 * - second arg
 	 */
 
-	reg_t *ebp = (reg_t*)&msg - 2; // use pointer arithmetic
+	reg_t *ebp = __builtin_frame_address(0);
+
+	// the caller's view: its frame pointer, return address and stack pointer
+	regs.ebp = ebp[0].val;
+	regs.eip = ebp[1].val;
+	regs.esp = (uint32_t)&msg;
 
 	memset(&isr_handler_sym, 0, sizeof(isr_handler_sym));
 	if (symbol_lookup("isr_common_stub", &isr_handler_sym) == false) {
@@ -49,53 +148,36 @@ void panic(char *msg, ...)
 		// we continue anyway
 	}
 
+	va_start(args, msg);
+	vsnprintf(error_buf, sizeof(error_buf), msg, args);
+	va_end(args);
+
+	nb_frames = collect_frames(ebp, &isr_handler_sym, frames,
+							   CRASHDUMP_MAX_FRAMES);
+
+	crashdump_write(error_buf, &regs, frames, nb_frames);
+
+	// the pending log messages come first (no-op if the panic hit a flush)
+	log_flush();
+
 	printf("\n=============\n");
 	printf("=== PANIC ===\n");
 	printf("=============\n\n");
 
-	va_start(args, msg);
-	// FIXME: use vsnprintf() to avoid buffer overflow
-	vsprintf(error_buf, msg, args);
-	va_end(args);
-	error_buf[sizeof(error_buf) - 1] = '\0';
 	printf("error: %s\n\n", error_buf);
 
 	// dump stack trace
 	printf("Call trace:\n");
-	for (;;) {
+	for (size_t i = 0; i < nb_frames; ++i) {
 		struct symbol sym;
-		reg_t eip = ebp[1];
+		const uint32_t eip = frames[i].eip;
 
-		if ((eip.val == 0) || (ebp[0].val == 0)) {
-			// no more caller
-			break;
-		}
-
-		if (symbol_find((void*)eip.val, &sym)) {
-			printf("- (ebp=0x%.8x) %s() + 0x%x/0x%x\n", ebp[0].val, sym.name,
-				(eip.val - (uint32_t)sym.addr), sym.len);
+		if (symbol_find((void*)eip, &sym)) {
+			printf("- (ebp=0x%.8x) %s() + 0x%x/0x%x\n", frames[i].ebp, sym.name,
+				(eip - (uint32_t)sym.addr), sym.len);
 		} else {
-			printf("- (ebp=0x%.8x) ????? / 0x%x\n", ebp[0].val, eip.val);
+			printf("- (ebp=0x%.8x) ????? / 0x%x\n", frames[i].ebp, eip);
 		}
-
-		// special treatment for panic in ISR / context switch
-		if (((void*)eip.val >= isr_handler_sym.addr) &&
-			(eip.val < ((size_t)isr_handler_sym.addr + isr_handler_sym.len )))
-		{
-			// TODO: handle the privilege change / context switch case
-
-			// any change in isr_common_stub stack layout must be reflected here
-			eip = ebp[13];
-
-			if (symbol_find((void*)eip.val, &sym)) {
-				printf("- (ebp=0x%.8x) %s() + 0x%x/0x%x\n", ebp[0].val, sym.name,
-					(eip.val - (uint32_t)sym.addr), sym.len);
-			} else {
-				printf("- (ebp=0x%.8x) ????? / 0x%x\n", ebp[0].val, eip.val);
-			}
-		}
-
-		ebp = (reg_t*) ebp[0].val;
 	}
 
 	// infinite loop
@@ -54,3 +54,33 @@ DECL_read_reg(cr4);
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
+
+/*
+ * Reads the Model-Specific Register @msr.
+ */
+
+uint64_t read_msr(uint32_t msr)
+{
+	uint32_t lo, hi;
+
+	asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+
+	return ((uint64_t)hi << 32) | lo;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Writes @val into the Model-Specific Register @msr.
+ */
+
+void write_msr(uint32_t msr, uint64_t val)
+{
+	asm volatile("wrmsr"
+				 : /* no output */
+				 : "c"(msr), "a"((uint32_t)val), "d"((uint32_t)(val >> 32)));
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
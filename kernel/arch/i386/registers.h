@@ -93,4 +93,20 @@ reg_t read_cr4(void);
 // ----------------------------------------------------------------------------
 // ============================================================================
 
+/*
+ * Model-Specific Registers (Intel volume 4).
+ */
+
+#define MSR_EFER		(0xc0000080) // Extended Feature Enable Register
+#define MSR_EFER_NXE	(1 << 11) // Execute Disable Bit Enable
+
+// ----------------------------------------------------------------------------
+
+uint64_t read_msr(uint32_t msr);
+void write_msr(uint32_t msr, uint64_t val);
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
 #endif /* !ARCH_I386_REGISTERS_H_ */
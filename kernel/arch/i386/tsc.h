@@ -0,0 +1,40 @@
+/*
+ * tsc.h
+ *
+ * Helpers for the Time-Stamp Counter (TSC).
+ *
+ * The TSC counts CPU cycles since reset. It is only meant to measure short
+ * durations (e.g. latencies), not to keep the wall clock.
+ */
+
+#ifndef ARCH_I386_TSC_H_
+#define ARCH_I386_TSC_H_
+
+#include <kernel/types.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Reads the current value of the Time-Stamp Counter.
+ *
+ * NOTE: "rdtsc" is not a serializing instruction, it might be executed before
+ * preceding instructions are completed.
+ */
+
+__attribute__((always_inline))
+static inline uint64_t rdtsc(void)
+{
+	uint32_t lo, hi;
+
+	asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+
+	return ((uint64_t)hi << 32) | lo;
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* !ARCH_I386_TSC_H_ */
@@ -13,6 +13,7 @@
 #include <kernel/types.h>
 #include <kernel/interrupt.h>
 #include <kernel/log.h>
+#include <kernel/profile.h>
 
 #include <arch/atomic.h>
 #include <arch/io.h>
@@ -127,10 +128,11 @@ void clock_sleep(int32_t msec)
 // ----------------------------------------------------------------------------
 
 /*
- * Clock interrupt request handler.
+ * Clock interrupt request handler. The interrupted code was running at @eip
+ * with @ebp as frame pointer (sampled by the profiler).
  */
 
-void clock_irq_handler(void)
+void clock_irq_handler(uint32_t eip, uint32_t ebp)
 {
 	atomic_inc(&clock_tick);
 
@@ -138,6 +140,8 @@ void clock_irq_handler(void)
 		panic("clock tick overflow detected!!!");
 	}
 
+	profile_tick(eip, ebp);
+
 	irq_send_eoi(IRQ0_CLOCK);
 }
 
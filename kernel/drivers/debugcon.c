@@ -0,0 +1,75 @@
+/*
+ * debugcon.c
+ *
+ * Debug console: the 0xe9 port of Bochs and QEMU ("-debugcon file:..."), every
+ * byte written to it goes straight to the host.
+ *
+ * Unlike the UART there is no line speed nor status to poll, so a whole
+ * message is written with a single "rep outsb": this is the fastest sink,
+ * the one to keep the debug messages on.
+ */
+
+#include <drivers/debugcon.h>
+
+#include <kernel/types.h>
+#include <kernel/console.h>
+
+#include <arch/io.h>
+
+#define LOG_MODULE "debugcon"
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#define DEBUGCON_PORT 0xe9
+
+// ----------------------------------------------------------------------------
+
+static void debugcon_write(const char *data, size_t size, uint8_t color);
+
+static struct console_sink debugcon_sink = {
+	.name = "debugcon",
+	.write = debugcon_write,
+	.level = LOG_DEBUG,
+};
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Console sink: there are no colors on the debug port.
+ */
+
+static void debugcon_write(const char *data, size_t size, uint8_t color)
+{
+	(void) color;
+	outsb(DEBUGCON_PORT, data, size);
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Registers the debug port sink if the emulator provides it.
+ *
+ * Returns false otherwise.
+ */
+
+bool debugcon_init(void)
+{
+	// reads back its own number, an unused port reads 0xff
+	if (inb(DEBUGCON_PORT) != DEBUGCON_PORT) {
+		return false;
+	}
+
+	console_register(&debugcon_sink);
+
+	return true;
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
@@ -33,6 +33,7 @@
 #include <kernel/interrupt.h>
 #include <kernel/timeout.h>
 #include <kernel/log.h>
+#include <kernel/trace.h>
 
 #include <string.h>
 
@@ -1134,6 +1135,7 @@ void ps2ctrl_irq1_handler(void)
 	// no need to check 'output' status in Status Register (we come from IRQ)
 	data = inb(DATA_PORT);
 	//info("IRQ1 handler: receveid data 0x%x", data); // debug only
+	trace("ps2ctrl: irq1 data=0x%x", data);
 
 	if (ps2_irq_handlers[0] == NULL) {
 		error("IRQ1 does not have an associated handler, data is lost!");
@@ -1163,6 +1165,7 @@ void ps2ctrl_irq12_handler(void)
 	// no need to check 'output' status in Status Register (we come from IRQ)
 	data = inb(DATA_PORT);
 	//info("IRQ12 handler: receveid data 0x%x", data); // debug only
+	trace("ps2ctrl: irq12 data=0x%x", data);
 
 	if (ps2_irq_handlers[1] == NULL) {
 		error("IRQ12 does not have an associated handler, data is lost!");
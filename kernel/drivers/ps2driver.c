@@ -10,6 +10,7 @@
 #include <kernel/log.h>
 #include <kernel/interrupt.h>
 #include <kernel/timeout.h>
+#include <kernel/trace.h>
 
 #include <string.h>
 
@@ -162,6 +163,7 @@ bool ps2driver_read(struct ps2driver *driver, uint8_t *data, size_t timeout)
 	ps2driver_unlock(driver);
 
 	dbg("got data = 0x%x", *data);
+	trace("ps2driver: read 0x%x", *data);
 
 	return true;
 }
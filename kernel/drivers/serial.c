@@ -14,10 +14,13 @@
  * - error handling (LSR)
  */
 
+#include <drivers/serial.h>
+
 #include <arch/io.h>
 
 #include <kernel/types.h>
 #include <kernel/interrupt.h>
+#include <kernel/console.h>
 
 #define LOG_MODULE "serial"
 
@@ -165,6 +168,18 @@
 // ----------------------------------------------------------------------------
 // ============================================================================
 
+static void serial_sink_write(const char *data, size_t size, uint8_t color);
+
+static struct console_sink serial_sink = {
+	.name = "serial",
+	.write = serial_sink_write,
+	.level = LOG_DEBUG,
+};
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
 /*
  * Assumes that UART interruptions are disabled.
  */
@@ -248,6 +263,18 @@ static void serial_enable_fifo(void)
 	outb(COM1 + FCR, fcr);
 }
 
+// ----------------------------------------------------------------------------
+
+/*
+ * Console sink: there are no colors on the serial line.
+ */
+
+static void serial_sink_write(const char *data, size_t size, uint8_t color)
+{
+	(void) color;
+	serial_write(data, size);
+}
+
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
@@ -259,6 +286,8 @@ void serial_init(void)
 	serial_set_protocol(LCR_PROTO_8N1);
 	serial_enable_fifo();
 	serial_enable_irqs();
+
+	console_register(&serial_sink);
 }
 
 // ----------------------------------------------------------------------------
@@ -8,6 +8,7 @@
 #include <drivers/vga.h>
 
 #include <kernel/types.h>
+#include <kernel/console.h>
 
 #include <string.h>
 
@@ -22,6 +23,16 @@ static size_t terminal_column;
 static uint8_t terminal_color;
 static uint8_t terminal_default_color;
 static uint16_t* terminal_buffer;
+static size_t cursor_row; // last position sent to the VGA controller
+static size_t cursor_column;
+
+static void terminal_sink_write(const char *data, size_t size, uint8_t color);
+
+static struct console_sink terminal_sink = {
+	.name = "terminal",
+	.write = terminal_sink_write,
+	.level = LOG_DEBUG,
+};
 
 static uint16_t* const VGA_MEMORY = (uint16_t*) 0xB8000;
 static const size_t VGA_ELT_SIZE = sizeof(terminal_buffer[0]);
@@ -84,6 +95,22 @@ static void __terminal_putchar(char c)
 	}
 }
 
+// ----------------------------------------------------------------------------
+
+/*
+ * Moves the hardware cursor to the current position. This costs 4 port I/Os,
+ * so it is skipped if the cursor did not move.
+ */
+
+static void update_cursor(void)
+{
+	if ((terminal_row != cursor_row) || (terminal_column != cursor_column)) {
+		cursor_row = terminal_row;
+		cursor_column = terminal_column;
+		vga_update_cursor(terminal_column, terminal_row);
+	}
+}
+
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
@@ -106,7 +133,11 @@ void terminal_initialize(void)
 	}
 
 	vga_enable_cursor(VGA_CURSOR_BOX);
+	cursor_row = terminal_row;
+	cursor_column = terminal_column;
 	vga_update_cursor(terminal_column, terminal_row);
+
+	console_register(&terminal_sink);
 }
 
 // ----------------------------------------------------------------------------
@@ -114,7 +145,7 @@ void terminal_initialize(void)
 void terminal_putchar(char c)
 {
 	__terminal_putchar(c);
-	vga_update_cursor(terminal_column, terminal_row);
+	update_cursor();
 }
 
 // ----------------------------------------------------------------------------
@@ -123,7 +154,22 @@ void terminal_write(const char* data, size_t size)
 {
 	for (size_t i = 0; i < size; i++)
 		__terminal_putchar(data[i]);
-	vga_update_cursor(terminal_column, terminal_row);
+	update_cursor();
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Console sink: writes a whole message in @color (if not the default one).
+ */
+
+static void terminal_sink_write(const char *data, size_t size, uint8_t color)
+{
+	if (color != CONSOLE_DEFAULT_COLOR) {
+		terminal_setcolor(color);
+	}
+	terminal_write(data, size);
+	terminal_reset_color();
 }
 
 // ----------------------------------------------------------------------------
@@ -0,0 +1,18 @@
+#ifndef ARCH_CPU_H_
+#define ARCH_CPU_H_
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#if defined(__i386__)
+	#include "../arch/i386/cpu.h"
+#else
+	#error "Only ix86 architecture for now"
+#endif
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef ARCH_CPUID_H_
+#define ARCH_CPUID_H_
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#if defined(__i386__)
+	#include "../arch/i386/cpuid.h"
+#else
+	#error "Only ix86 architecture for now"
+#endif
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif
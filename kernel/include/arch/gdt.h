@@ -1,11 +1,54 @@
 #ifndef ARCH_GDT_H_
 #define ARCH_GDT_H_
 
+#include <kernel/types.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#define GDT_KERNEL_CODE_SELECTOR	0x08
+#define GDT_KERNEL_DATA_SELECTOR	0x10
+#define GDT_KERNEL_TSS_SELECTOR		0x28
+#define GDT_DOUBLE_FAULT_TSS_SELECTOR	0x30
+
+// ----------------------------------------------------------------------------
+
+// 32-bit Task-State Segment (Intel, chapter 7)
+struct tss {
+	uint16_t link, reserved0;
+	uint32_t esp0;
+	uint16_t ss0, reserved1;
+	uint32_t esp1;
+	uint16_t ss1, reserved2;
+	uint32_t esp2;
+	uint16_t ss2, reserved3;
+	uint32_t cr3;
+	uint32_t eip;
+	uint32_t eflags;
+	uint32_t eax, ecx, edx, ebx;
+	uint32_t esp, ebp, esi, edi;
+	uint16_t es, reserved4;
+	uint16_t cs, reserved5;
+	uint16_t ss, reserved6;
+	uint16_t ds, reserved7;
+	uint16_t fs, reserved8;
+	uint16_t gs, reserved9;
+	uint16_t ldt, reserved10;
+	uint16_t trap, iomap_base;
+} __attribute__((packed));
+
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
 
+// the context interrupted by a double fault is saved here
+extern struct tss kernel_tss;
+
+// ----------------------------------------------------------------------------
+
 void gdt_setup(void);
+void tss_setup(void);
 
 // ============================================================================
 // ----------------------------------------------------------------------------
@@ -0,0 +1,18 @@
+#ifndef ARCH_TSC_H_
+#define ARCH_TSC_H_
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#if defined(__i386__)
+	#include "../arch/i386/tsc.h"
+#else
+	#error "Only ix86 architecture for now"
+#endif
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif
@@ -18,7 +18,7 @@
 void clock_init(uint32_t freq);
 int32_t clock_gettick(void);
 void clock_sleep(int32_t msec);
-void clock_irq_handler(void);
+void clock_irq_handler(uint32_t eip, uint32_t ebp);
 
 // ============================================================================
 // ----------------------------------------------------------------------------
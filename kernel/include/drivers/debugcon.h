@@ -0,0 +1,20 @@
+/*
+ * debugcon.h
+ */
+
+#ifndef DRIVERS_DEBUGCON_H_
+#define DRIVERS_DEBUGCON_H_
+
+#include <kernel/types.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+bool debugcon_init(void);
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* DRIVERS_DEBUGCON_H_ */
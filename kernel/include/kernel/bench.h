@@ -0,0 +1,33 @@
+/*
+ * bench.h
+ *
+ * In-kernel micro-benchmarks (selected with the "bench" boot option).
+ */
+
+#ifndef KERNEL_BENCH_H_
+#define KERNEL_BENCH_H_
+
+#include <kernel/types.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#define BENCH_SAMPLES			64 // single operation benchmarks
+#define BENCH_SPAN_SAMPLES		8 // span benchmarks (whole page tables)
+#define BENCH_SPAN_PDES			4 // "many-PDE" span, in page tables
+#define BENCH_NEW_TABLE_SAMPLES	16 // one fresh page table per sample
+#define BENCH_STRING_MAX_SIZE	16384 // string functions, from 16 bytes
+#define BENCH_STRING_SLACK		5 // memmove() overlap (unaligned on purpose)
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+void bench_run(void);
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* !KERNEL_BENCH_H_ */
@@ -0,0 +1,49 @@
+/*
+ * console.h
+ *
+ * Console sinks: the output devices of printf() and of the log messages
+ * (terminal, serial port, debug port...).
+ *
+ * Drivers register their sink once they are ready. A sink is always given a
+ * whole buffer (e.g. a log message), never a single character, and only gets
+ * the messages up to its own level: a slow sink (the VGA terminal, the UART)
+ * can be limited to warnings while a fast one (the debug port) keeps every
+ * debug message.
+ */
+
+#ifndef KERNEL_CONSOLE_H_
+#define KERNEL_CONSOLE_H_
+
+#include <kernel/types.h>
+#include <kernel/list.h>
+#include <kernel/log.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#define CONSOLE_DEFAULT_COLOR 0 // the sink keeps its own color
+
+struct console_sink
+{
+	const char *name; // for the "console=<name>:<level>" boot option
+	// @color is a VGA color, or CONSOLE_DEFAULT_COLOR
+	void (*write)(const char *data, size_t size, uint8_t color);
+	enum log_level level; // messages above are not written to this sink
+	struct list list;
+};
+
+// ----------------------------------------------------------------------------
+
+void console_register(struct console_sink *sink);
+void console_write(const char *data, size_t size, enum log_level level,
+				   uint8_t color);
+
+bool console_set_level(const char *name, enum log_level level);
+bool console_configure(const char *spec);
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* !KERNEL_CONSOLE_H_ */
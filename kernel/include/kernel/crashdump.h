@@ -0,0 +1,112 @@
+/*
+ * crashdump.h
+ *
+ * Binary crash dump streamed over the serial port by panic().
+ *
+ * This header is shared with the host-side decoder (tools/crashdump.c), so it
+ * must only depend on <stdint.h> and <stddef.h>.
+ *
+ * A dump is a header followed by sections, every field is little endian:
+ *
+ *	struct crashdump_header
+ *	struct crashdump_section + payload		(repeated)
+ *	struct crashdump_section (CD_END) + uint32_t crc32
+ *
+ * The CRC32 (IEEE 802.3) covers every byte from the header up to the CD_END
+ * section header (included). Section payloads:
+ *
+ *	CD_MSG			the panic message (not null terminated)
+ *	CD_REGS			struct crashdump_regs
+ *	CD_CALLCHAIN	struct crashdump_frame[], innermost first
+ *	CD_STACK		uint32_t address, followed by the stack bytes from there
+ *	CD_LOG			recent log messages (text)
+ *	CD_MEM			struct crashdump_mem
+ *	CD_TRACE		trace chunks (see <kernel/tracefmt.h>), one per context
+ *
+ * Unknown sections must be skipped by the decoder (their length is known).
+ */
+
+#ifndef KERNEL_CRASHDUMP_H_
+#define KERNEL_CRASHDUMP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#define CRASHDUMP_MAGIC		0x44434841 // "AHCD"
+#define CRASHDUMP_VERSION	1
+
+#define CRASHDUMP_MAX_FRAMES	32
+#define CRASHDUMP_STACK_BYTES	1024 // from the stack pointer (upward)
+
+// ----------------------------------------------------------------------------
+
+enum crashdump_section_type {
+	CD_MSG = 1,
+	CD_REGS = 2,
+	CD_CALLCHAIN = 3,
+	CD_STACK = 4,
+	CD_LOG = 5,
+	CD_MEM = 6,
+	CD_TRACE = 7,
+	CD_END = 0xffff,
+};
+
+// ----------------------------------------------------------------------------
+
+struct crashdump_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t reserved;
+	uint32_t tick; // clock tick at panic time
+};
+
+struct crashdump_section {
+	uint16_t type;
+	uint16_t reserved;
+	uint32_t len; // payload length (header excluded)
+};
+
+// as seen on panic() entry (eip is the panic() caller)
+struct crashdump_regs {
+	uint32_t eax, ebx, ecx, edx;
+	uint32_t esi, edi, ebp, esp;
+	uint32_t eip, eflags;
+	uint32_t cs, ds, es, fs, gs, ss;
+	uint32_t cr0, cr2, cr3, cr4;
+};
+
+struct crashdump_frame {
+	uint32_t ebp;
+	uint32_t eip;
+};
+
+struct crashdump_mem {
+	uint32_t pfa_regions;
+	uint32_t pfa_pages;
+	uint32_t pfa_free_pages;
+	uint32_t pfa_highmem_pages;
+	uint32_t pfa_highmem_free_pages;
+	uint32_t kmalloc_blocks;
+	uint32_t kmalloc_used_chunks;
+	uint32_t kmalloc_free_chunks;
+	uint32_t kmalloc_used_bytes;
+	uint32_t kmalloc_big;
+	uint32_t kmalloc_big_bytes;
+};
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+void crashdump_write(const char *msg, const struct crashdump_regs *regs,
+					 const struct crashdump_frame *frames, size_t nb_frames);
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* !KERNEL_CRASHDUMP_H_ */
@@ -7,6 +7,8 @@
 #ifndef KERNEL_INIT_H_
 #define KERNEL_INIT_H_
 
+#include <kernel/types.h>
+
 #include <multiboot.h>
 
 // ============================================================================
@@ -16,6 +18,8 @@
 void kernel_early_init(void);
 void kernel_init(multiboot_info_t *mbi);
 
+bool cmdline_has(const char *option);
+
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
@@ -44,6 +44,8 @@
 
 void setup_idt();
 
+extern volatile uint32_t g_interrupt_depth; // nested isr_handler() calls
+
 void enable_interrupts(void);
 void disable_interrupts(void);
 
@@ -2,11 +2,16 @@
  * log.h
  *
  * Helpers to print message with various priorities.
+ *
+ * Messages are formatted in an in-memory ring buffer (see log.c), the console
+ * sinks accepting their level are fed by log_flush() (see <kernel/console.h>).
  */
 
 #ifndef KERNEL_LOG_H_
 #define KERNEL_LOG_H_
 
+#include <kernel/types.h>
+
 #include <stdio.h>
 
 #include <drivers/terminal.h>
@@ -26,65 +31,131 @@ enum log_level
 
 // ----------------------------------------------------------------------------
 
+/*
+ * Messages above LOG_BUILD_LEVEL are not built in at all: no call, no format
+ * string (set with 'make LOG_LEVEL=<n>', 'n' being one of the levels above).
+ * The remaining ones are filtered at runtime by the level of their module.
+ */
+
+#ifndef LOG_BUILD_LEVEL
+#define LOG_BUILD_LEVEL 3 // LOG_DEBUG
+#endif
+
+// ----------------------------------------------------------------------------
+
 #if 0 // XXX: use this version if you want something more verbose
-#define log_macro_def(level, prefixe, fmt, ...)\
+#define log_macro_def(level, color, prefixe, fmt, ...)\
   do {\
-    if (g_log_level >= level) \
-      printf("[%s] %s: "prefixe fmt"\n", LOG_MODULE, __FUNCTION__, ##__VA_ARGS__); \
+    static struct log_site __log_site = { LOG_MODULE, 0, 0 }; \
+    if (log_enabled(&__log_site, level)) \
+      log_write(level, color, "[%s] %s: "prefixe fmt"\n", LOG_MODULE, __FUNCTION__, \
+                ##__VA_ARGS__); \
   } while (0)
 #else
-#define log_macro_def(level, prefixe, fmt, ...)\
+#define log_macro_def(level, color, prefixe, fmt, ...)\
   do {\
-    if (g_log_level >= level) \
-      printf("[%s] "prefixe fmt"\n", LOG_MODULE, ##__VA_ARGS__); \
+    static struct log_site __log_site = { LOG_MODULE, 0, 0 }; \
+    if (log_enabled(&__log_site, level)) \
+      log_write(level, color, "[%s] "prefixe fmt"\n", LOG_MODULE, ##__VA_ARGS__); \
   } while (0)
 #endif
 
+// keeps the arguments "used" (no warning), but the whole call is removed
+#define log_discard(fmt, ...)\
+  do {\
+    if (0) \
+      log_write(LOG_ERROR, 0, fmt, ##__VA_ARGS__); \
+  } while (0)
+
 // ----------------------------------------------------------------------------
 
+#if LOG_BUILD_LEVEL >= 3
 #define dbg(fmt, ...) \
-{\
-	terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));\
-	log_macro_def(LOG_DEBUG, "DBG: ", fmt, ##__VA_ARGS__); \
-	terminal_reset_color(); \
-}
+	log_macro_def(LOG_DEBUG, \
+		vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK), \
+		"DBG: ", fmt, ##__VA_ARGS__)
+#else
+#define dbg(fmt, ...) log_discard(fmt, ##__VA_ARGS__)
+#endif
 
+#if LOG_BUILD_LEVEL >= 2
 #define info(fmt, ...) \
-{\
-	terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));\
-	log_macro_def(LOG_INFO, "", fmt, ##__VA_ARGS__); \
-	terminal_reset_color(); \
-}
+	log_macro_def(LOG_INFO, \
+		vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK), \
+		"", fmt, ##__VA_ARGS__)
 
 #define success(fmt, ...) \
-{\
-	terminal_setcolor(vga_entry_color(VGA_COLOR_GREEN, VGA_COLOR_BLACK));\
-	log_macro_def(LOG_INFO, "", fmt, ##__VA_ARGS__); \
-	terminal_reset_color(); \
-}
+	log_macro_def(LOG_INFO, \
+		vga_entry_color(VGA_COLOR_GREEN, VGA_COLOR_BLACK), \
+		"", fmt, ##__VA_ARGS__)
+#else
+#define info(fmt, ...) log_discard(fmt, ##__VA_ARGS__)
+#define success(fmt, ...) log_discard(fmt, ##__VA_ARGS__)
+#endif
 
+#if LOG_BUILD_LEVEL >= 1
 #define warn(fmt, ...) \
-{\
-	terminal_setcolor(vga_entry_color(VGA_COLOR_BROWN, VGA_COLOR_BLACK));\
-	log_macro_def(LOG_WARN, "WARN: ", fmt, ##__VA_ARGS__); \
-	terminal_reset_color(); \
-}
+	log_macro_def(LOG_WARN, \
+		vga_entry_color(VGA_COLOR_BROWN, VGA_COLOR_BLACK), \
+		"WARN: ", fmt, ##__VA_ARGS__)
+#else
+#define warn(fmt, ...) log_discard(fmt, ##__VA_ARGS__)
+#endif
 
+// errors are always built in
 #define error(fmt, ...) \
-{\
-	terminal_setcolor(vga_entry_color(VGA_COLOR_RED, VGA_COLOR_BLACK));\
-	log_macro_def(LOG_ERROR, "ERROR: ", fmt, ##__VA_ARGS__); \
-	terminal_reset_color(); \
-}
+	log_macro_def(LOG_ERROR, \
+		vga_entry_color(VGA_COLOR_RED, VGA_COLOR_BLACK), \
+		"ERROR: ", fmt, ##__VA_ARGS__)
+
+// ----------------------------------------------------------------------------
+
+#define LOG_RING_SIZE	(16 * 1024) // must be a power-of-two
+#define LOG_LINE_MAX	1024 // formatted message, truncated above
+
+extern void log_write(enum log_level level, uint8_t color, const char *fmt,
+					  ...);
+extern void log_flush(void);
+extern void log_set_deferred(bool value);
+
+// crash dump helpers, iterate over the messages still in the ring
+extern uint32_t log_ring_first(void);
+extern const char* log_ring_next(uint32_t *pos, size_t *len);
 
 // ----------------------------------------------------------------------------
 
 extern void log_set_level(enum log_level level);
 extern enum log_level log_get_level(void);
+extern bool log_set_module_level(const char *module, enum log_level level);
+extern bool log_parse_level(const char *name, enum log_level *level);
+extern bool log_configure(const char *spec);
 
 // ----------------------------------------------------------------------------
 
-extern enum log_level g_log_level; // don't use it directly
+// one per call site, caches the level of its module
+struct log_site
+{
+	const char *module;
+	uint32_t gen; // g_log_gen when 'level' was looked up
+	enum log_level level;
+};
+
+extern uint32_t g_log_gen; // don't use it directly
+extern void log_site_update(struct log_site *site);
+
+/*
+ * Returns true if messages of @level are enabled at @site. The module level is
+ * only looked up again after a level change.
+ */
+
+static inline bool log_enabled(struct log_site *site, enum log_level level)
+{
+	if (site->gen != g_log_gen) {
+		log_site_update(site);
+	}
+
+	return site->level >= level;
+}
 
 // ============================================================================
 // ----------------------------------------------------------------------------
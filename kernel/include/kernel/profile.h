@@ -0,0 +1,33 @@
+/*
+ * profile.h
+ *
+ * Statistical sampling profiler driven by the clock interrupt (selected with
+ * the "profile" boot option).
+ */
+
+#ifndef KERNEL_PROFILE_H_
+#define KERNEL_PROFILE_H_
+
+#include <kernel/types.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#define PROFILE_SAMPLES		1024 // ring buffer size (power-of-two)
+#define PROFILE_MAX_DEPTH	16 // frames per sample (interrupted EIP included)
+#define PROFILE_MAX_FRAME	0x4000 // bytes, larger frames stop the walk
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+void profile_init(void);
+void profile_tick(uint32_t eip, uint32_t ebp);
+void profile_flush(void);
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* !KERNEL_PROFILE_H_ */
@@ -13,12 +13,10 @@
 // ----------------------------------------------------------------------------
 // ============================================================================
 
-#define SYMBOL_MAX_LEN 96
-
 struct symbol {
 	void *addr;
 	size_t len; // (optionnal) might be zero
-	char name[SYMBOL_MAX_LEN]; // a null terminated string
+	const char *name; // points into the symbol table (null terminated)
 };
 
 // ----------------------------------------------------------------------------
@@ -0,0 +1,73 @@
+/*
+ * symtab.h
+ *
+ * Binary symbol table format ('symbols.bin').
+ *
+ * The table is generated at build time by tools/mksymtab.c from the
+ * 'symbols.map' file and is used in place by the kernel (no parsing, no copy).
+ * This header is shared by both of them, so it must only depend on <stdint.h>.
+ *
+ * Layout (little endian, every section is 4-byte aligned):
+ *
+ *	struct symtab_header
+ *	uint32_t addrs[nb_syms]			symbol addresses, sorted
+ *	uint32_t lens[nb_syms]			symbol lengths (might be zero)
+ *	uint32_t names[nb_syms]			offsets in the string blob
+ *	uint32_t hash_heads[hash_size]	first symbol index of each bucket
+ *	uint32_t hash_next[nb_syms]		next symbol index in the same bucket
+ *	char strtab[strtab_size]		deduplicated null terminated names
+ *
+ * The hash table is optional (hash_size is zero if there is none). Otherwise
+ * hash_size is a power-of-two, names are hashed with FNV-1a and each chain is
+ * kept in address order.
+ */
+
+#ifndef KERNEL_SYMTAB_H_
+#define KERNEL_SYMTAB_H_
+
+#include <stdint.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#define SYMTAB_MAGIC	0x4d595341 // "ASYM"
+#define SYMTAB_VERSION	1
+
+#define SYMTAB_HASH_END ((uint32_t) -1) // end of a hash chain
+
+// ----------------------------------------------------------------------------
+
+struct symtab_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nb_syms;
+	uint32_t hash_size;
+	uint32_t strtab_size;
+	uint32_t size; // of the whole table (header included)
+};
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns the FNV-1a hash of the null terminated string @name.
+ */
+
+static inline uint32_t symtab_hash(const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name != '\0') {
+		hash ^= (uint8_t) *name++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* !KERNEL_SYMTAB_H_ */
@@ -0,0 +1,109 @@
+/*
+ * trace.h
+ *
+ * Always-on binary tracing, for hot paths where the log macros are too
+ * expensive.
+ *
+ * A trace() call neither formats nor copies any string: it stores the address
+ * of its format string, up to TRACE_MAX_ARGS raw 32-bit arguments and a TSC
+ * timestamp in the buffer of the current context (see <kernel/tracefmt.h>).
+ * The buffers are part of the crash dump, and are streamed over the serial
+ * port with the "trace" boot option. tools/tracedump.c formats the events.
+ *
+ * Arguments are truncated to 32 bits (use PHYS_ARG() for a physical address),
+ * and a "%s" argument is only decoded if the string belongs to the kernel
+ * image (e.g. a string literal).
+ */
+
+#ifndef KERNEL_TRACE_H_
+#define KERNEL_TRACE_H_
+
+#include <kernel/types.h>
+#include <kernel/interrupt.h>
+#include <kernel/tracefmt.h>
+
+#include <arch/tsc.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#define TRACE_EVENTS 512 // per context ring buffer size (power-of-two)
+
+struct trace_buffer
+{
+	volatile uint32_t head; // free running
+	struct trace_event events[TRACE_EVENTS];
+};
+
+extern struct trace_buffer g_trace_buffers[TRACE_CONTEXTS];
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Records an event in the buffer of the current context (overwriting the
+ * oldest one). A context is only interrupted by deeper ones, which have their
+ * own buffer, so nothing is locked.
+ */
+
+__attribute__((always_inline))
+static inline void trace_event(const char *fmt, uint32_t a0, uint32_t a1,
+							   uint32_t a2, uint32_t a3, uint32_t a4)
+{
+	const uint32_t depth = g_interrupt_depth;
+	struct trace_buffer *buf =
+		&g_trace_buffers[depth < TRACE_CONTEXTS ? depth : TRACE_CONTEXTS - 1];
+	const uint32_t head = buf->head;
+	struct trace_event *event = &buf->events[head & (TRACE_EVENTS - 1)];
+	const uint64_t tsc = rdtsc();
+
+	event->tsc_lo = (uint32_t) tsc;
+	event->tsc_hi = (uint32_t)(tsc >> 32);
+	event->fmt = (uint32_t) fmt;
+	event->args[0] = a0;
+	event->args[1] = a1;
+	event->args[2] = a2;
+	event->args[3] = a3;
+	event->args[4] = a4;
+
+	// publish the event once it is complete
+	asm volatile("" ::: "memory");
+	buf->head = head + 1;
+}
+
+// ----------------------------------------------------------------------------
+
+// expands @args (e.g. PHYS_ARG()) before they are counted and split
+#define __trace_apply(macro, args) macro args
+
+#define __trace_nargs_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define __trace_args_(_0, a0, a1, a2, a3, a4, ...) \
+	(uint32_t)(a0), (uint32_t)(a1), (uint32_t)(a2), (uint32_t)(a3), \
+	(uint32_t)(a4)
+
+// the format must be a string literal (it is decoded from the kernel image)
+#define trace(fmt, ...) \
+  do {\
+    _Static_assert(__trace_apply(__trace_nargs_, \
+                   (0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)) <= \
+                   TRACE_MAX_ARGS, "too many trace arguments"); \
+    trace_event("" fmt, __trace_apply(__trace_args_, \
+                (0, ##__VA_ARGS__, 0, 0, 0, 0, 0))); \
+  } while (0)
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+void trace_init(void);
+void trace_flush(void);
+
+// crash dump helpers
+size_t trace_dump_size(void);
+void trace_dump(void (*write)(const void *data, size_t len));
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* !KERNEL_TRACE_H_ */
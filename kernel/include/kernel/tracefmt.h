@@ -0,0 +1,65 @@
+/*
+ * tracefmt.h
+ *
+ * Binary trace format (see <kernel/trace.h>).
+ *
+ * This header is shared with the host-side decoder (tools/tracedump.c), so it
+ * must only depend on <stdint.h>.
+ *
+ * Traces are streamed as chunks of events from a single context, every field
+ * is little endian:
+ *
+ *	struct trace_chunk
+ *	struct trace_event events[nb_events]		oldest first
+ *
+ * An event only holds the address of its format string in the kernel image
+ * and its raw arguments (32-bit each). The decoder formats it with the string
+ * found at that address in the kernel ELF file.
+ */
+
+#ifndef KERNEL_TRACEFMT_H_
+#define KERNEL_TRACEFMT_H_
+
+#include <stdint.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#define TRACE_MAGIC		0x52544841 // "AHTR"
+#define TRACE_VERSION	1
+
+#define TRACE_MAX_ARGS	5
+
+// ----------------------------------------------------------------------------
+
+// every context has its own buffer, so that there is a single producer
+enum trace_context {
+	TRACE_CTX_THREAD = 0, // not in an interrupt handler
+	TRACE_CTX_IRQ = 1, // interrupt or exception handler
+	TRACE_CTX_NESTED = 2, // exception raised from an interrupt handler
+	TRACE_CONTEXTS = 3,
+};
+
+// ----------------------------------------------------------------------------
+
+struct trace_chunk {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t context;
+	uint32_t nb_events;
+	uint32_t lost; // events overwritten right before the first one
+};
+
+struct trace_event {
+	uint32_t tsc_lo; // Time-Stamp Counter
+	uint32_t tsc_hi;
+	uint32_t fmt; // format string address
+	uint32_t args[TRACE_MAX_ARGS];
+};
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* !KERNEL_TRACEFMT_H_ */
@@ -11,6 +11,16 @@
 // ----------------------------------------------------------------------------
 // ============================================================================
 
+#ifdef CONFIG_PAE
+typedef uint64_t phys_addr_t; // physical address (up to 52-bits with PAE)
+#else
+typedef uint32_t phys_addr_t; // physical address
+#endif
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
 // exported by linker
 extern uint32_t kernel_start_ldsym;
 extern uint32_t kernel_end_ldsym;
@@ -18,6 +28,8 @@ extern uint32_t kernel_code_start_ldsym;
 extern uint32_t kernel_code_end_ldsym;
 extern uint32_t kernel_rodata_start_ldsym;
 extern uint32_t kernel_rodata_end_ldsym;
+extern uint32_t kernel_symtab_start_ldsym;
+extern uint32_t kernel_symtab_end_ldsym;
 extern uint32_t kernel_data_start_ldsym;
 extern uint32_t kernel_data_end_ldsym;
 extern uint32_t kernel_bss_start_ldsym;
@@ -29,6 +41,8 @@ extern uint32_t kernel_bss_end_ldsym;
 #define kernel_code_end ((uint32_t)&kernel_code_end_ldsym)
 #define kernel_rodata_start ((uint32_t)&kernel_rodata_start_ldsym)
 #define kernel_rodata_end ((uint32_t)&kernel_rodata_end_ldsym)
+#define kernel_symtab_start ((uint32_t)&kernel_symtab_start_ldsym)
+#define kernel_symtab_end ((uint32_t)&kernel_symtab_end_ldsym)
 #define kernel_data_start ((uint32_t)&kernel_data_start_ldsym)
 #define kernel_data_end ((uint32_t)&kernel_data_end_ldsym)
 #define kernel_bss_start ((uint32_t)&kernel_bss_start_ldsym)
@@ -0,0 +1,36 @@
+/*
+ * cow.h
+ *
+ * Copy-On-Write page sharing.
+ */
+
+#ifndef MEM_COW_H_
+#define MEM_COW_H_
+
+#include <kernel/types.h>
+
+#include <mem/memory.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#define COW_HASH_SIZE 128 // shared page frames hash table (power-of-two)
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+void cow_setup(void);
+
+void* cow_snapshot(const void *src, size_t size);
+void cow_free(void *snapshot);
+
+bool cow_put(pgframe_t pgf);
+bool cow_fault(uint32_t fault_addr);
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* !MEM_COW_H_ */
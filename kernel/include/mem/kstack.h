@@ -0,0 +1,56 @@
+/*
+ * kstack.h
+ *
+ * Guard-page protected kernel stacks.
+ */
+
+#ifndef MEM_KSTACK_H_
+#define MEM_KSTACK_H_
+
+#include <kernel/types.h>
+#include <kernel/list.h>
+
+#include <mem/memory.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#define KSTACK_DEFAULT_PAGES 4 // 16KB, same as the boot stack
+
+// ----------------------------------------------------------------------------
+
+/*
+ * A kernel stack is made of @nb_pages mapped pages sitting right above an
+ * unmapped guard page. The stack grows downward from @top to @bottom, any
+ * access to [guard, bottom - 1] faults.
+ */
+
+struct kstack {
+	const char *owner;
+	uint32_t guard; // never mapped
+	uint32_t bottom; // lowest usable address
+	uint32_t top; // initial stack pointer (exclusive)
+	size_t nb_pages;
+	struct list list; // pointer in 'kstack_list'
+	pgframe_t frames[0]; // variable size (empty for the boot stack)
+};
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+void kstack_setup(void);
+
+struct kstack* kstack_alloc(const char *owner, size_t nb_pages);
+void kstack_free(struct kstack *stack);
+
+const char* kstack_guard_owner(uint32_t addr);
+
+void kstack_run(struct kstack *stack, void (*func)(void));
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* !MEM_KSTACK_H_ */
@@ -16,29 +16,136 @@
 #define PAGE_OFFSET(x) (((uint32_t)x) & (~PAGE_MASK))
 
 #define BAD_PAGE ((uint32_t) 0)
+#define BAD_PHYS_ADDR ((phys_addr_t) -1) // virt_to_phys() error value
+
+// physical addresses (or page table entries) are printed as two 32-bit halves,
+// so that the same format works with trace() (32-bit arguments only)
+#define PHYS_FMT "0x%x%08x"
+#define PHYS_ARG(addr) (uint32_t)((uint64_t)(addr) >> 32), (uint32_t)(addr)
+
+// ----------------------------------------------------------------------------
+
+typedef phys_addr_t pgframe_t; // represent the physical address of a page
+
+/*
+ * Aligns the physical address @addr on a PAGE_SIZE boundary.
+ *
+ * Same as page_align() (see below) but does not truncate addresses above 4GB.
+ */
+
+static inline phys_addr_t phys_page_align(phys_addr_t addr)
+{
+	return (addr + PAGE_SIZE - 1) & ~((phys_addr_t)PAGE_SIZE - 1);
+}
 
 // ----------------------------------------------------------------------------
 
-typedef uint32_t pgframe_t; // represent a 32-bit physical address of a page
+/*
+ * Kernel virtual memory layout:
+ *
+ *		+-------------------+ 0x00000000
+ *		| identity mapping  |
+ *		+-------------------+ 0xc0000000 (IDENTITY_MAP_END)
+ *		| vmem kernel arena |
+ *		+-------------------+ 0xe0000000
+ *		| demand-paged area |
+ *		+-------------------+ 0xf0000000
+ *		| kmap slots        |
+ *		+-------------------+ 0xf0400000
+ *		| (unused)          |
+ *		+-------------------+ PAGE_TABLES_BASE (0xffc00000 or 0xff800000)
+ *		| page tables       |
+ *		+-------------------+ 0xffffffff
+ *
+ * Physical memory above IDENTITY_MAP_END (a.k.a. "highmem") cannot be
+ * identity mapped. Its page frames are only handed out by pfa_alloc_highmem()
+ * to users mapping them at arbitrary virtual addresses (vmalloc, demand
+ * paging). With CONFIG_PAE, it includes memory above 4GB.
+ */
+
+#define IDENTITY_MAP_END	(0xc0000000)
+
+#define VMEM_START			(0xc0000000)
+#define VMEM_END			(0xe0000000)
+
+#define DEMAND_START		(0xe0000000)
+#define DEMAND_END			(0xf0000000)
+
+// fixed virtual pages to temporarily map a page frame (see kmap_scratch())
+#define KMAP_START			(0xf0000000)
+#define KMAP_END			(0xf0400000)
+#define KMAP_SCRATCH		(KMAP_START)
+#define KMAP_COW			(KMAP_START + PAGE_SIZE) // copy-on-write faults
 
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
 
+// page frame allocator summary (see pfa_get_stats())
+struct pfa_stats {
+	size_t nb_regions;
+	size_t nb_pages;
+	size_t free_pages;
+	size_t highmem_pages; // included in the above
+	size_t highmem_free_pages;
+};
+
 bool pfa_init(void);
 void pfa_map_metadata(void);
 pgframe_t pfa_alloc(size_t nb_pages);
+pgframe_t pfa_alloc_highmem(size_t nb_pages);
 void pfa_free(pgframe_t pgf);
+void pfa_get_stats(struct pfa_stats *stats);
 
 // ----------------------------------------------------------------------------
 
+// kmalloc summary (see kmalloc_get_stats())
+struct kmalloc_stats {
+	size_t nb_blocks;
+	size_t used_chunks;
+	size_t free_chunks;
+	size_t used_bytes; // in used chunks
+	size_t nb_big; // big allocations
+	size_t big_bytes;
+};
+
 void* kmalloc(size_t size);
 void kfree(void *ptr);
+void kmalloc_get_stats(struct kmalloc_stats *stats);
 
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
 
+/*
+ * Paging structures geometry.
+ *
+ * Without CONFIG_PAE, the classic two-level format is used: 1024 x 32-bit
+ * entries per table, a PDE covers 4MB. With CONFIG_PAE, entries are 64-bit
+ * and there are three levels: a 4-entry Page-Directory-Pointer Table (PDPT)
+ * points to four page directories of 512 entries, a PDE covers 2MB. The four
+ * page directories are physically contiguous so they can be indexed as a
+ * single 2048-entry page directory (see PD_INDEX()).
+ */
+
+#ifdef CONFIG_PAE
+	#define PTRS_PER_TABLE		(512)
+	#define PDE_SHIFT			(21)
+	#define PAGE_TABLES_BASE	(0xff800000)
+#else
+	#define PTRS_PER_TABLE		(1024)
+	#define PDE_SHIFT			(22)
+	#define PAGE_TABLES_BASE	(0xffc00000)
+#endif
+
+#define NB_PDE				(1 << (32 - PDE_SHIFT)) // over all page directories
+#define NB_PAGE_DIRECTORIES	(NB_PDE / PTRS_PER_TABLE)
+#define PDE_SELFMAP_INDEX	(PAGE_TABLES_BASE >> PDE_SHIFT)
+#define LARGE_PAGE_SIZE		(1 << PDE_SHIFT) // mapped by a single PDE
+#define PAGE_DIRECTORY_BASE	(PAGE_TABLES_BASE + PDE_SELFMAP_INDEX * PAGE_SIZE)
+
+// ----------------------------------------------------------------------------
+
 // Page-Directory Entry masks
 #define PDE_MASK_PRESENT			(1 << 0) // 1=page is in physical memory,
 											 // 0=attempt to access generates
@@ -49,9 +156,8 @@ void kfree(void *ptr);
 #define PDE_MASK_CACHE_DISABLED		(1 << 4) // 0=cached, 1=cache disabled
 #define PDE_MASK_ACCESSED			(1 << 5) // set by processor at first access
 #define PDE_MASK_RESERVED			(1 << 6) // unused (set to 0)
-#define PDE_MASK_PAGE_SIZE			(1 << 7) // 0=4kb, 1=4Mb
+#define PDE_MASK_PAGE_SIZE			(1 << 7) // 0=4kb, 1=4Mb (2Mb with PAE)
 #define PDE_MASK_GLOBAL_PAGE		(1 << 8) // ignored if point to page table
-#define PDE_MASK_ADDR				(0xfffff000) // Page-Table Base Address
 
 // Page-Table Entry masks
 #define PTE_MASK_PRESENT			(1 << 0) // 1=page is in physical memory,
@@ -65,29 +171,67 @@ void kfree(void *ptr);
 #define PTE_MASK_DIRTY				(1 << 6) // 1=page has been written to
 #define PTE_MASK_PT_ATTRIBUTE_INDEX	(1 << 7) // PAT enabled, otherwise reserved (=0)
 #define PTE_MASK_GLOBAL_PAGE		(1 << 8) // 1=not invalidated by TLB (see doc)
-#define PTE_MASK_ADDR				(0xfffff000) // Page Base Address
+#define PTE_MASK_DEMAND				(1 << 9) // (software) backed on first access
+#define PTE_MASK_COW				(1 << 10) // (software) shared, copied on write
+#define PTE_MASK_SOFTWARE			(7 << 9) // ignored by the processor
+
+// Large page (PDE_MASK_PAGE_SIZE) PDE masks
+#define PDE_MASK_LARGE_PAT			(1 << 12) // same as PTE_MASK_PT_ATTRIBUTE_INDEX
+
+#ifdef CONFIG_PAE
+	#define PDE_MASK_ADDR			(0x000ffffffffff000ULL) // Page-Table Base Address
+	#define PTE_MASK_ADDR			(0x000ffffffffff000ULL) // Page Base Address
+	#define PTE_MASK_NO_EXECUTE		(1ULL << 63) // instruction fetch faults (if NX)
+	#define PDE_MASK_LARGE_ADDR		(0x000fffffffe00000ULL) // 2MB Page Base Address
+
+	// Page-Directory-Pointer-Table Entry masks (only a few bits are allowed)
+	#define PDPTE_MASK_PRESENT		(1 << 0)
+#else
+	#define PDE_MASK_ADDR			(0xfffff000) // Page-Table Base Address
+	#define PTE_MASK_ADDR			(0xfffff000) // Page Base Address
+	#define PTE_MASK_NO_EXECUTE		(0) // not available without PAE
+	#define PDE_MASK_LARGE_ADDR		(0xffc00000) // 4MB Page Base Address
+#endif
 
 // ----------------------------------------------------------------------------
 
-// common flags for supervisor page-directory entry (read/write, not present)
-#define PDE_RW_KERNEL_NOCACHE ((pde_t) (PDE_MASK_READWRITE | \
-							   PDE_MASK_WRITE_THROUGH | \
-							   PDE_MASK_CACHE_DISABLED))
-
 // common flags for supervisor page-table entry (read/write, not present)
 #define PTE_RW_KERNEL_NOCACHE ((pte_t) (PTE_MASK_READWRITE | \
 							   PTE_MASK_WRITE_THROUGH | \
-							   PTE_MASK_CACHE_DISABLED))
+							   PTE_MASK_CACHE_DISABLED | \
+							   PTE_MASK_NO_EXECUTE))
+
+// same as above but executable (kernel code)
+#define PTE_RWX_KERNEL_NOCACHE ((pte_t) (PTE_MASK_READWRITE | \
+								PTE_MASK_WRITE_THROUGH | \
+								PTE_MASK_CACHE_DISABLED))
+
+// common flags for supervisor page-directory entry (read/write, not present)
+#define PDE_RW_KERNEL ((pde_t) PDE_MASK_READWRITE)
 
-// flags to check for consistenty between a pte flag and its pde. We want it to
-// be sync for now (until copy-on-write implementation?)
-#define PG_CONSISTENT_MASK (PTE_MASK_READWRITE | PTE_MASK_SUPERVISOR | \
-						   PTE_MASK_WRITE_THROUGH | PTE_MASK_CACHE_DISABLED)
+// flags of every PDE pointing to a page table (not present). The processor
+// combines both levels using the most restrictive one, so PDEs grant
+// everything and the permissions are only enforced by the PTEs. That is, pages
+// with different flags can share a page table. As for the caching flags, they
+// only apply to the page table itself at this level (cached).
+#define PDE_PERMISSIVE ((pde_t) (PDE_MASK_READWRITE | PDE_MASK_SUPERVISOR))
+
+// common flags for supervisor page-table entry (read/write, not present)
+#define PTE_RW_KERNEL ((pte_t) (PTE_MASK_READWRITE | PTE_MASK_NO_EXECUTE))
+
+// same as above but read-only (not present)
+#define PTE_RO_KERNEL ((pte_t) (PTE_MASK_NO_EXECUTE))
 
 // ----------------------------------------------------------------------------
 
+#ifdef CONFIG_PAE
+typedef uint64_t pte_t;
+typedef uint64_t pde_t;
+typedef uint64_t pdpte_t;
+#else
 typedef uint32_t pte_t;
 typedef uint32_t pde_t;
+#endif
 
 // ----------------------------------------------------------------------------
 
@@ -111,13 +255,135 @@ inline uint32_t page_align(uint32_t addr)
 
 // ----------------------------------------------------------------------------
 
+/*
+ * Invalidates the whole TLB cache.
+ *
+ * NOTE: This is an EXPENSIVE operation and must be avoided if possible.
+ *
+ * In addition, this won't works on SMP as it only flush a single CPU TLB
+ * cache. In SMP, this is more complexe, requires to send IPI, etc.
+ */
+
+static inline void invalidate_tlb(void)
+{
+	asm volatile("mov %%cr3, %%eax\n"
+				 "mov %%eax, %%cr3"
+				 : /* no output */
+				 : /* no input */
+				 : "eax", "memory");
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Invalidates a single TLB page table entry for virtual address @virt_addr.
+ *
+ * The CPU automatically retrieves the TLB PTE from the virtual address.
+ *
+ * Uses this version instead of invalidate_tlb() whenever possible.
+ *
+ * The TLB cache must be invalidated on page table operations (creation,
+ * modification, deletion).
+ *
+ * NOTE: The "invlpg" only exists since i486 processors. For older cpu, it
+ * falls back to a full TLB cache invalidation.
+ */
+
+static inline void invalidate_tlb_page(uint32_t virt_addr)
+{
+#if 0
+	// only for archictecture with a CPU lesser than i486 (not planned to
+	// support).
+	invalidate_tlb();
+#else
+	// we can use the 'invlpg' instruction
+	asm volatile("invlpg (%0)"
+				 : /* no output */
+				 :"r" (virt_addr)
+				 : "memory");
+#endif
+}
+
+// ----------------------------------------------------------------------------
+
 void paging_setup(void);
 
-bool map_page(uint32_t phys_addr, uint32_t virt_addr, uint32_t flags);
+bool map_page(phys_addr_t phys_addr, uint32_t virt_addr, pte_t flags);
 bool unmap_page(uint32_t virt_addr);
 
+pte_t* lookup_pte(uint32_t virt_addr);
+void paging_update_pte(uint32_t virt_addr, pte_t pte);
+
+size_t paging_promote(void);
+bool paging_split(uint32_t virt_addr);
+bool paging_reserve_refill(void);
+
+void* kmap_scratch(pgframe_t pgf);
+void kunmap_scratch(void);
+
 void page_fault_handler(int error);
 
+// ----------------------------------------------------------------------------
+
+/*
+ * Translates the kernel virtual address @ptr into a physical address, using
+ * the linear page tables window (PDE self-mapping). Paging must be enabled.
+ *
+ * The page tables are contiguous in the window, so the PTE of @ptr is simply
+ * the (@ptr >> 12)-th entry from PAGE_TABLES_BASE (no page-directory index
+ * arithmetic). The PDE must be checked first though, since the page table
+ * itself might not exist (or it might map a large page).
+ *
+ * Returns the physical address, or BAD_PHYS_ADDR if @ptr is not mapped.
+ */
+
+static inline phys_addr_t virt_to_phys(const void *ptr)
+{
+	const uint32_t virt_addr = (uint32_t)ptr;
+	const pde_t pde = ((pde_t*)PAGE_DIRECTORY_BASE)[virt_addr >> PDE_SHIFT];
+	pte_t pte = 0;
+
+	if (__builtin_expect(!(pde & PDE_MASK_PRESENT), 0)) {
+		return BAD_PHYS_ADDR;
+	}
+
+	if (pde & PDE_MASK_PAGE_SIZE) {
+		return (pde & PDE_MASK_LARGE_ADDR) |
+			(virt_addr & (LARGE_PAGE_SIZE - 1));
+	}
+
+	pte = ((pte_t*)PAGE_TABLES_BASE)[virt_addr >> 12];
+	if (__builtin_expect(!(pte & PTE_MASK_PRESENT), 0)) {
+		return BAD_PHYS_ADDR;
+	}
+
+	return (pte & PTE_MASK_ADDR) | PAGE_OFFSET(virt_addr);
+}
+
+// ----------------------------------------------------------------------------
+
+// physically contiguous part of a buffer (e.g. for DMA descriptors)
+struct sg_segment {
+	phys_addr_t addr;
+	size_t len;
+};
+
+size_t virt_to_sg(const void *buf, size_t len, struct sg_segment *segs,
+				  size_t max_segs);
+
+// ----------------------------------------------------------------------------
+
+struct demand_stats {
+	uint32_t nb_faults; // number of faults handled
+	uint64_t total_cycles; // time spent in the handler (TSC cycles)
+	uint64_t max_cycles; // worst case latency (TSC cycles)
+};
+
+void* demand_alloc(size_t size);
+void demand_free(void *ptr);
+bool demand_contains(const void *ptr, size_t size);
+void demand_get_stats(struct demand_stats *stats);
+
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
@@ -28,8 +28,8 @@ enum phys_mmap_type {
 
 // describe a memory region
 struct phys_mmap_entry {
-	uint32_t addr; // starting address (physical)
-	size_t len; // len in bytes
+	phys_addr_t addr; // starting address (physical)
+	phys_addr_t len; // len in bytes
 	enum phys_mmap_type type;
 };
 
@@ -0,0 +1,85 @@
+/*
+ * vmem.h
+ *
+ * Kernel Virtual Address Space Allocator.
+ */
+
+#ifndef MEM_VMEM_H_
+#define MEM_VMEM_H_
+
+#include <kernel/types.h>
+
+#include <mem/memory.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#define VMEM_NB_FREELISTS	32 // one per power-of-two
+#define VMEM_HASH_SIZE		64 // allocated segments hash table (power-of-two)
+#define VMEM_QCACHE_MAX		8 // maximum number of quantum caches
+#define VMEM_QCACHE_DEPTH	16 // number of cached ranges per quantum cache
+
+// ----------------------------------------------------------------------------
+
+struct vmem_seg;
+
+// caches ranges of (index + 1) quanta
+struct vmem_qcache {
+	size_t nb_cached;
+	struct vmem_seg *segs[VMEM_QCACHE_DEPTH]; // still in the arena's hash
+};
+
+// ----------------------------------------------------------------------------
+
+/*
+ * An arena manages the [base, base + size - 1] range in @quantum units.
+ *
+ * Do not manipulate the fields directly, use the vmem_*() API instead.
+ */
+
+struct vmem {
+	const char *name;
+	uint32_t base;
+	size_t size;
+	size_t quantum;
+	size_t in_use; // in bytes (quantum cached ranges excluded)
+	struct list seg_list; // every segments, sorted by address
+	uint32_t freemap; // bit N is set if freelists[N] is not empty
+	struct list freelists[VMEM_NB_FREELISTS];
+	struct list hash[VMEM_HASH_SIZE];
+	size_t nb_qcaches;
+	struct vmem_qcache qcaches[VMEM_QCACHE_MAX];
+};
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+extern struct vmem kernel_vmem;
+
+// ----------------------------------------------------------------------------
+
+bool vmem_init(struct vmem *vm, const char *name, uint32_t base, size_t size,
+			   size_t quantum, size_t nb_qcaches);
+uint32_t vmem_alloc(struct vmem *vm, size_t size);
+size_t vmem_free(struct vmem *vm, uint32_t addr);
+size_t vmem_size(struct vmem *vm, uint32_t addr);
+bool vmem_contains(struct vmem *vm, uint32_t addr, size_t size);
+
+// ----------------------------------------------------------------------------
+
+void vmem_setup(void);
+
+void* vmalloc(size_t size);
+void vfree(void *ptr);
+bool vmalloc_contains(const void *ptr, size_t size);
+
+void* ioremap(phys_addr_t phys_addr, size_t size);
+void iounmap(void *ptr);
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* !MEM_VMEM_H_ */
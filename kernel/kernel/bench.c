@@ -0,0 +1,511 @@
+/*
+ * bench.c
+ *
+ * In-kernel micro-benchmarks (selected with the "bench" boot option).
+ *
+ * Times the paging primitives with the TSC: mapping/unmapping a single page,
+ * a whole page table (1 PDE) and several page tables (many-PDE span), page
+ * table creation, TLB invalidations, and accesses through cached vs uncached
+ * mappings. Also compares the libc memcpy(), memset() and memmove() with
+ * byte loops, over a range of sizes, and times clear_page() (the variants
+ * selected at boot, boot with "nosse" to compare them) and the integer
+ * conversions of sprintf().
+ *
+ * Every benchmark reports one line per measured operation, in cycles:
+ *
+ *   BENCH name=<operation> samples=<n> median=<cycles> p99=<cycles>
+ *
+ * The results are enclosed between "BENCH begin" and "BENCH end" lines, so
+ * they can be extracted from the serial output.
+ *
+ * NOTE: Interrupts are disabled while measuring, the numbers only account for
+ * the operation itself (and the TSC reads).
+ */
+
+#include <kernel/bench.h>
+#include <kernel/interrupt.h>
+#include <kernel/log.h>
+
+#include <mem/memory.h>
+#include <mem/vmem.h>
+
+#include <arch/cpu.h>
+#include <arch/tsc.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define LOG_MODULE "bench"
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+static uint32_t samples[BENCH_SAMPLES];
+static uint32_t samples2[BENCH_SAMPLES];
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Sorts the @nb_samples first entries of @array (insertion sort, the arrays
+ * are small).
+ */
+
+static void sort_samples(uint32_t *array, size_t nb_samples)
+{
+	for (size_t i = 1; i < nb_samples; ++i) {
+		const uint32_t val = array[i];
+		size_t j = i;
+
+		while ((j > 0) && (array[j - 1] > val)) {
+			array[j] = array[j - 1];
+			j--;
+		}
+		array[j] = val;
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Prints the median and 99th percentile of @array (which gets sorted).
+ */
+
+static void bench_report(const char *name, uint32_t *array, size_t nb_samples)
+{
+	size_t p99 = (nb_samples * 99 + 99) / 100; // rounded up (1-based)
+
+	if (nb_samples == 0) {
+		printf("BENCH name=%s samples=0\n", name);
+		return;
+	}
+
+	sort_samples(array, nb_samples);
+
+	printf("BENCH name=%s samples=%u median=%u p99=%u\n", name, nb_samples,
+		array[nb_samples / 2], array[p99 - 1]);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns the first @align aligned address in [@addr, @addr + @align - 1].
+ */
+
+static inline uint32_t align_up(uint32_t addr, uint32_t align)
+{
+	return (addr + align - 1) & ~(align - 1);
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+static void bench_single_page(uint32_t virt_addr, pgframe_t pgf)
+{
+	for (size_t i = 0; i < BENCH_SAMPLES; ++i) {
+		uint64_t t0, t1, t2;
+
+		disable_interrupts();
+		t0 = rdtsc();
+		map_page(pgf, virt_addr, PTE_RW_KERNEL);
+		t1 = rdtsc();
+		unmap_page(virt_addr);
+		t2 = rdtsc();
+		enable_interrupts();
+
+		samples[i] = (uint32_t)(t1 - t0);
+		samples2[i] = (uint32_t)(t2 - t1);
+	}
+
+	bench_report("map_page", samples, BENCH_SAMPLES);
+	bench_report("unmap_page", samples2, BENCH_SAMPLES);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Maps (then unmaps) @nb_pages consecutive pages from @virt_addr, all of them
+ * aliasing @pgf. The first round is not accounted: it creates the page
+ * tables.
+ */
+
+static void bench_span(const char *map_name, const char *unmap_name,
+					   uint32_t virt_addr, size_t nb_pages, pgframe_t pgf)
+{
+	for (size_t i = 0; i <= BENCH_SPAN_SAMPLES; ++i) {
+		uint64_t t0, t1, t2;
+
+		disable_interrupts();
+		t0 = rdtsc();
+		for (size_t page = 0; page < nb_pages; ++page) {
+			map_page(pgf, virt_addr + page * PAGE_SIZE, PTE_RW_KERNEL);
+		}
+		t1 = rdtsc();
+		for (size_t page = 0; page < nb_pages; ++page) {
+			unmap_page(virt_addr + page * PAGE_SIZE);
+		}
+		t2 = rdtsc();
+		enable_interrupts();
+
+		if (i > 0) {
+			samples[i - 1] = (uint32_t)(t1 - t0);
+			samples2[i - 1] = (uint32_t)(t2 - t1);
+		}
+	}
+
+	bench_report(map_name, samples, BENCH_SPAN_SAMPLES);
+	bench_report(unmap_name, samples2, BENCH_SPAN_SAMPLES);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Maps a page in @nb_tables page-table-less ranges from @virt_addr, so every
+ * map_page() also creates a page table (taken from the reserve). The page
+ * tables are kept afterward.
+ */
+
+static void bench_new_table(uint32_t virt_addr, size_t nb_tables, pgframe_t pgf)
+{
+	size_t nb_samples = 0;
+
+	for (size_t i = 0; i < nb_tables; ++i) {
+		const uint32_t addr = virt_addr + i * LARGE_PAGE_SIZE;
+		uint64_t t0, t1;
+
+		if (lookup_pte(addr) != NULL) {
+			// created earlier (e.g. pre-populated)
+			continue;
+		}
+
+		// not accounted, keep the reserve filled
+		paging_reserve_refill();
+
+		disable_interrupts();
+		t0 = rdtsc();
+		map_page(pgf, addr, PTE_RW_KERNEL);
+		t1 = rdtsc();
+		enable_interrupts();
+
+		unmap_page(addr);
+		samples[nb_samples++] = (uint32_t)(t1 - t0);
+	}
+
+	bench_report("map_page_new_table", samples, nb_samples);
+}
+
+// ----------------------------------------------------------------------------
+
+static void bench_tlb(uint32_t virt_addr)
+{
+	for (size_t i = 0; i < BENCH_SAMPLES; ++i) {
+		uint64_t t0, t1, t2;
+
+		disable_interrupts();
+		t0 = rdtsc();
+		invalidate_tlb();
+		t1 = rdtsc();
+		invalidate_tlb_page(virt_addr);
+		t2 = rdtsc();
+		enable_interrupts();
+
+		samples[i] = (uint32_t)(t1 - t0);
+		samples2[i] = (uint32_t)(t2 - t1);
+	}
+
+	bench_report("invalidate_tlb", samples, BENCH_SAMPLES);
+	bench_report("invalidate_tlb_page", samples2, BENCH_SAMPLES);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Writes then reads a whole page through a mapping of @pgf with @flags.
+ */
+
+static void bench_access(const char *write_name, const char *read_name,
+						 uint32_t virt_addr, pgframe_t pgf, pte_t flags)
+{
+	volatile uint32_t *page = (volatile uint32_t*) virt_addr;
+
+	map_page(pgf, virt_addr, flags);
+
+	for (size_t i = 0; i < BENCH_SAMPLES; ++i) {
+		uint32_t sum = 0;
+		uint64_t t0, t1, t2;
+
+		disable_interrupts();
+		t0 = rdtsc();
+		memset((void*)virt_addr, (int)i, PAGE_SIZE);
+		t1 = rdtsc();
+		for (size_t word = 0; word < (PAGE_SIZE / sizeof(*page)); ++word) {
+			sum += page[word];
+		}
+		t2 = rdtsc();
+		enable_interrupts();
+
+		(void) sum;
+		samples[i] = (uint32_t)(t1 - t0);
+		samples2[i] = (uint32_t)(t2 - t1);
+	}
+
+	unmap_page(virt_addr);
+
+	bench_report(write_name, samples, BENCH_SAMPLES);
+	bench_report(read_name, samples2, BENCH_SAMPLES);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Byte loop references for the string benchmarks. GCC must not turn them into
+ * calls to the functions they are compared with.
+ */
+
+#define BYTE_LOOP __attribute__((noinline, \
+	optimize("no-tree-loop-distribute-patterns")))
+
+static BYTE_LOOP void memcpy_bytes(uint8_t *dst, uint8_t *src, size_t size)
+{
+	for (size_t i = 0; i < size; ++i) {
+		dst[i] = src[i];
+	}
+}
+
+static BYTE_LOOP void memset_bytes(uint8_t *dst, uint8_t *src, size_t size)
+{
+	(void) src;
+	for (size_t i = 0; i < size; ++i) {
+		dst[i] = 0x5a;
+	}
+}
+
+static BYTE_LOOP void memmove_bytes(uint8_t *dst, uint8_t *src, size_t size)
+{
+	// overlapping, backward
+	for (size_t i = size; i > 0; --i) {
+		dst[i - 1] = src[i - 1];
+	}
+}
+
+static void memcpy_libc(uint8_t *dst, uint8_t *src, size_t size)
+{
+	memcpy(dst, src, size);
+}
+
+static void memset_libc(uint8_t *dst, uint8_t *src, size_t size)
+{
+	(void) src;
+	memset(dst, 0x5a, size);
+}
+
+static void memmove_libc(uint8_t *dst, uint8_t *src, size_t size)
+{
+	memmove(dst, src, size);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Times the string functions (and their byte loop references) on sizes from
+ * 16 bytes to BENCH_STRING_MAX_SIZE. @dst and @src hold BENCH_STRING_MAX_SIZE
+ * bytes plus BENCH_STRING_SLACK; the memmove() destination overlaps its
+ * source (backward copy).
+ */
+
+static void bench_string(uint8_t *dst, uint8_t *src)
+{
+	static const struct {
+		const char *name;
+		void (*func)(uint8_t *dst, uint8_t *src, size_t size);
+		bool overlap;
+	} funcs[] = {
+		{ "memcpy", memcpy_libc, false },
+		{ "memcpy_bytes", memcpy_bytes, false },
+		{ "memset", memset_libc, false },
+		{ "memset_bytes", memset_bytes, false },
+		{ "memmove", memmove_libc, true },
+		{ "memmove_bytes", memmove_bytes, true },
+	};
+	char name[32];
+	void *page = NULL;
+
+	for (size_t size = 16; size <= BENCH_STRING_MAX_SIZE; size *= 4) {
+		for (size_t f = 0; f < (sizeof(funcs) / sizeof(funcs[0])); ++f) {
+			uint8_t *to = funcs[f].overlap ? src + BENCH_STRING_SLACK : dst;
+
+			// warm up the caches (not accounted)
+			funcs[f].func(to, src, size);
+
+			for (size_t i = 0; i < BENCH_SAMPLES; ++i) {
+				uint64_t t0, t1;
+
+				disable_interrupts();
+				t0 = rdtsc();
+				funcs[f].func(to, src, size);
+				t1 = rdtsc();
+				enable_interrupts();
+
+				samples[i] = (uint32_t)(t1 - t0);
+			}
+
+			sprintf(name, "%s_%u", funcs[f].name, size);
+			bench_report(name, samples, BENCH_SAMPLES);
+		}
+	}
+
+	// the buffer spans at least 4 pages, the aligned one is within
+	page = (void*) align_up((uint32_t) dst, PAGE_SIZE);
+	for (size_t i = 0; i < BENCH_SAMPLES; ++i) {
+		uint64_t t0, t1;
+
+		disable_interrupts();
+		t0 = rdtsc();
+		clear_page(page);
+		t1 = rdtsc();
+		enable_interrupts();
+
+		samples[i] = (uint32_t)(t1 - t0);
+	}
+	bench_report("clear_page", samples, BENCH_SAMPLES);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Times sprintf() on integer conversions (32-bit decimal and hexadecimal,
+ * 64-bit decimal), with values of every magnitude.
+ */
+
+static void bench_format(void)
+{
+	static const struct {
+		const char *name;
+		const char *fmt;
+		bool wide;
+	} formats[] = {
+		{ "sprintf_u32", "%u", false },
+		{ "sprintf_x32", "%08x", false },
+		{ "sprintf_llu", "%llu", true },
+	};
+	char buf[32];
+
+	for (size_t f = 0; f < (sizeof(formats) / sizeof(formats[0])); ++f) {
+		uint64_t val = 0x9e3779b97f4a7c15ULL;
+
+		for (size_t i = 0; i < BENCH_SAMPLES; ++i) {
+			uint64_t t0, t1;
+
+			// drops up to 63 bits, so that the lengths vary
+			val = val * 6364136223846793005ULL + 1442695040888963407ULL;
+
+			disable_interrupts();
+			t0 = rdtsc();
+			if (formats[f].wide) {
+				sprintf(buf, formats[f].fmt, val >> (i & 63));
+			} else {
+				sprintf(buf, formats[f].fmt, (uint32_t)(val >> (i & 31)));
+			}
+			t1 = rdtsc();
+			enable_interrupts();
+
+			samples[i] = (uint32_t)(t1 - t0);
+		}
+
+		bench_report(formats[f].name, samples, BENCH_SAMPLES);
+	}
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Runs every benchmark and prints the results. The virtual address ranges
+ * come from the kernel vmem arena and are released once done (the page tables
+ * created on the way are kept).
+ */
+
+void bench_run(void)
+{
+	const size_t span_size = (BENCH_SPAN_PDES + 1) * LARGE_PAGE_SIZE;
+	const size_t new_table_size = (BENCH_NEW_TABLE_SAMPLES + 1) * LARGE_PAGE_SIZE;
+	uint32_t span_range = 0;
+	uint32_t new_table_range = 0;
+	uint32_t base = 0;
+	pgframe_t pgf = BAD_PAGE;
+	uint8_t *string_dst = NULL;
+	uint8_t *string_src = NULL;
+
+	info("running benchmarks...");
+
+	if ((pgf = pfa_alloc_highmem(1)) == BAD_PAGE) {
+		error("not enough memory");
+		return;
+	}
+
+	if ((span_range = vmem_alloc(&kernel_vmem, span_size)) == 0) {
+		error("failed to reserve the span range");
+		goto free_pgf;
+	}
+
+	if ((new_table_range = vmem_alloc(&kernel_vmem, new_table_size)) == 0) {
+		error("failed to reserve the page table range");
+		goto free_span;
+	}
+
+	string_dst = kmalloc(BENCH_STRING_MAX_SIZE + BENCH_STRING_SLACK);
+	string_src = kmalloc(BENCH_STRING_MAX_SIZE + BENCH_STRING_SLACK);
+	if ((string_dst == NULL) || (string_src == NULL)) {
+		error("failed to allocate the string buffers");
+		goto free_string;
+	}
+	memset(string_src, 0xa5, BENCH_STRING_MAX_SIZE + BENCH_STRING_SLACK);
+
+	printf("BENCH begin\n");
+
+	// page table aligned, so the spans cover exactly 1 or N page tables
+	base = align_up(span_range, LARGE_PAGE_SIZE);
+
+	bench_span("map_span_1pde", "unmap_span_1pde", base, PTRS_PER_TABLE, pgf);
+	bench_span("map_span_npde", "unmap_span_npde", base,
+		BENCH_SPAN_PDES * PTRS_PER_TABLE, pgf);
+
+	// the page tables are there now
+	bench_single_page(base, pgf);
+	bench_tlb(base);
+	bench_access("write_page_cached", "read_page_cached", base, pgf,
+		PTE_RW_KERNEL);
+	bench_access("write_page_uncached", "read_page_uncached", base, pgf,
+		PTE_RW_KERNEL_NOCACHE);
+
+	bench_new_table(align_up(new_table_range, LARGE_PAGE_SIZE),
+		BENCH_NEW_TABLE_SAMPLES, pgf);
+
+	bench_string(string_dst, string_src);
+	bench_format();
+
+	printf("BENCH end\n");
+
+free_string:
+	if (string_src != NULL) {
+		kfree(string_src);
+	}
+	if (string_dst != NULL) {
+		kfree(string_dst);
+	}
+	vmem_free(&kernel_vmem, new_table_range);
+free_span:
+	vmem_free(&kernel_vmem, span_range);
+free_pgf:
+	pfa_free(pgf);
+
+	success("benchmarks complete");
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
@@ -0,0 +1,112 @@
+/*
+ * console.c
+ *
+ * Console sinks registry (see <kernel/console.h>).
+ *
+ * Sinks are registered by the drivers during the early initialization and
+ * never removed, so the list is walked without any lock (interrupts are still
+ * disabled when the sinks are registered).
+ */
+
+#include <kernel/console.h>
+
+#include <string.h>
+
+#define LOG_MODULE "console"
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+static LIST_DECLARE(sinks);
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Adds @sink to the console, it receives every message written from now on
+ * (up to its level).
+ */
+
+void console_register(struct console_sink *sink)
+{
+	list_add_tail(&sink->list, &sinks);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Writes the @size bytes at @data to every sink which accepts messages of
+ * @level, in @color (or CONSOLE_DEFAULT_COLOR).
+ */
+
+void console_write(const char *data, size_t size, enum log_level level,
+				   uint8_t color)
+{
+	struct console_sink *sink = NULL;
+
+	list_for_each_entry(sink, &sinks, list) {
+		if (sink->level >= level) {
+			sink->write(data, size, color);
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Sets the level of the @name sink.
+ *
+ * Returns false if there is no such sink.
+ */
+
+bool console_set_level(const char *name, enum log_level level)
+{
+	struct console_sink *sink = NULL;
+
+	list_for_each_entry(sink, &sinks, list) {
+		if (strcmp(sink->name, name) == 0) {
+			sink->level = level;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Applies a "sink:level" specification (e.g. "terminal:warn"), the level is
+ * one of the log levels (see log_parse_level()).
+ *
+ * Returns false if @spec is invalid.
+ */
+
+bool console_configure(const char *spec)
+{
+	char name[16];
+	const char *level = strchr(spec, ':');
+	enum log_level value;
+	size_t len = 0;
+
+	if (level == NULL) {
+		return false;
+	}
+
+	len = level - spec;
+	if ((len == 0) || (len >= sizeof(name)) ||
+		(log_parse_level(level + 1, &value) == false))
+	{
+		return false;
+	}
+	memcpy(name, spec, len);
+	name[len] = '\0';
+
+	return console_set_level(name, value);
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
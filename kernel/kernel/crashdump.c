@@ -0,0 +1,243 @@
+/*
+ * crashdump.c
+ *
+ * Binary crash dump streamed over the serial port by panic() (see
+ * <kernel/crashdump.h> for the format, tools/crashdump.c decodes it).
+ *
+ * Nothing here goes through printf() nor allocates memory: the records are
+ * written as they are, and the CRC32 is computed on the fly.
+ */
+
+#include <kernel/crashdump.h>
+#include <kernel/types.h>
+#include <kernel/log.h>
+#include <kernel/trace.h>
+
+#include <drivers/clock.h>
+#include <drivers/serial.h>
+
+#include <mem/memory.h>
+
+#include <string.h>
+
+#define LOG_MODULE "crashdump"
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+static bool dump_in_progress = false;
+static uint32_t dump_crc = 0;
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Updates the running CRC32 (IEEE 802.3, reflected) with @len bytes at @data.
+ * Bitwise, a lookup table is not worth it for a single dump.
+ */
+
+static void crc32_update(const uint8_t *data, size_t len)
+{
+	uint32_t crc = dump_crc;
+
+	for (size_t i = 0; i < len; ++i) {
+		crc ^= data[i];
+		for (size_t bit = 0; bit < 8; ++bit) {
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		}
+	}
+
+	dump_crc = crc;
+}
+
+// ----------------------------------------------------------------------------
+
+static void emit(const void *data, size_t len)
+{
+	crc32_update((const uint8_t*) data, len);
+	serial_write((const char*) data, len);
+}
+
+// ----------------------------------------------------------------------------
+
+static void emit_section(uint16_t type, const void *data, size_t len)
+{
+	struct crashdump_section section = {
+		.type = type,
+		.reserved = 0,
+		.len = len,
+	};
+
+	emit(&section, sizeof(section));
+	emit(data, len);
+}
+
+// ----------------------------------------------------------------------------
+
+#define CR0_PG (1u << 31) // paging enabled
+
+/*
+ * Dumps the stack from @esp, up to CRASHDUMP_STACK_BYTES but stopping at the
+ * first unmapped page (e.g. above the top of a kernel stack). The page tables
+ * are only looked up if paging is enabled in @cr0.
+ */
+
+static void emit_stack(uint32_t esp, uint32_t cr0)
+{
+	struct crashdump_section section = {
+		.type = CD_STACK,
+		.reserved = 0,
+		.len = 0,
+	};
+	uint32_t len = 0;
+
+	while (len < CRASHDUMP_STACK_BYTES) {
+		const uint32_t addr = esp + len;
+		uint32_t chunk = PAGE_SIZE - PAGE_OFFSET(addr);
+
+		if ((cr0 & CR0_PG) && (virt_to_phys((void*)addr) == BAD_PHYS_ADDR)) {
+			break;
+		}
+		if (chunk > (CRASHDUMP_STACK_BYTES - len)) {
+			chunk = CRASHDUMP_STACK_BYTES - len;
+		}
+		len += chunk;
+	}
+
+	section.len = sizeof(esp) + len;
+	emit(&section, sizeof(section));
+	emit(&esp, sizeof(esp));
+	emit((const void*) esp, len);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Dumps the messages still in the log ring buffer (flushed or not), oldest
+ * first. The ring is walked twice: once for the section length, once for the
+ * text.
+ */
+
+static void emit_log(void)
+{
+	struct crashdump_section section = {
+		.type = CD_LOG,
+		.reserved = 0,
+		.len = 0,
+	};
+	const char *text = NULL;
+	uint32_t pos = 0;
+	size_t len = 0;
+
+	pos = log_ring_first();
+	while ((text = log_ring_next(&pos, &len)) != NULL) {
+		section.len += len;
+	}
+
+	emit(&section, sizeof(section));
+
+	pos = log_ring_first();
+	while ((text = log_ring_next(&pos, &len)) != NULL) {
+		emit(text, len);
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static void emit_trace(void)
+{
+	struct crashdump_section section = {
+		.type = CD_TRACE,
+		.reserved = 0,
+		.len = trace_dump_size(),
+	};
+
+	emit(&section, sizeof(section));
+	trace_dump(emit);
+}
+
+// ----------------------------------------------------------------------------
+
+static void emit_mem(void)
+{
+	struct crashdump_mem mem;
+	struct pfa_stats pfa;
+	struct kmalloc_stats km;
+
+	pfa_get_stats(&pfa);
+	kmalloc_get_stats(&km);
+
+	mem.pfa_regions = pfa.nb_regions;
+	mem.pfa_pages = pfa.nb_pages;
+	mem.pfa_free_pages = pfa.free_pages;
+	mem.pfa_highmem_pages = pfa.highmem_pages;
+	mem.pfa_highmem_free_pages = pfa.highmem_free_pages;
+	mem.kmalloc_blocks = km.nb_blocks;
+	mem.kmalloc_used_chunks = km.used_chunks;
+	mem.kmalloc_free_chunks = km.free_chunks;
+	mem.kmalloc_used_bytes = km.used_bytes;
+	mem.kmalloc_big = km.nb_big;
+	mem.kmalloc_big_bytes = km.big_bytes;
+
+	emit_section(CD_MEM, &mem, sizeof(mem));
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Streams a crash dump over the serial port: the panic @msg, the registers
+ * @regs, the @nb_frames call chain @frames, the top of the stack, the recent
+ * log messages and trace events, and the memory allocators summary.
+ *
+ * The allocators are walked last, since their metadata might be the reason of
+ * the panic. Should it panic again, the nested dump is skipped and the decoder
+ * reports a truncated dump.
+ */
+
+void crashdump_write(const char *msg, const struct crashdump_regs *regs,
+					 const struct crashdump_frame *frames, size_t nb_frames)
+{
+	struct crashdump_header hdr;
+	struct crashdump_section end = {
+		.type = CD_END,
+		.reserved = 0,
+		.len = sizeof(uint32_t),
+	};
+
+	if (dump_in_progress) {
+		return;
+	}
+	dump_in_progress = true;
+
+	if (nb_frames > CRASHDUMP_MAX_FRAMES) {
+		nb_frames = CRASHDUMP_MAX_FRAMES;
+	}
+
+	dump_crc = 0xffffffff;
+
+	hdr.magic = CRASHDUMP_MAGIC;
+	hdr.version = CRASHDUMP_VERSION;
+	hdr.reserved = 0;
+	hdr.tick = clock_gettick();
+	emit(&hdr, sizeof(hdr));
+
+	emit_section(CD_MSG, msg, strlen(msg));
+	emit_section(CD_REGS, regs, sizeof(*regs));
+	emit_section(CD_CALLCHAIN, frames, nb_frames * sizeof(*frames));
+	emit_stack(regs->esp, regs->cr0);
+	emit_log();
+	emit_trace();
+	emit_mem();
+
+	emit(&end, sizeof(end));
+	dump_crc ^= 0xffffffff;
+	serial_write((const char*) &dump_crc, sizeof(dump_crc));
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
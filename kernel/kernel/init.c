@@ -7,9 +7,13 @@
 #include <kernel/init.h>
 #include <kernel/interrupt.h>
 #include <kernel/log.h>
+#include <kernel/console.h>
 #include <kernel/symbol.h>
+#include <kernel/profile.h>
+#include <kernel/trace.h>
 
 #include <drivers/serial.h>
+#include <drivers/debugcon.h>
 #include <drivers/clock.h>
 #include <drivers/ps2ctrl.h>
 #include <drivers/terminal.h>
@@ -17,15 +21,104 @@
 
 #include <mem/memory.h>
 #include <mem/pmm.h>
+#include <mem/vmem.h>
+#include <mem/kstack.h>
+#include <mem/cow.h>
 
+#include <arch/cpu.h>
 #include <arch/gdt.h>
 
+#include <string.h>
+
 #define LOG_MODULE "init"
 
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
 
+#define CMDLINE_MAX 256
+
+static char cmdline[CMDLINE_MAX]; // copy of the multiboot command line
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Saves the boot command line, as 'mbi' cannot be used past mem_init().
+ */
+
+static void cmdline_init(multiboot_info_t *mbi)
+{
+	const char *src = NULL;
+	size_t len = 0;
+
+	if ((mbi->flags & MULTIBOOT_INFO_CMDLINE) == 0) {
+		return;
+	}
+
+	src = (const char*) mbi->cmdline;
+	len = strnlen(src, sizeof(cmdline) - 1);
+	memcpy(cmdline, src, len);
+	cmdline[len] = '\0';
+
+	info("command line: %s", cmdline);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Applies the "log=[module:]level" options of the command line, e.g.
+ * "log=pfa:debug log=ps2ctrl:warn" (see log_configure()), and the
+ * "console=sink:level" ones, e.g. "console=terminal:warn" (see
+ * console_configure()).
+ *
+ * NOTE: The dbg() messages are only built in with 'make LOG_LEVEL=3',
+ * "log=pfa:debug" has no effect otherwise (a warning says so).
+ */
+
+static void cmdline_log_levels(void)
+{
+	const char *word = cmdline;
+
+	while (*word != '\0') {
+		const char *end = word;
+		char spec[32];
+
+		while ((*end != '\0') && (*end != ' ')) {
+			end++;
+		}
+
+		if (((size_t)(end - word) > 4) && (memcmp(word, "log=", 4) == 0)) {
+			const size_t len = end - word - 4;
+
+			if (len < sizeof(spec)) {
+				memcpy(spec, word + 4, len);
+				spec[len] = '\0';
+			}
+			if ((len >= sizeof(spec)) || (log_configure(spec) == false)) {
+				warn("invalid option: %.*s", (int)(end - word), word);
+			}
+		} else if (((size_t)(end - word) > 8) &&
+				   (memcmp(word, "console=", 8) == 0))
+		{
+			const size_t len = end - word - 8;
+
+			if (len < sizeof(spec)) {
+				memcpy(spec, word + 8, len);
+				spec[len] = '\0';
+			}
+			if ((len >= sizeof(spec)) || (console_configure(spec) == false)) {
+				warn("invalid option: %.*s", (int)(end - word), word);
+			}
+		}
+
+		word = (*end == ' ') ? end + 1 : end;
+	}
+}
+
+// ----------------------------------------------------------------------------
+
 static void ps2_init(void)
 {
 	info("starting PS/2 subsystem initialization...");
@@ -73,6 +166,16 @@ static void mem_init(multiboot_info_t *mbi)
 	// the page frame allocator is ready, we can now setup paging
 	paging_setup();
 
+	// virtual address space allocation is ready once paging is
+	vmem_setup();
+	cow_setup();
+
+	// from now on, overflowing the boot stack faults
+	kstack_setup();
+
+	// collapse the contiguous boot mappings (PFA metadata, module, ...)
+	paging_promote();
+
 	success("memory initialization complete");
 }
 
@@ -92,8 +195,9 @@ void kernel_early_init(void)
 
 	gdt_setup();
 
-	// initialise output early for debugging
+	// initialise output early for debugging (every one is a console sink)
 	serial_init();
+	debugcon_init();
 	terminal_initialize();
 }
 
@@ -101,14 +205,34 @@ void kernel_early_init(void)
 
 void kernel_init(multiboot_info_t *mbi)
 {
+	bool symbols_loaded = false;
+
+	cmdline_init(mbi);
+	cmdline_log_levels();
+
+	// selects the string functions before they are heavily used
+	cpu_setup();
+
+	// embedded in the image and used in place, so available from now on
+	symbols_loaded = symbol_init((char*)kernel_symtab_start,
+								 kernel_symtab_end - kernel_symtab_start);
+
 	mem_init(mbi);
 
+	// the double fault task runs with the current page directory
+	tss_setup();
+	info("TSS setup");
+
 	setup_idt();
 	info("IDT setup");
 
 	irq_init(IRQ0_INT, IRQ7_INT); // TODO: move it into setup_idt()
 	info("IRQ initialized");
 
+	// before the clock, nothing is allocated from its handler
+	profile_init();
+	trace_init();
+
 	clock_init(CLOCK_FREQ);
 	info("clock initialized");
 
@@ -117,7 +241,9 @@ void kernel_init(multiboot_info_t *mbi)
 	enable_nmi();
 	enable_interrupts();
 
-	if (symbol_init((char*)module_addr, module_len) == false) {
+	if ((symbols_loaded == false) &&
+		(symbol_init((char*)module_addr, module_len) == false))
+	{
 		// this is not critical
 		warn("failed to load symbol from module");
 	}
@@ -127,6 +253,35 @@ void kernel_init(multiboot_info_t *mbi)
 	success("kernel initialization complete");
 }
 
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns true if @option is one of the (space separated) words of the boot
+ * command line, false otherwise. The first word is the kernel image path.
+ */
+
+bool cmdline_has(const char *option)
+{
+	const size_t len = strlen(option);
+	const char *word = cmdline;
+
+	while (*word != '\0') {
+		const char *end = word;
+
+		while ((*end != '\0') && (*end != ' ')) {
+			end++;
+		}
+
+		if (((size_t)(end - word) == len) && (memcmp(word, option, len) == 0)) {
+			return true;
+		}
+
+		word = (*end == ' ') ? end + 1 : end;
+	}
+
+	return false;
+}
+
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
@@ -6,11 +6,17 @@
 
 #include <kernel/init.h>
 #include <kernel/log.h>
+#include <kernel/bench.h>
 #include <kernel/scheduler.h>
+#include <kernel/profile.h>
+#include <kernel/trace.h>
 
 #include <drivers/keyboard.h>
 #include <drivers/clock.h>
 
+#include <mem/memory.h>
+#include <mem/kstack.h>
+
 #include <multiboot.h>
 #include <stdio.h>
 
@@ -52,10 +58,24 @@ static void kernel_main_loop(void)
 {
 	info("starting kernel main loop");
 
+	// from now on, messages are written to the console by the loop below
+	log_set_deferred(true);
+
 	for (;;) {
 		sched_run_task(100, "keyboard", &keyboard_task);
+
+		// keep page table creation off the PFA (no-op most of the time)
+		paging_reserve_refill();
+
+		// stream the profiler samples and the trace events (if enabled)
+		profile_flush();
+		trace_flush();
+
+		// write the pending log messages to the console
+		log_flush();
 	}
 
+	log_set_deferred(false);
 	info("kernel main loop stopped");
 }
 
@@ -65,6 +85,8 @@ static void kernel_main_loop(void)
 
 void kernel_main(uint32_t magic, multiboot_info_t *multiboot_info)
 {
+	struct kstack *main_stack = NULL;
+
 	kernel_early_init();
 	// we can use log printing now
 
@@ -82,7 +104,16 @@ void kernel_main(uint32_t magic, multiboot_info_t *multiboot_info)
 	// it only accounts from the clock initialization
 	info("kernel booted in %d tick(s)", clock_gettick());
 
-	kernel_main_loop();
+	if (cmdline_has("bench")) {
+		bench_run();
+	}
+
+	if ((main_stack = kstack_alloc("main loop", KSTACK_DEFAULT_PAGES)) != NULL) {
+		kstack_run(main_stack, kernel_main_loop);
+	} else {
+		warn("failed to allocate the main loop stack, staying on boot stack");
+		kernel_main_loop();
+	}
 
 	for (;;) // do not quit yet, otherwise irq will be disabled
 	{
@@ -2,30 +2,516 @@
  * log.c
  *
  * Helpers to print message with various priorities.
+ *
+ * The log macros don't print anything: the message is formatted into a ring
+ * buffer, and log_flush() (called from the kernel main loop) later writes it
+ * to the console sinks which accept its level (see console.c). Hence, logging from an IRQ
+ * handler neither waits for the UART, nor breaks the line being printed.
+ *
+ * Until the main loop starts (see log_set_deferred()), every message is
+ * flushed as soon as it is written.
+ *
+ * Producers can nest (an IRQ handler logging while the main code is logging)
+ * and never block:
+ * - a record is reserved with a cmpxchg on the ring head, a message which does
+ *   not fit in the ring (not flushed yet) is dropped and counted
+ * - the outermost producer publishes the head once it is done ('ring_done'),
+ *   log_flush() only reads records below it, so it never sees a half-written
+ *   one
+ * Since nested producers always complete before the interrupted one resumes,
+ * this only holds on a uniprocessor (like the rest of the kernel).
+ *
+ * Flushed records are kept until the space is reused, so that the recent
+ * messages can be dumped after a crash (see crashdump.c).
+ *
+ * Every module (LOG_MODULE) can have its own level, the default one applies to
+ * the others. Call sites cache the level of their module, those caches are
+ * invalidated by bumping 'g_log_gen' on any level change.
  */
 
 #include <kernel/log.h>
+#include <kernel/console.h>
+
+#include <arch/atomic.h>
+
+#include <stdarg.h>
+#include <string.h>
+
+#define LOG_MODULE "log"
 
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
 
-enum log_level g_log_level = LOG_INFO;
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+#define LOG_RECORD_ALIGN 8 // so that a padding record always fits
+
+#define LOG_PAD_COLOR 0xff // padding record up to the end of the ring
+
+#define LOG_MAX_MODULES 16 // with their own level
+#define LOG_MODULE_NAME_MAX 16
+
+struct log_record
+{
+	uint16_t len; // whole record (header included), LOG_RECORD_ALIGN aligned
+	uint16_t text_len;
+	uint8_t color; // VGA color, or LOG_PAD_COLOR
+	uint8_t level; // enum log_level
+	uint8_t reserved[2];
+	char text[];
+};
+
+// ----------------------------------------------------------------------------
+
+struct log_module
+{
+	char name[LOG_MODULE_NAME_MAX];
+	enum log_level level;
+};
+
+// ----------------------------------------------------------------------------
+
+uint32_t g_log_gen = 1; // call sites start at zero (i.e. not looked up)
+
+static const char *level_names[LOG_MAX_LEVEL] = {
+	[LOG_ERROR] = "error",
+	[LOG_WARN] = "warn",
+	[LOG_INFO] = "info",
+	[LOG_DEBUG] = "debug",
+};
+
+static enum log_level default_level = LOG_INFO;
+static struct log_module modules[LOG_MAX_MODULES];
+static size_t nb_modules = 0;
+
+// positions are free running (only masked to access the ring)
+static uint8_t log_ring[LOG_RING_SIZE]
+	__attribute__((aligned(LOG_RECORD_ALIGN)));
+static atomic_t ring_head; // next record to reserve
+static atomic_t ring_done; // every record below is complete
+static atomic_t ring_oldest; // oldest record not overwritten yet
+static volatile uint32_t ring_tail = 0; // written by log_flush() only
+
+static atomic_t writers; // nesting level of the producers
+static atomic_t flushing;
+static atomic_t dropped;
+static uint32_t dropped_reported = 0;
+
+static bool deferred = false;
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+static inline struct log_record* record_at(uint32_t pos)
+{
+	return (struct log_record*) &log_ring[pos & LOG_RING_MASK];
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Moves the oldest record forward until the ring can hold everything up to
+ * @end. The records skipped this way are flushed (the reservation checked it),
+ * so their headers are valid.
+ */
+
+static void ring_make_room(uint32_t end)
+{
+	uint32_t oldest;
+	uint32_t pos;
+
+	do {
+		oldest = pos = (uint32_t) atomic_read(&ring_oldest);
+		while ((end - pos) > LOG_RING_SIZE) {
+			pos += record_at(pos)->len;
+		}
+	} while ((pos != oldest) &&
+		((uint32_t) atomic_cmpxchg(&ring_oldest, oldest, pos) != oldest));
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Reserves a record of @len bytes (header included), preceded by a padding
+ * record if it would wrap around the end of the ring.
+ *
+ * Returns false if the ring is full, otherwise the record position is stored
+ * in @pos.
+ */
+
+static bool ring_reserve(uint32_t len, uint32_t *pos)
+{
+	uint32_t head;
+	uint32_t pad;
+
+	do {
+		head = (uint32_t) atomic_read(&ring_head);
+		pad = 0;
+		if (((head & LOG_RING_MASK) + len) > LOG_RING_SIZE) {
+			pad = LOG_RING_SIZE - (head & LOG_RING_MASK);
+		}
+		if ((head + pad + len - ring_tail) > LOG_RING_SIZE) {
+			return false;
+		}
+	} while ((uint32_t) atomic_cmpxchg(&ring_head, head, head + pad + len) !=
+			 head);
+
+	ring_make_room(head + pad + len);
+
+	if (pad > 0) {
+		struct log_record *padding = record_at(head);
+
+		padding->len = pad;
+		padding->text_len = 0;
+		padding->color = LOG_PAD_COLOR;
+	}
+
+	*pos = head + pad;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Ends a producer section. The outermost producer publishes the records
+ * reserved so far (every nested producer is done by now).
+ */
+
+static void ring_publish(void)
+{
+	uint32_t head;
+	uint32_t done;
+
+	if (!atomic_dec_and_test(&writers)) {
+		return;
+	}
+
+	head = (uint32_t) atomic_read(&ring_head);
+	do {
+		done = (uint32_t) atomic_read(&ring_done);
+		if ((int32_t)(head - done) <= 0) {
+			break; // a later producer already published more
+		}
+	} while ((uint32_t) atomic_cmpxchg(&ring_done, done, head) != done);
+}
 
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
 
+/*
+ * Warns that messages of @level (requested for @module) are not built in, the
+ * new level only filters the remaining ones.
+ */
+
+static void check_build_level(const char *module, enum log_level level)
+{
+	if ((level > LOG_BUILD_LEVEL) && (level < LOG_MAX_LEVEL)) {
+		warn("%s messages of %s are not built in, rebuild with 'make "
+			 "LOG_LEVEL=%u'", level_names[level], module, level);
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Sets the level of the modules without their own level.
+ */
+
 void log_set_level(enum log_level level)
 {
-  g_log_level = level;
+	check_build_level("any module", level);
+	default_level = level;
+	g_log_gen++;
 }
 
 // ----------------------------------------------------------------------------
 
 enum log_level log_get_level(void)
 {
-  return g_log_level;
+	return default_level;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Sets the level of @module (its LOG_MODULE name).
+ *
+ * Returns false if there is no room for another module.
+ */
+
+bool log_set_module_level(const char *module, enum log_level level)
+{
+	size_t i;
+
+	for (i = 0; i < nb_modules; ++i) {
+		if (strcmp(modules[i].name, module) == 0) {
+			break;
+		}
+	}
+
+	if (i == nb_modules) {
+		if ((nb_modules == LOG_MAX_MODULES) ||
+			(strlen(module) >= LOG_MODULE_NAME_MAX))
+		{
+			return false;
+		}
+		strcpy(modules[i].name, module);
+		nb_modules++;
+	}
+
+	check_build_level(module, level);
+	modules[i].level = level;
+	g_log_gen++;
+
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Stores the level named @name ("error", "warn", "info" or "debug") in @level.
+ *
+ * Returns false if @name is not a level.
+ */
+
+bool log_parse_level(const char *name, enum log_level *level)
+{
+	for (size_t i = 0; i < LOG_MAX_LEVEL; ++i) {
+		if (strcmp(name, level_names[i]) == 0) {
+			*level = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Applies a "[module:]level" specification (e.g. "pfa:debug", or "warn" for
+ * the default level), see log_parse_level() for the level names.
+ *
+ * Returns false if @spec is invalid.
+ */
+
+bool log_configure(const char *spec)
+{
+	char module[LOG_MODULE_NAME_MAX];
+	const char *level = strchr(spec, ':');
+	enum log_level value;
+	size_t len = 0;
+
+	if (level == NULL) {
+		level = spec;
+	} else {
+		len = level - spec;
+		level++;
+		if ((len == 0) || (len >= sizeof(module))) {
+			return false;
+		}
+		memcpy(module, spec, len);
+		module[len] = '\0';
+	}
+
+	if (log_parse_level(level, &value) == false) {
+		return false;
+	}
+	if (len == 0) {
+		log_set_level(value);
+		return true;
+	}
+
+	return log_set_module_level(module, value);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Looks up the level of the @site module, called by log_enabled() after a
+ * level change.
+ */
+
+void log_site_update(struct log_site *site)
+{
+	const uint32_t gen = g_log_gen;
+	enum log_level level = default_level;
+
+	for (size_t i = 0; i < nb_modules; ++i) {
+		if (strcmp(modules[i].name, site->module) == 0) {
+			level = modules[i].level;
+			break;
+		}
+	}
+
+	site->level = level;
+	site->gen = gen;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Formats a message of @level in the log ring buffer, displayed in @color
+ * once flushed. Messages longer than LOG_LINE_MAX are truncated.
+ *
+ * Called by the log macros, safe to use from IRQ handlers.
+ */
+
+void log_write(enum log_level level, uint8_t color, const char *fmt, ...)
+{
+	char line[LOG_LINE_MAX];
+	struct log_record *record = NULL;
+	uint32_t pos = 0;
+	uint32_t len = 0;
+	va_list args;
+	int text_len;
+
+	va_start(args, fmt);
+	text_len = vsnprintf(line, sizeof(line), fmt, args);
+	va_end(args);
+
+	if (text_len < 0) {
+		return;
+	}
+	if (text_len >= LOG_LINE_MAX) {
+		text_len = LOG_LINE_MAX - 1; // the null terminator is not kept
+	}
+
+	len = sizeof(*record) + text_len;
+	len = (len + LOG_RECORD_ALIGN - 1) & ~(LOG_RECORD_ALIGN - 1);
+
+	atomic_inc(&writers);
+	if (ring_reserve(len, &pos)) {
+		record = record_at(pos);
+		record->len = len;
+		record->text_len = text_len;
+		record->color = color;
+		record->level = level;
+		memcpy(record->text, line, text_len);
+	} else {
+		atomic_inc(&dropped);
+	}
+	ring_publish();
+
+	if (!deferred) {
+		log_flush();
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Writes the pending messages to the console sinks, every message in a single
+ * call to each sink which accepts its level.
+ *
+ * It does nothing if a flush is already in progress (e.g. called from an IRQ
+ * handler which interrupted it), the interrupted one will write the new
+ * messages as well.
+ */
+
+void log_flush(void)
+{
+	uint32_t nb_dropped;
+
+again:
+	if (atomic_cmpxchg(&flushing, 0, 1) != 0) {
+		return;
+	}
+
+	while (ring_tail != (uint32_t) atomic_read(&ring_done)) {
+		const struct log_record *record = record_at(ring_tail);
+
+		if (record->color != LOG_PAD_COLOR) {
+			console_write(record->text, record->text_len, record->level,
+						  record->color);
+		}
+
+		// the space is released once the message is written
+		asm volatile("" : : : "memory");
+		ring_tail += record->len;
+	}
+
+	nb_dropped = (uint32_t) atomic_read(&dropped);
+	if (nb_dropped != dropped_reported) {
+		char line[48];
+		const int len = snprintf(line, sizeof(line),
+			"[log] WARN: %u messages dropped\n", nb_dropped - dropped_reported);
+
+		console_write(line, len, LOG_WARN, CONSOLE_DEFAULT_COLOR);
+		dropped_reported = nb_dropped;
+	}
+
+	atomic_write(&flushing, 0);
+
+	// a message published since the last check might have been skipped
+	if (ring_tail != (uint32_t) atomic_read(&ring_done)) {
+		goto again;
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * If @deferred is true, log_write() no longer flushes the messages: the
+ * caller must call log_flush() on a regular basis (i.e. the main loop).
+ */
+
+void log_set_deferred(bool value)
+{
+	deferred = value;
+	if (!deferred) {
+		log_flush();
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns the position of the oldest message still in the ring, to be used
+ * with log_ring_next().
+ */
+
+uint32_t log_ring_first(void)
+{
+	return (uint32_t) atomic_read(&ring_oldest);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns the text (not null terminated) of the message at @pos and stores its
+ * length in @len, then moves @pos to the next message. Padding records are
+ * skipped.
+ *
+ * This is meant to be used after a crash, so the records are checked: NULL is
+ * returned at the end of the ring and on a corrupted record.
+ */
+
+const char* log_ring_next(uint32_t *pos, size_t *len)
+{
+	const uint32_t done = (uint32_t) atomic_read(&ring_done);
+
+	while ((int32_t)(done - *pos) > 0) {
+		const struct log_record *record = record_at(*pos);
+
+		if ((record->len < sizeof(*record)) ||
+			(record->len > (done - *pos)) ||
+			(record->len & (LOG_RECORD_ALIGN - 1)) ||
+			(record->text_len > (record->len - sizeof(*record))))
+		{
+			return NULL;
+		}
+
+		*pos += record->len;
+		if (record->color != LOG_PAD_COLOR) {
+			*len = record->text_len;
+			return record->text;
+		}
+	}
+
+	return NULL;
 }
 
 // ============================================================================
@@ -0,0 +1,231 @@
+/*
+ * profile.c
+ *
+ * Statistical sampling profiler driven by the clock interrupt.
+ *
+ * With the "profile" boot option, every clock tick records the interrupted
+ * EIP in a ring buffer allocated at initialization time. With the
+ * "profile_callchain" boot option, the frame pointer chain of the interrupted
+ * code is recorded too (the kernel is built with -fno-omit-frame-pointer).
+ *
+ * The clock handler is the only producer, profile_flush() (called from the
+ * kernel main loop) is the only consumer. It streams the pending samples over
+ * the serial port, one line per sample, leaf first:
+ *
+ *   PROF <eip> [<return address> ...]
+ *
+ * The samples follow a "PROF begin hz=<freq> depth=<max frames>" line. When
+ * the buffer is full, samples are dropped and a "PROF dropped=<n>" line
+ * reports the total. tools/profile-fold.sh symbolizes the output with
+ * 'symbols.map' and emits folded stacks (for flame graphs).
+ */
+
+#include <kernel/profile.h>
+#include <kernel/init.h>
+#include <kernel/log.h>
+
+#include <drivers/clock.h>
+#include <drivers/serial.h>
+
+#include <mem/memory.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define LOG_MODULE "profile"
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+struct profile_sample
+{
+	uint32_t depth;
+	uint32_t pcs[PROFILE_MAX_DEPTH]; // interrupted EIP first
+};
+
+// ----------------------------------------------------------------------------
+
+static bool profiling = false;
+static bool callchain = false;
+static struct profile_sample *ring = NULL;
+static volatile uint32_t ring_head = 0; // written by the clock handler only
+static volatile uint32_t ring_tail = 0; // written by profile_flush() only
+static volatile uint32_t dropped = 0;
+static uint32_t dropped_reported = 0;
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Returns true if the 4 bytes at @addr are mapped.
+ */
+
+static inline bool word_mapped(uint32_t addr)
+{
+	return (virt_to_phys((void*)addr) != BAD_PHYS_ADDR) &&
+		(virt_to_phys((void*)(addr + 3)) != BAD_PHYS_ADDR);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Walks the frame pointer chain from @ebp and stores up to @max return
+ * addresses in @pcs.
+ *
+ * This runs in the clock handler, so nothing is trusted: the walk stops on a
+ * misaligned or unmapped frame, and on a frame which does not move up the
+ * stack (or too far up, e.g. a stack switch).
+ *
+ * Returns the number of stored return addresses.
+ */
+
+static size_t walk_callchain(uint32_t ebp, uint32_t *pcs, size_t max)
+{
+	size_t depth = 0;
+
+	while ((depth < max) && (ebp != 0)) {
+		const uint32_t *frame = (const uint32_t*) ebp;
+		uint32_t next = 0;
+
+		if ((ebp & 3) || !word_mapped(ebp) || !word_mapped(ebp + 4)) {
+			break;
+		}
+
+		if (frame[1] == 0) {
+			break;
+		}
+		pcs[depth++] = frame[1];
+
+		next = frame[0];
+		if ((next <= ebp) || ((next - ebp) > PROFILE_MAX_FRAME)) {
+			break;
+		}
+		ebp = next;
+	}
+
+	return depth;
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Enables the profiler if the "profile" boot option is set. The ring buffer
+ * is allocated here, so nothing is allocated from the clock handler.
+ *
+ * Memory must be initialized.
+ */
+
+void profile_init(void)
+{
+	char line[64];
+
+	if (cmdline_has("profile") == false) {
+		return;
+	}
+
+	ring = kmalloc(PROFILE_SAMPLES * sizeof(*ring));
+	if (ring == NULL) {
+		error("not enough memory");
+		return;
+	}
+
+	callchain = cmdline_has("profile_callchain");
+	ring_head = 0;
+	ring_tail = 0;
+	dropped = 0;
+	dropped_reported = 0;
+
+	sprintf(line, "PROF begin hz=%u depth=%u\n", CLOCK_FREQ,
+		callchain ? PROFILE_MAX_DEPTH : 1);
+	serial_write(line, strlen(line));
+
+	asm volatile("" ::: "memory");
+	profiling = true;
+
+	success("profiler enabled (%u samples ring buffer%s)", PROFILE_SAMPLES,
+		callchain ? ", call chains" : "");
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Records a sample of the code interrupted at @eip, with @ebp its frame
+ * pointer. Called by the clock handler (interrupts disabled).
+ */
+
+void profile_tick(uint32_t eip, uint32_t ebp)
+{
+	struct profile_sample *sample = NULL;
+	const uint32_t head = ring_head;
+
+	if (profiling == false) {
+		return;
+	}
+
+	if ((head - ring_tail) >= PROFILE_SAMPLES) {
+		dropped++;
+		return;
+	}
+
+	sample = &ring[head & (PROFILE_SAMPLES - 1)];
+	sample->pcs[0] = eip;
+	sample->depth = 1;
+	if (callchain) {
+		sample->depth += walk_callchain(ebp, &sample->pcs[1],
+			PROFILE_MAX_DEPTH - 1);
+	}
+
+	// publish the sample once it is complete
+	asm volatile("" ::: "memory");
+	ring_head = head + 1;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Streams the pending samples over the serial port. The slot of a sample is
+ * only released once it has been written, so the clock handler never
+ * overwrites it in the meantime.
+ */
+
+void profile_flush(void)
+{
+	// "PROF" + " 0x12345678" per frame + "\n"
+	char line[8 + 11 * PROFILE_MAX_DEPTH];
+	uint32_t tail = ring_tail;
+
+	if (profiling == false) {
+		return;
+	}
+
+	while (tail != ring_head) {
+		const struct profile_sample *sample =
+			&ring[tail & (PROFILE_SAMPLES - 1)];
+		char *ptr = line;
+
+		memcpy(ptr, "PROF", 4);
+		ptr += 4;
+		for (size_t i = 0; i < sample->depth; ++i) {
+			ptr += sprintf(ptr, " 0x%x", sample->pcs[i]);
+		}
+		*ptr++ = '\n';
+		serial_write(line, ptr - line);
+
+		asm volatile("" ::: "memory");
+		ring_tail = ++tail;
+	}
+
+	if (dropped != dropped_reported) {
+		dropped_reported = dropped;
+		sprintf(line, "PROF dropped=%u\n", dropped_reported);
+		serial_write(line, strlen(line));
+	}
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
@@ -2,15 +2,19 @@
  * symbol.c
  *
  * Kernel symbol facility.
+ *
+ * The symbol table is the binary 'symbols.bin' file generated at build time
+ * (see <kernel/symtab.h>) and embedded in the kernel image by the second link
+ * pass (or loaded as a multiboot module). It is used in place: symbol_init()
+ * only validates the header and sets pointers to the arrays. The addresses are
+ * sorted, so symbol_find() is a binary search, and symbol_lookup() walks the
+ * name hash table (if any).
  */
 
 #include <kernel/symbol.h>
-
-#include <mem/pmm.h>
-#include <mem/memory.h>
+#include <kernel/symtab.h>
 
 #include <string.h>
-#include <stdlib.h>
 
 #define LOG_MODULE "symbol"
 
@@ -21,7 +25,14 @@
 struct symbol_map
 {
 	size_t nb_syms;
-	struct symbol *symbols;
+	const uint32_t *addrs;
+	const uint32_t *lens;
+	const uint32_t *names; // offsets in strtab
+	size_t hash_size; // power-of-two, zero if there is no hash table
+	const uint32_t *hash_heads; // first symbol index of each bucket
+	const uint32_t *hash_next; // next symbol index in the same bucket
+	const char *strtab;
+	size_t strtab_size;
 };
 
 // ============================================================================
@@ -35,154 +46,88 @@ static struct symbol_map sym_map;
 // ============================================================================
 
 /*
- * Parses a single @line (null terminated) from a memory mapped symbol map file
- * and update the @sym content.
- *
- * WARNING: just like parse_symbol_map(), the file content is updated (and
- * restored) during parsing (see comments).
- *
- * This parser expects the following grammar:
- *
- * SYMBOL_NAME SYMBOL_TYPE SYMBOL_ADDR [SYMBOL_LEN]\0
- *									  ^   ^--- optionnal
- *									  \--- mandatory
- *
- * Returns true on success, false otherwise.
+ * Fills @sym with the symbol at @index.
  */
 
-static bool parse_line(char *line, struct symbol *sym)
+static void get_symbol(size_t index, struct symbol *sym)
 {
-	char *sep = NULL;
-	size_t name_len = 0;
-
-	if (line == NULL || *line == '\0' || sym == NULL) {
-		error("invalid argument");
-		return false;
-	}
-
-	dbg("parsing line '%s'", line);
-
-	// extract symbol name
-	if ((sep = strchr(line, ' ')) == NULL) {
-		error("unexpected character");
-		return false;
-	}
-	*sep = '\0'; // update file content
-	if ((name_len = strlen(line)) == 0) {
-		error("empty symbol name");
-		goto fail;
-	} else if (name_len >= sizeof(sym->name)) {
-		error("symbol name is too big");
-		goto fail;
-	}
-	strncpy(sym->name, line, sizeof(sym->name) - 1);
-	sym->name[sizeof(sym->name) - 1] = '\0';
-	dbg("sym->name = %s", sym->name);
-	*sep = ' '; // restore file content
-	line = sep + 1;
-
-	// extract symbol type
-	if ((sep = strchr(line, ' ')) == NULL) {
-		error("unexpected character");
-		return false;
-	}
-	line = sep + 1; // skip it
-
-	// extract symbol starting addr (in hexa)
-	if ((sep = strchr(line, ' ')) == NULL) {
-		error("unexpected character");
-		return false;
-	}
-	*sep = '\0'; // update file content
-	if (strlen(line) > 2*sizeof(sym->addr)) {
-		error("address is too large");
-		goto fail;
-	}
-	sym->addr = (void*) atoh(line);
-	dbg("sym->addr = 0x%p", sym->addr);
-	*sep = ' '; // restore file content
-	line = sep + 1;
-
-	// extract symbol len (if any)
-	if (*line == '\0') {
-		sym->len = 0;
-	} else if (strlen(line) > 2*sizeof(sym->len)) {
-		error("address is too large");
-		return false; // nothing to restore
-	} else {
-		sym->len = atoh(line);
-	}
-	dbg("sym->len = 0x%x", sym->len);
-
-	return true;
-
-fail:
-	*sep = ' ';
-	return false;
+	sym->addr = (void*) sym_map.addrs[index];
+	sym->len = sym_map.lens[index];
+	sym->name = sym_map.strtab + sym_map.names[index];
 }
 
 // ----------------------------------------------------------------------------
 
 /*
- * Parses the memory mapped symbol map file from @symbol_map_start to
- * @symbol_map_end and fills the @sm's symbols array. The @sm's nb_syms field
- * must already be set.
- *
- * WARNING: the file's content is updated (then restored) during the parsing
- * (null bytes are inserted), so we should setup some sort of 'file locking'
- * while walking this file. At the time of writing their shouldn't be any
- * concurrent reader as the file is read during system startup.
+ * Checks the symbol table @hdr of @len bytes. Nothing is trusted in it: every
+ * array must fit in the table, addresses must be sorted, name offsets and
+ * hash indexes must be in bounds and the string blob null terminated.
  *
  * Returns true on success, false otherwise.
  */
 
-static bool parse_symbol_map(char *symbol_map_start, char *symbol_map_end,
-							 struct symbol_map *sm)
+static bool check_symtab(const struct symtab_header *hdr, size_t len)
 {
-	struct symbol *last = NULL;
-	char *ptr = symbol_map_start;
-	char *eol = NULL;
-	size_t sym_index = 0;
-	bool ret = false;
+	const uint32_t *words = (const uint32_t*) (hdr + 1);
+	const uint32_t nb_syms = hdr->nb_syms;
+	const uint32_t hash_size = hdr->hash_size;
+	const char *strtab = NULL;
+	uint64_t size = 0;
+
+	if (hdr->magic != SYMTAB_MAGIC) {
+		error("bad magic 0x%x", hdr->magic);
+		return false;
+	}
 
-	if ((symbol_map_start == symbol_map_end) || (sm->nb_syms == 0)) {
-		error("invalid argument");
+	if (hdr->version != SYMTAB_VERSION) {
+		error("unsupported version %u", hdr->version);
 		return false;
 	}
 
-	do {
-		struct symbol *sym = &sm->symbols[sym_index];
+	if ((nb_syms == 0) || (hdr->strtab_size == 0)) {
+		error("empty symbol table");
+		return false;
+	}
 
-		if ((eol = strchr(ptr, '\n')) == NULL) {
-			// this is the last line
-			if ((uint32_t)(symbol_map_end - ptr) == 0) {
-				// empty line
-				break;
-			}
-		}
+	if ((hash_size & (hash_size - 1)) != 0) {
+		error("hash size is not a power-of-two");
+		return false;
+	}
+
+	// 64-bit, so that a forged header cannot overflow it
+	size = sizeof(*hdr) + sizeof(uint32_t) * ((uint64_t) 3 * nb_syms +
+		hash_size + (hash_size ? nb_syms : 0)) + hdr->strtab_size;
+	if ((size != hdr->size) || (size > len)) {
+		error("bad table size");
+		return false;
+	}
 
-		*eol = '\0'; // update file content
-		ret = parse_line(ptr, sym);
-		*eol = '\n'; // restore the original character
+	strtab = (const char*) words + (size - sizeof(*hdr) - hdr->strtab_size);
+	if (strtab[hdr->strtab_size - 1] != '\0') {
+		error("string blob is not null terminated");
+		return false;
+	}
 
-		if (ret == false) {
-			error("parsing line failed");
+	for (size_t i = 0; i < nb_syms; ++i) {
+		// symbol_find() relies on it
+		if ((i > 0) && (words[i] < words[i - 1])) {
+			error("symbols are not sorted by address");
 			return false;
 		}
-
-		// update the previous symbol len
-		if (last != NULL) {
-			last->len = (size_t)sym->addr - (size_t)last->addr;
+		if (words[2 * nb_syms + i] >= hdr->strtab_size) {
+			error("bad name offset");
+			return false;
 		}
+	}
 
-		ptr = eol + 1;
-		sym_index++;
-		last = sym;
-	} while (ptr < symbol_map_end);
+	// hash heads and chains
+	for (size_t i = 0; i < hash_size + (hash_size ? nb_syms : 0); ++i) {
+		const uint32_t index = words[3 * nb_syms + i];
 
-	if (sym_index != sm->nb_syms) {
-		error("oops! something went wrong!");
-		return false;
+		if ((index != SYMTAB_HASH_END) && (index >= nb_syms)) {
+			error("bad hash index");
+			return false;
+		}
 	}
 
 	return true;
@@ -193,60 +138,57 @@ static bool parse_symbol_map(char *symbol_map_start, char *symbol_map_end,
 // ============================================================================
 
 /*
- * Initialize the symbol list from a memory mapped file at @symbol_map_addr of
- * @symbol_map_len bytes.
+ * Initialize the symbol list from a memory mapped binary symbol table at
+ * @symbol_map_start of @symbol_map_len bytes. The table is used in place, it
+ * must stay mapped (and untouched) afterward.
  *
  * Returns true on success, false otherwise.
  */
 
 bool symbol_init(char* symbol_map_start, size_t symbol_map_len)
 {
-	char *symbol_map_end = symbol_map_start + symbol_map_len;
-	char *ptr = NULL;
-	char *eol = NULL;
+	const struct symtab_header *hdr =
+		(const struct symtab_header*) symbol_map_start;
+	const uint32_t *words = NULL;
 
 	info("initializing symbol list");
 
 	if (symbol_map_start == NULL || symbol_map_len == 0) {
-		error("'symbols.map' file not loaded");
+		error("no symbol table");
 		return false;
 	}
 
-	// first walking to count the number of entries for kmalloc
-	sym_map.nb_syms = 0;
-	ptr = symbol_map_start;
-	do {
-		if ((eol = strchr(ptr, '\n')) == NULL) {
-			if ((uint32_t)(symbol_map_end - ptr) > 0) {
-				error("missing last line feed");
-				goto fail;
-			}
-		}
-		sym_map.nb_syms++;
-		ptr = eol + 1;
-	} while (ptr < symbol_map_end);
-	dbg("sym_map.nb_syms = %u", sym_map.nb_syms);
-
-	// allocates everything with a single call to kmalloc()
-	sym_map.symbols =
-		(struct symbol*) kmalloc(sym_map.nb_syms * sizeof(sym_map.symbols[0]));
-	if (sym_map.symbols == NULL) {
-		warn("not enough memory for a single alloc");
-		// TODO: fallback to a kmalloc() for each symbol (or a bucketed alloc)
-		NOT_IMPLEMENTED();
+	if ((symbol_map_len < sizeof(*hdr)) ||
+		(((uint32_t) symbol_map_start & (sizeof(uint32_t) - 1)) != 0))
+	{
+		error("invalid symbol table");
+		goto fail;
 	}
-	dbg("sym_map.symbols = 0x%p", sym_map.symbols);
 
-	// finally parse the memory mapped file
-	if (parse_symbol_map(symbol_map_start, symbol_map_end,
-						 &sym_map) == false)
-	{
-		error("failed to parse symbol memory mapped file");
-		kfree(sym_map.symbols);
+	if (check_symtab(hdr, symbol_map_len) == false) {
+		error("invalid symbol table");
 		goto fail;
 	}
 
-	success("symbol list initialized (%u symbols)", sym_map.nb_syms);
+	words = (const uint32_t*) (hdr + 1);
+	sym_map.addrs = words;
+	sym_map.lens = words + hdr->nb_syms;
+	sym_map.names = words + 2 * hdr->nb_syms;
+	sym_map.hash_size = hdr->hash_size;
+	if (hdr->hash_size > 0) {
+		sym_map.hash_heads = words + 3 * hdr->nb_syms;
+		sym_map.hash_next = sym_map.hash_heads + hdr->hash_size;
+		sym_map.strtab = (const char*) (sym_map.hash_next + hdr->nb_syms);
+	} else {
+		sym_map.hash_heads = NULL;
+		sym_map.hash_next = NULL;
+		sym_map.strtab = (const char*) (words + 3 * hdr->nb_syms);
+	}
+	sym_map.strtab_size = hdr->strtab_size;
+	sym_map.nb_syms = hdr->nb_syms; // last, symbols are usable from now on
+
+	success("symbol list initialized (%u symbols, %u bytes)",
+		sym_map.nb_syms, hdr->size);
 	return true;
 
 fail:
@@ -267,7 +209,8 @@ fail:
 
 bool symbol_find(void *addr, struct symbol *sym)
 {
-	struct symbol *last_sym = NULL;
+	size_t lo = 0;
+	size_t hi = 0;
 
 	dbg("searching symbol at 0x%p", addr);
 
@@ -281,27 +224,28 @@ bool symbol_find(void *addr, struct symbol *sym)
 		return false;
 	}
 
-	// TODO: implement a binary tree instead of linear searching in O(n)
-	for (size_t i = 0; i < sym_map.nb_syms; ++i) {
-		struct symbol *sym = &sym_map.symbols[i];
+	// binary search of the last symbol starting at or before @addr
+	lo = 0;
+	hi = sym_map.nb_syms;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
 
-		if (sym->addr > addr) {
-			break;
+		if (sym_map.addrs[mid] > (uint32_t) addr) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
 		}
-
-		last_sym = sym;
 	}
 
-	if (last_sym != NULL) {
-		if (last_sym->len > 0) {
-			if 	((addr < last_sym->addr) ||
-				(addr >= (last_sym->addr + last_sym->len)))
-			{
-				return false;
-			}
+	if (lo > 0) {
+		const uint32_t start = sym_map.addrs[lo - 1];
+		const uint32_t len = sym_map.lens[lo - 1];
+
+		if ((len > 0) && ((uint32_t) addr - start >= len)) {
+			return false;
 		}
 
-		*sym = *last_sym;
+		get_symbol(lo - 1, sym);
 		return true;
 	}
 
@@ -330,12 +274,25 @@ bool symbol_lookup(char *name, struct symbol *sym)
 
 	dbg("searching symbol '%s'", name);
 
-	// TODO: implement hash table for a faster lookup
-	for (size_t i = 0; i < sym_map.nb_syms; ++i) {
-		struct symbol *cur_sym = &sym_map.symbols[i];
+	if (sym_map.hash_size > 0) {
+		const uint32_t bucket = symtab_hash(name) & (sym_map.hash_size - 1);
+
+		for (uint32_t i = sym_map.hash_heads[bucket]; i != SYMTAB_HASH_END;
+			 i = sym_map.hash_next[i])
+		{
+			if (strcmp(name, sym_map.strtab + sym_map.names[i]) == 0) {
+				get_symbol(i, sym);
+				return true;
+			}
+		}
 
-		if (strcmp(name, cur_sym->name) == 0) {
-			*sym = *cur_sym;
+		return false;
+	}
+
+	// no hash table, linear search
+	for (size_t i = 0; i < sym_map.nb_syms; ++i) {
+		if (strcmp(name, sym_map.strtab + sym_map.names[i]) == 0) {
+			get_symbol(i, sym);
 			return true;
 		}
 	}
@@ -0,0 +1,211 @@
+/*
+ * trace.c
+ *
+ * Always-on binary tracing (see <kernel/trace.h>).
+ *
+ * Events are recorded by the inline trace_event(), this file only gets them
+ * out: over the serial port from the kernel main loop with the "trace" boot
+ * option (trace_flush()), and in the crash dump (trace_dump()).
+ *
+ * The buffers are never locked: an event is copied first, and only kept if
+ * its slot has not been reused in the meantime (the producer of an interrupt
+ * context can overwrite it while the main loop copies it).
+ */
+
+#include <kernel/trace.h>
+#include <kernel/init.h>
+#include <kernel/log.h>
+
+#include <drivers/serial.h>
+
+#include <string.h>
+
+#define LOG_MODULE "trace"
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#define TRACE_MASK (TRACE_EVENTS - 1)
+#define TRACE_FLUSH_BATCH 16 // events per streamed chunk
+
+// ----------------------------------------------------------------------------
+
+struct trace_buffer g_trace_buffers[TRACE_CONTEXTS];
+
+static bool streaming = false;
+static uint32_t sent[TRACE_CONTEXTS]; // next event to stream
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Returns the index of the oldest event of @buf which is still available.
+ */
+
+static inline uint32_t oldest_event(const struct trace_buffer *buf)
+{
+	const uint32_t head = buf->head;
+
+	return (head > TRACE_EVENTS) ? head - TRACE_EVENTS : 0;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Streams the new events of @context over the serial port, by chunks of
+ * TRACE_FLUSH_BATCH events.
+ */
+
+static void stream_context(enum trace_context context)
+{
+	const struct trace_buffer *buf = &g_trace_buffers[context];
+	struct {
+		struct trace_chunk chunk;
+		struct trace_event events[TRACE_FLUSH_BATCH];
+	} out;
+
+	while (buf->head != sent[context]) {
+		uint32_t first = sent[context];
+		uint32_t head = buf->head;
+		uint32_t lost = 0;
+		uint32_t skip = 0;
+		uint32_t nb = 0;
+
+		if ((head - first) > TRACE_EVENTS) {
+			lost = head - TRACE_EVENTS - first;
+			first = head - TRACE_EVENTS;
+		}
+
+		while ((nb < TRACE_FLUSH_BATCH) && ((first + nb) != head)) {
+			out.events[nb] = buf->events[(first + nb) & TRACE_MASK];
+			nb++;
+		}
+
+		// drop the events overwritten while they were copied
+		asm volatile("" ::: "memory");
+		head = buf->head;
+		if ((head - first) > TRACE_EVENTS) {
+			skip = head - TRACE_EVENTS - first;
+			if (skip > nb) {
+				skip = nb;
+			}
+			memmove(&out.events[0], &out.events[skip],
+				(nb - skip) * sizeof(out.events[0]));
+		}
+		sent[context] = first + nb;
+
+		out.chunk.magic = TRACE_MAGIC;
+		out.chunk.version = TRACE_VERSION;
+		out.chunk.context = context;
+		out.chunk.nb_events = nb - skip;
+		out.chunk.lost = lost + skip;
+		serial_write((const char*) &out, sizeof(out.chunk) +
+			out.chunk.nb_events * sizeof(out.events[0]));
+	}
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Enables the streaming of the events over the serial port if the "trace"
+ * boot option is set. Events are recorded anyway.
+ */
+
+void trace_init(void)
+{
+	if (cmdline_has("trace") == false) {
+		return;
+	}
+
+	// the events recorded since boot come first
+	for (size_t i = 0; i < TRACE_CONTEXTS; ++i) {
+		sent[i] = oldest_event(&g_trace_buffers[i]);
+	}
+	streaming = true;
+
+	success("trace streaming enabled (%u events per context)", TRACE_EVENTS);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Streams the new events over the serial port (if enabled). Called from the
+ * kernel main loop.
+ */
+
+void trace_flush(void)
+{
+	if (streaming == false) {
+		return;
+	}
+
+	for (size_t i = 0; i < TRACE_CONTEXTS; ++i) {
+		stream_context(i);
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns the number of bytes written by trace_dump().
+ */
+
+size_t trace_dump_size(void)
+{
+	size_t size = 0;
+
+	for (size_t i = 0; i < TRACE_CONTEXTS; ++i) {
+		const struct trace_buffer *buf = &g_trace_buffers[i];
+
+		size += sizeof(struct trace_chunk) +
+			(buf->head - oldest_event(buf)) * sizeof(struct trace_event);
+	}
+
+	return size;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Writes every event still in the buffers with @write, a chunk per context.
+ *
+ * Meant to be used after a crash (interrupts disabled, nothing is recorded
+ * in the meantime).
+ */
+
+void trace_dump(void (*write)(const void *data, size_t len))
+{
+	for (size_t i = 0; i < TRACE_CONTEXTS; ++i) {
+		const struct trace_buffer *buf = &g_trace_buffers[i];
+		const uint32_t first = oldest_event(buf);
+		const uint32_t nb = buf->head - first;
+		const uint32_t start = first & TRACE_MASK;
+		struct trace_chunk chunk = {
+			.magic = TRACE_MAGIC,
+			.version = TRACE_VERSION,
+			.context = i,
+			.nb_events = nb,
+			.lost = 0,
+		};
+
+		write(&chunk, sizeof(chunk));
+
+		// the oldest events might be at the end of the ring
+		if (start + nb > TRACE_EVENTS) {
+			write(&buf->events[start],
+				(TRACE_EVENTS - start) * sizeof(struct trace_event));
+			write(&buf->events[0],
+				(start + nb - TRACE_EVENTS) * sizeof(struct trace_event));
+		} else {
+			write(&buf->events[start], nb * sizeof(struct trace_event));
+		}
+	}
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
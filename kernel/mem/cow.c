@@ -0,0 +1,327 @@
+/*
+ * cow.c
+ *
+ * Copy-On-Write page sharing.
+ *
+ * A page frame can be mapped (read-only) at several virtual pages, their PTEs
+ * being marked with PTE_MASK_COW. The first write to one of them raises a
+ * protection page fault which gives it a private copy of the page frame
+ * (cow_fault()). The last mapping of a shared page frame does not need a
+ * copy, it gets its write access back instead.
+ *
+ * Only shared page frames have a reference count, stored in a hash table
+ * indexed by their physical address. That is, a page frame without an entry
+ * is mapped once. Code releasing a page frame which might be shared must call
+ * cow_put() and only give it back to the PFA if it returns false.
+ *
+ * NOTE: The write protection is only enforced in supervisor mode when CR0.WP
+ * is set (see paging_setup()).
+ *
+ * For now, this is used to take snapshots of kernel buffers (cow_snapshot()),
+ * but the same mechanism is meant to back fork() later on.
+ */
+
+#include <mem/cow.h>
+#include <mem/memory.h>
+#include <mem/vmem.h>
+
+#include <kernel/log.h>
+#include <kernel/list.h>
+
+#include <string.h>
+
+#define LOG_MODULE "cow"
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+// reference count of a shared page frame (always >= 2)
+struct cow_frame {
+	pgframe_t pgf;
+	uint32_t refcount;
+	struct list list; // pointer in a hash chain
+};
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+static struct list cow_hash[COW_HASH_SIZE];
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+static inline struct list* hash_bucket(pgframe_t pgf)
+{
+	// multiplicative hashing (Knuth), highmem frame numbers are truncated
+	uint32_t key = (uint32_t)(pgf / PAGE_SIZE) * 2654435761u;
+
+	return &cow_hash[key >> (32 - __builtin_ctz(COW_HASH_SIZE))];
+}
+
+// ----------------------------------------------------------------------------
+
+static struct cow_frame* cow_lookup(pgframe_t pgf)
+{
+	struct cow_frame *frame = NULL;
+
+	list_for_each_entry(frame, hash_bucket(pgf), list) {
+		if (frame->pgf == pgf) {
+			return frame;
+		}
+	}
+
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Adds a reference to @pgf (a page frame mapped once has an implicit reference
+ * count of one).
+ *
+ * Returns true on success, false otherwise.
+ */
+
+static bool cow_get(pgframe_t pgf)
+{
+	struct cow_frame *frame = NULL;
+
+	if ((frame = cow_lookup(pgf)) != NULL) {
+		frame->refcount++;
+		return true;
+	}
+
+	if ((frame = (struct cow_frame*) kmalloc(sizeof(*frame))) == NULL) {
+		error("not enough memory");
+		return false;
+	}
+
+	frame->pgf = pgf;
+	frame->refcount = 2;
+	list_add(&frame->list, hash_bucket(pgf));
+
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Drops a reference to @pgf.
+ *
+ * Returns true if @pgf is still mapped somewhere else, false if the caller
+ * was the last user (i.e. it can be released or written).
+ */
+
+bool cow_put(pgframe_t pgf)
+{
+	struct cow_frame *frame = NULL;
+
+	if ((frame = cow_lookup(pgf)) == NULL) {
+		return false;
+	}
+
+	if (--frame->refcount == 1) {
+		// a single mapping left, it does not need a refcount anymore
+		list_del(&frame->list);
+		kfree(frame);
+	}
+
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Tries to resolve a write protection page fault at @fault_addr on a
+ * copy-on-write page: the page gets a private copy of the shared page frame
+ * (or the page frame itself if no one else maps it) and becomes writable.
+ *
+ * Returns true if the fault has been handled, false otherwise.
+ */
+
+bool cow_fault(uint32_t fault_addr)
+{
+	const uint32_t virt_addr = fault_addr & PAGE_MASK;
+	pte_t *pte = NULL;
+	pte_t flags = 0;
+	pgframe_t pgf = BAD_PAGE;
+	pgframe_t copy = BAD_PAGE;
+
+	if (((pte = lookup_pte(virt_addr)) == NULL) ||
+		((*pte & (PTE_MASK_PRESENT | PTE_MASK_COW)) !=
+		 (PTE_MASK_PRESENT | PTE_MASK_COW)))
+	{
+		return false;
+	}
+
+	pgf = *pte & PTE_MASK_ADDR;
+	flags = (*pte & ~(PTE_MASK_ADDR | PTE_MASK_COW)) | PTE_MASK_READWRITE;
+
+	if (cow_put(pgf)) {
+		// still shared, duplicate it
+		if ((copy = pfa_alloc_highmem(1)) == BAD_PAGE) {
+			error("not enough memory to copy page 0x%p", virt_addr);
+			cow_get(pgf); // rollback
+			return false;
+		}
+
+		// the scratch page might be in use by the interrupted code
+		if (map_page(copy, KMAP_COW, PTE_RW_KERNEL) == false) {
+			panic("failed to map the copy-on-write page");
+		}
+		memcpy((void*)KMAP_COW, (void*)virt_addr, PAGE_SIZE);
+		unmap_page(KMAP_COW);
+
+		pgf = copy;
+	}
+
+	paging_update_pte(virt_addr, pgf | flags);
+
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Creates a copy-on-write snapshot of [@src, @src + @size - 1]. Both the
+ * source and the snapshot share the page frames until one of them writes.
+ *
+ * @src must be page-aligned and the whole range must belong to a single
+ * vmalloc()'ed or demand_alloc()'ed area (page frames of other regions are not
+ * released with cow_put(), and write protecting a kernel stack would turn its
+ * next push into a double fault). Not yet backed demand-paged pages are
+ * populated first.
+ *
+ * Returns the (page-aligned) snapshot, or NULL on error. It must be released
+ * with cow_free().
+ */
+
+void* cow_snapshot(const void *src, size_t size)
+{
+	const uint32_t start = (uint32_t)src;
+	const pte_t cow_flags = (PTE_RW_KERNEL & ~PTE_MASK_READWRITE) | PTE_MASK_COW;
+	size_t nb_pages = 0;
+	uint32_t addr = 0;
+	size_t shared = 0;
+
+	if ((size == 0) || PAGE_OFFSET(start) ||
+		((vmalloc_contains(src, size) == false) &&
+		 (demand_contains(src, size) == false)))
+	{
+		error("invalid argument");
+		return NULL;
+	}
+
+	nb_pages = page_align(size) / PAGE_SIZE;
+
+	if ((addr = vmem_alloc(&kernel_vmem, nb_pages * PAGE_SIZE)) == 0) {
+		return NULL;
+	}
+
+	for (shared = 0; shared < nb_pages; ++shared) {
+		const uint32_t src_addr = start + shared * PAGE_SIZE;
+		pte_t *pte = lookup_pte(src_addr);
+		pgframe_t pgf = BAD_PAGE;
+
+		if ((pte != NULL) && ((*pte & (PTE_MASK_PRESENT | PTE_MASK_DEMAND)) ==
+							  PTE_MASK_DEMAND))
+		{
+			// back it now (read access)
+			(void) *(volatile uint8_t*)src_addr;
+		}
+
+		if ((pte == NULL) || ((*pte & PTE_MASK_PRESENT) == 0)) {
+			error("0x%p is not mapped", src_addr);
+			goto rollback;
+		}
+
+		pgf = *pte & PTE_MASK_ADDR;
+
+		if (cow_get(pgf) == false) {
+			goto rollback;
+		}
+
+		// write protect the source first, so it cannot change underneath
+		paging_update_pte(src_addr,
+			(*pte & ~PTE_MASK_READWRITE) | PTE_MASK_COW);
+
+		if (map_page(pgf, addr + shared * PAGE_SIZE, cow_flags) == false) {
+			cow_put(pgf); // the source keeps its copy-on-write flag
+			goto rollback;
+		}
+	}
+
+	dbg("%u pages of 0x%p shared at 0x%p", nb_pages, src, addr);
+
+	return (void*)addr;
+
+rollback:
+	while (shared-- > 0) {
+		const uint32_t virt_addr = addr + shared * PAGE_SIZE;
+		const pte_t *pte = lookup_pte(virt_addr);
+
+		if (cow_put(*pte & PTE_MASK_ADDR) == false) {
+			// the source has already been unshared (written)
+			pfa_free(*pte & PTE_MASK_ADDR);
+		}
+		unmap_page(virt_addr);
+	}
+	vmem_free(&kernel_vmem, addr);
+
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Releases @snapshot (created with cow_snapshot()).
+ */
+
+void cow_free(void *snapshot)
+{
+	const uint32_t start = (uint32_t)snapshot;
+	size_t size = 0;
+
+	if ((start < VMEM_START) || (start >= VMEM_END) ||
+		((size = vmem_size(&kernel_vmem, start)) == 0))
+	{
+		panic("ptr (0x%p) is not a snapshot", snapshot);
+	}
+
+	for (uint32_t addr = start; addr < (start + size); addr += PAGE_SIZE) {
+		const pte_t *pte = lookup_pte(addr);
+		pgframe_t pgf = BAD_PAGE;
+
+		if ((pte == NULL) || ((*pte & PTE_MASK_PRESENT) == 0)) {
+			panic("snapshot page 0x%p is not mapped", addr);
+		}
+
+		pgf = *pte & PTE_MASK_ADDR;
+		if (unmap_page(addr) == false) {
+			// this must not failed
+			panic("failed to unmap 0x%p", addr);
+		}
+
+		if (cow_put(pgf) == false) {
+			pfa_free(pgf);
+		}
+	}
+
+	vmem_free(&kernel_vmem, start);
+}
+
+// ----------------------------------------------------------------------------
+
+void cow_setup(void)
+{
+	for (size_t i = 0; i < COW_HASH_SIZE; ++i) {
+		INIT_LIST_HEAD(&cow_hash[i]);
+	}
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
@@ -34,6 +34,8 @@
 
 #include <mem/memory.h>
 
+#include <kernel/trace.h>
+
 #include <string.h>
 
 #define LOG_MODULE "kmalloc"
@@ -63,7 +65,7 @@ struct aha_block {
 
 struct aha_big_meta {
 	size_t size; // a power-of-two size
-	uint32_t ptr; // point to data (virt) and head page (phys)
+	uint32_t ptr; // point to data (virt)
 	struct list list; // pointer in 'aha_big_list'
 };
 
@@ -130,7 +132,12 @@ static void* big_alloc(size_t size)
 		}
 	}
 
-	return (void*)head_page;
+	// it might have filled (aligned) page tables
+	if (size >= LARGE_PAGE_SIZE) {
+		paging_promote();
+	}
+
+	return (void*) (uint32_t) head_page;
 }
 
 // ----------------------------------------------------------------------------
@@ -156,7 +163,7 @@ static struct aha_block* new_block(size_t elt_size)
 
 	dbg("new_block: elt_size = %u (nb_elts=%u)", elt_size, nb_elts);
 
-	if ((block = (struct aha_block*) pfa_alloc(1)) == NULL) {
+	if ((block = (struct aha_block*) (uint32_t) pfa_alloc(1)) == NULL) {
 		error("not enough memory");
 		return NULL;
 	}
@@ -243,6 +250,8 @@ static size_t next_highest_power_of_two(size_t size)
 
 static void big_free(struct aha_big_meta *meta)
 {
+	pgframe_t head_page = BAD_PAGE;
+
 	dbg("freeing big allocation (meta = 0x%p)", meta);
 
 	if (meta == NULL) {
@@ -253,6 +262,11 @@ static void big_free(struct aha_big_meta *meta)
 		warn("meta->size is not a PAGE_SIZE multiple");
 	}
 
+	// retrieve the 'head' page frame before it gets unmapped
+	if ((head_page = virt_to_phys((void*)meta->ptr)) == BAD_PHYS_ADDR) {
+		panic("big allocation 0x%p is not mapped", meta->ptr);
+	}
+
 	// unmap all pages
 	for (size_t i = 0; i < (meta->size / PAGE_SIZE); ++i) {
 		uint32_t addr = meta->ptr + i*PAGE_SIZE;
@@ -262,8 +276,7 @@ static void big_free(struct aha_big_meta *meta)
 		}
 	}
 
-	// free the 'head' page frame (ptr=virt=phys because of identity mapping)
-	pfa_free(meta->ptr);
+	pfa_free(head_page);
 
 	list_del(&meta->list);
 
@@ -314,7 +327,10 @@ void* kmalloc(size_t size)
 	dbg("new size %u", size);
 
 	if (size >= PAGE_SIZE) {
-		return big_alloc(size);
+		void *ptr = big_alloc(size);
+
+		trace("kmalloc: big %u bytes = 0x%p", size, ptr);
+		return ptr;
 	}
 
 	dbg("searching block...");
@@ -334,9 +350,12 @@ void* kmalloc(size_t size)
 	// allocates a new chunk
 	for (size_t chunk = 0; chunk < block->tot_elts; ++chunk) {
 		if (block->chunkmap[chunk] == CHUNK_FREE) {
+			void *ptr = (void*)(block->first_ptr + chunk*block->elt_size);
+
 			block->chunkmap[chunk] = CHUNK_USED;
 			block->nb_frees--;
-			return (void*)(block->first_ptr + chunk*block->elt_size);
+			trace("kmalloc: %u bytes = 0x%p", size, ptr);
+			return ptr;
 		}
 	}
 
@@ -358,6 +377,7 @@ void kfree(void *ptr)
 	struct aha_block *block = NULL;
 
 	dbg("freeing 0x%p", ptr);
+	trace("kfree: 0x%p", ptr);
 
 	if (ptr == NULL) {
 		panic("freeing NULL pointer");
@@ -409,6 +429,38 @@ found:
 	panic("ptr (0x%p) hasn't matching chunk in block 0x%p", ptr, block);
 }
 
+// ----------------------------------------------------------------------------
+
+/*
+ * Fills @stats with a summary of the allocator usage (walks every block).
+ */
+
+void kmalloc_get_stats(struct kmalloc_stats *stats)
+{
+	struct aha_block *block = NULL;
+	struct aha_big_meta *meta = NULL;
+
+	memset(stats, 0, sizeof(*stats));
+
+	if (!list_empty(&aha_block_list)) {
+		list_for_each_entry(block, &aha_block_list, list) {
+			const size_t used = block->tot_elts - block->nb_frees;
+
+			stats->nb_blocks++;
+			stats->used_chunks += used;
+			stats->free_chunks += block->nb_frees;
+			stats->used_bytes += used * block->elt_size;
+		}
+	}
+
+	if (!list_empty(&aha_big_list)) {
+		list_for_each_entry(meta, &aha_big_list, list) {
+			stats->nb_big++;
+			stats->big_bytes += meta->size;
+		}
+	}
+}
+
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
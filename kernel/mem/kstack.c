@@ -0,0 +1,211 @@
+/*
+ * kstack.c
+ *
+ * Guard-page protected kernel stacks.
+ *
+ * Kernel stacks are allocated from the kernel virtual address space (vmem)
+ * with one extra page below them which is never mapped. A stack overflow
+ * then faults on the guard page instead of silently corrupting whatever sits
+ * below the stack. The faulting address can be matched against the stack
+ * registry so the fault handlers report which stack overflowed.
+ *
+ * The CPU cannot push the page fault exception frame on an overflowed stack,
+ * hence the fault is escalated to a double fault which runs on its own stack
+ * (task gate, see [arch/i386/gdt.c]).
+ *
+ * The boot stack (see [arch/i386/boot.S]) gets the same treatment: it is
+ * preceded by a page-aligned guard page which is unmapped by kstack_setup().
+ */
+
+#include <mem/kstack.h>
+#include <mem/memory.h>
+#include <mem/vmem.h>
+
+#include <kernel/log.h>
+
+#define LOG_MODULE "kstack"
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+// implemented in [arch/i386/boot.S]
+extern uint8_t boot_stack_guard[];
+extern uint8_t boot_stack_top[];
+extern void asm_call_on_stack(uint32_t stack_top, void (*func)(void));
+
+// ----------------------------------------------------------------------------
+
+static struct kstack boot_kstack;
+
+LIST_DECLARE(kstack_list);
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Unmaps the boot stack guard page and registers the boot stack.
+ *
+ * Must be called once paging and vmem are ready.
+ */
+
+void kstack_setup(void)
+{
+	boot_kstack.owner = "boot";
+	boot_kstack.guard = (uint32_t)boot_stack_guard;
+	boot_kstack.bottom = boot_kstack.guard + PAGE_SIZE;
+	boot_kstack.top = (uint32_t)boot_stack_top;
+	boot_kstack.nb_pages = (boot_kstack.top - boot_kstack.bottom) / PAGE_SIZE;
+
+	if (unmap_page(boot_kstack.guard) == false) {
+		panic("failed to unmap the boot stack guard page");
+	}
+
+	list_add(&boot_kstack.list, &kstack_list);
+
+	dbg("boot stack: [0x%p - 0x%p] (guard at 0x%p)",
+		boot_kstack.bottom, boot_kstack.top - 1, boot_kstack.guard);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Allocates a kernel stack of @nb_pages pages on behalf of @owner (which must
+ * outlive the stack, a string literal is fine).
+ *
+ * Returns the stack descriptor, or NULL on error.
+ */
+
+struct kstack* kstack_alloc(const char *owner, size_t nb_pages)
+{
+	struct kstack *stack = NULL;
+	uint32_t addr = 0;
+	size_t mapped = 0;
+
+	if ((owner == NULL) || (nb_pages == 0) ||
+		(nb_pages >= (VMEM_END - VMEM_START) / PAGE_SIZE))
+	{
+		error("invalid argument");
+		return NULL;
+	}
+
+	stack = (struct kstack*)
+		kmalloc(sizeof(*stack) + nb_pages * sizeof(stack->frames[0]));
+	if (stack == NULL) {
+		error("not enough memory for metadata");
+		return NULL;
+	}
+
+	// one more page for the guard
+	if ((addr = vmem_alloc(&kernel_vmem, (nb_pages + 1) * PAGE_SIZE)) == 0) {
+		kfree(stack);
+		return NULL;
+	}
+
+	stack->owner = owner;
+	stack->guard = addr;
+	stack->bottom = addr + PAGE_SIZE;
+	stack->top = stack->bottom + nb_pages * PAGE_SIZE;
+	stack->nb_pages = nb_pages;
+
+	for (mapped = 0; mapped < nb_pages; ++mapped) {
+		uint32_t virt_addr = stack->bottom + mapped * PAGE_SIZE;
+
+		if ((stack->frames[mapped] = pfa_alloc_highmem(1)) == BAD_PAGE) {
+			error("not enough memory");
+			goto rollback;
+		}
+
+		if (map_page(stack->frames[mapped], virt_addr, PTE_RW_KERNEL) == false) {
+			error("failed to map 0x%p", virt_addr);
+			pfa_free(stack->frames[mapped]);
+			goto rollback;
+		}
+	}
+
+	list_add(&stack->list, &kstack_list);
+
+	dbg("stack \"%s\": [0x%p - 0x%p] (guard at 0x%p)",
+		owner, stack->bottom, stack->top - 1, stack->guard);
+
+	return stack;
+
+rollback:
+	while (mapped-- > 0) {
+		unmap_page(stack->bottom + mapped * PAGE_SIZE);
+		pfa_free(stack->frames[mapped]);
+	}
+	vmem_free(&kernel_vmem, addr);
+	kfree(stack);
+
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Releases @stack (allocated with kstack_alloc()). The stack must not be in
+ * use anymore.
+ */
+
+void kstack_free(struct kstack *stack)
+{
+	if ((stack == NULL) || (stack == &boot_kstack)) {
+		panic("invalid stack");
+	}
+
+	for (size_t i = 0; i < stack->nb_pages; ++i) {
+		uint32_t virt_addr = stack->bottom + i * PAGE_SIZE;
+
+		if (unmap_page(virt_addr) == false) {
+			// this must not failed
+			panic("failed to unmap 0x%p", virt_addr);
+		}
+		pfa_free(stack->frames[i]);
+	}
+
+	vmem_free(&kernel_vmem, stack->guard);
+	list_del(&stack->list);
+	kfree(stack);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns the owner of the stack whose guard page contains @addr, or NULL if
+ * @addr does not belong to any guard page.
+ *
+ * This is called from the fault handlers, it must not allocate nor fault.
+ */
+
+const char* kstack_guard_owner(uint32_t addr)
+{
+	struct kstack *stack = NULL;
+
+	list_for_each_entry(stack, &kstack_list, list) {
+		if ((addr >= stack->guard) && (addr < stack->bottom)) {
+			return stack->owner;
+		}
+	}
+
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Calls @func on top of @stack and switches back to the current stack when
+ * it returns.
+ */
+
+void kstack_run(struct kstack *stack, void (*func)(void))
+{
+	dbg("running 0x%p on stack \"%s\"", func, stack->owner);
+
+	asm_call_on_stack(stack->top, func);
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
@@ -2,9 +2,16 @@
  * page_frame_allocator.c
  *
  * The first implementation of a dummy page frame allocator.
+ *
+ * Regions are either entirely below IDENTITY_MAP_END ("lowmem") or entirely
+ * above it ("highmem", the physical memory map splits them). The PFA metadata
+ * and pfa_alloc() only use lowmem regions, since their page frames can be
+ * dereferenced through the identity mapping. Highmem page frames are only
+ * handed out by pfa_alloc_highmem().
  */
 
 #include <kernel/types.h>
+#include <kernel/trace.h>
 
 #include <mem/memory.h>
 #include <mem/pmm.h>
@@ -29,7 +36,7 @@ typedef unsigned char page_state_t;
 // ----------------------------------------------------------------------------
 
 struct pfa_region {
-	uint32_t first_page; // first allocatable page
+	pgframe_t first_page; // first allocatable page
 	size_t nb_pages;
 	page_state_t pagemap[0];
 	// pagemap goes here
@@ -67,7 +74,8 @@ static void dump_pfa_meta(struct pfa_meta *pm)
 		struct pfa_region *pr = pm->region_ptrs[region];
 		dbg("- region_ptrs[%u] = 0x%p", region, pm->region_ptrs[region]);
 		dbg("\t[region #%u] nb_pages = %u", region, pr->nb_pages);
-		dbg("\t[region #%u] first_page = 0x%p", region, pr->first_page);
+		dbg("\t[region #%u] first_page = " PHYS_FMT,
+			region, PHYS_ARG(pr->first_page));
 	}
 	dbg("-----------------------");
 }
@@ -85,7 +93,7 @@ static void dump_pfa_meta(struct pfa_meta *pm)
 
 static bool is_valid_region(struct phys_mmap_entry *pmme)
 {
-	uint32_t len = pmme->len;
+	phys_addr_t len = pmme->len;
 
 	if (pmme->type != MMAP_TYPE_AVAILABLE) {
 		return false;
@@ -97,7 +105,7 @@ static bool is_valid_region(struct phys_mmap_entry *pmme)
 	}
 
 	if (PAGE_OFFSET(pmme->addr)) {
-		uint32_t addr = page_align(pmme->addr);
+		phys_addr_t addr = phys_page_align(pmme->addr);
 
 		if (addr < pmme->addr) {
 			// int overflow
@@ -129,15 +137,16 @@ static size_t pfa_meta_size(struct phys_mmap *pmm)
 
 	for (size_t i = 0; i < pmm->len; ++i) {
 		struct phys_mmap_entry *pmme = &pmm->entries[i];
-		dbg("region[%u]: 0x%p (%u bytes)", i, pmme->addr, pmme->len);
+		dbg("region[%u]: " PHYS_FMT " (" PHYS_FMT " bytes)",
+			i, PHYS_ARG(pmme->addr), PHYS_ARG(pmme->len));
 		if (is_valid_region(pmme)) {
 			size_t nb_pages = 0;
-			size_t region_len = pmme->len;
+			phys_addr_t region_len = pmme->len;
 
 			dbg("valid region");
 
 			if (PAGE_OFFSET(pmme->addr)) {
-				region_len -= page_align(pmme->addr) - pmme->addr;
+				region_len -= phys_page_align(pmme->addr) - pmme->addr;
 			}
 			nb_pages = region_len / PAGE_SIZE;
 
@@ -153,9 +162,9 @@ static size_t pfa_meta_size(struct phys_mmap *pmm)
 // ----------------------------------------------------------------------------
 
 /*
- * Finds a region which can host the PFA metadata on a page-aligned starting
- * address. If a region is found, @meta is updated to point to the first
- * page-aligned address.
+ * Finds a (lowmem) region which can host the PFA metadata on a page-aligned
+ * starting address. If a region is found, @meta is updated to point to the
+ * first page-aligned address.
  *
  * NOTE: A valid region might become invalid once "consumed" by the PFA
  * metadata (not enough bytes remaining to hold a single page). That is, we
@@ -169,19 +178,21 @@ static size_t find_hosting_region(struct phys_mmap *pmm, size_t pfa_size,
 {
 	for (size_t region = 0; region < pmm->len; ++region) {
 		struct phys_mmap_entry *pmme = &pmm->entries[region];
-		size_t region_len = pmme->len;
+		phys_addr_t region_len = pmme->len;
 
-		if (is_valid_region(pmme) == false) {
+		if ((is_valid_region(pmme) == false) ||
+			(pmme->addr >= IDENTITY_MAP_END))
+		{
 			continue;
 		}
 
 		if (PAGE_OFFSET(pmme->addr)) {
-			region_len -= page_align(pmme->addr) - pmme->addr;
+			region_len -= phys_page_align(pmme->addr) - pmme->addr;
 		}
 
 		if (region_len >= pfa_size) {
 			// found one
-			*pfa = (struct pfa_meta*) page_align(pmme->addr);
+			*pfa = (struct pfa_meta*) (uint32_t) phys_page_align(pmme->addr);
 			return region;
 		}
 	}
@@ -194,14 +205,14 @@ static size_t find_hosting_region(struct phys_mmap *pmm, size_t pfa_size,
 static void init_pfa_region(struct phys_mmap_entry *pmme,
 							struct pfa_region *region)
 {
-	uint32_t len = pmme->len;
+	phys_addr_t len = pmme->len;
 
 	if (PAGE_OFFSET(pmme->addr)) {
 		// no int underflow check, the region is supposed to be valid
-		len -= page_align(pmme->addr) - pmme->addr;
+		len -= phys_page_align(pmme->addr) - pmme->addr;
 	}
 
-	region->first_page = page_align(pmme->addr);
+	region->first_page = phys_page_align(pmme->addr);
 	region->nb_pages = len / PAGE_SIZE;
 
 	for (size_t page = 0; page < region->nb_pages; ++page) {
@@ -276,8 +287,8 @@ static struct pfa_region* find_region(pgframe_t pgf)
 {
 	for (size_t i = 0; i < pfa_meta->nb_regions; ++i) {
 		struct pfa_region *region = pfa_meta->region_ptrs[i];
-		const uint32_t max_pgf =
-			region->first_page + region->nb_pages*PAGE_SIZE;
+		const pgframe_t max_pgf =
+			region->first_page + (pgframe_t)region->nb_pages * PAGE_SIZE;
 
 		if ((pgf >= region->first_page) && (pgf < max_pgf)) {
 			return region;
@@ -304,7 +315,7 @@ static pgframe_t pfa_alloc_single(struct pfa_region *region)
 	for (size_t page = 0; page < region->nb_pages; ++page) {
 		if (region->pagemap[page] == PAGE_FREE) {
 			region->pagemap[page] = PAGE_USED;
-			return (region->first_page + page * PAGE_SIZE);
+			return (region->first_page + (pgframe_t)page * PAGE_SIZE);
 		}
 	}
 
@@ -374,7 +385,48 @@ found:
 		}
 	}
 
-	return (region->first_page + start_page * PAGE_SIZE);
+	return (region->first_page + (pgframe_t)start_page * PAGE_SIZE);
+}
+
+// ----------------------------------------------------------------------------
+
+static inline bool is_highmem(struct pfa_region *region)
+{
+	return (region->first_page >= IDENTITY_MAP_END);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Allocates @nb_pages contiguous page frames from a highmem region if
+ * @highmem is set, from a lowmem region otherwise.
+ *
+ * Returns the physical address of the first page frame, or NULL on error.
+ */
+
+static pgframe_t pfa_alloc_from(size_t nb_pages, bool highmem)
+{
+	for (size_t i = 0; i < pfa_meta->nb_regions; ++i) {
+		struct pfa_region *region = pfa_meta->region_ptrs[i];
+		pgframe_t page_frame = BAD_PAGE;
+
+		if (is_highmem(region) != highmem) {
+			continue;
+		}
+
+		if (nb_pages == 1) {
+			page_frame = pfa_alloc_single(region);
+		} else {
+			page_frame = pfa_alloc_multiple(region, nb_pages);
+		}
+
+		if (page_frame != BAD_PAGE) {
+			dbg("allocated %u pages from region #%u", nb_pages, i);
+			return page_frame;
+		}
+	}
+
+	return BAD_PAGE;
 }
 
 // ============================================================================
@@ -446,7 +498,7 @@ bool pfa_init(void)
 // ----------------------------------------------------------------------------
 
 /*
- * Allocates @nb_pages contiguous page frames.
+ * Allocates @nb_pages contiguous page frames (below IDENTITY_MAP_END).
  *
  * WARNING: once paging is enabled, returned page(s) frame MUST BE mapped
  * before being deref'ed (expect a page fault otherwise).
@@ -456,25 +508,17 @@ bool pfa_init(void)
 
 pgframe_t pfa_alloc(size_t nb_pages)
 {
+	pgframe_t page_frame = BAD_PAGE;
+
 	if (nb_pages == 0) {
 		error("invalid argument");
 		return BAD_PAGE;
 	}
 
-	for (size_t i = 0; i < pfa_meta->nb_regions; ++i) {
-		struct pfa_region *region = pfa_meta->region_ptrs[i];
-		pgframe_t page_frame = BAD_PAGE;
-
-		if (nb_pages == 1) {
-			page_frame = pfa_alloc_single(region);
-		} else {
-			page_frame = pfa_alloc_multiple(region, nb_pages);
-		}
-
-		if (page_frame != BAD_PAGE) {
-			dbg("allocated %u pages from region #%u", nb_pages, i);
-			return page_frame;
-		}
+	if ((page_frame = pfa_alloc_from(nb_pages, false)) != BAD_PAGE) {
+		trace("pfa_alloc: %u pages = " PHYS_FMT, nb_pages,
+			PHYS_ARG(page_frame));
+		return page_frame;
 	}
 
 	// TODO: memory reclaim
@@ -485,6 +529,35 @@ pgframe_t pfa_alloc(size_t nb_pages)
 
 // ----------------------------------------------------------------------------
 
+/*
+ * Same as pfa_alloc() but page frames are preferably taken from highmem (i.e.
+ * above IDENTITY_MAP_END), falling back to lowmem. Use it when the page frames
+ * are mapped at arbitrary virtual addresses, it keeps lowmem for the identity
+ * mapped allocations.
+ *
+ * Returns the physical address of the first page frame, or NULL on error.
+ */
+
+pgframe_t pfa_alloc_highmem(size_t nb_pages)
+{
+	pgframe_t page_frame = BAD_PAGE;
+
+	if (nb_pages == 0) {
+		error("invalid argument");
+		return BAD_PAGE;
+	}
+
+	if ((page_frame = pfa_alloc_from(nb_pages, true)) != BAD_PAGE) {
+		trace("pfa_alloc_highmem: %u pages = " PHYS_FMT, nb_pages,
+			PHYS_ARG(page_frame));
+		return page_frame;
+	}
+
+	return pfa_alloc(nb_pages);
+}
+
+// ----------------------------------------------------------------------------
+
 /*
  * Frees a single page frame.
  *
@@ -500,7 +573,8 @@ void pfa_free(pgframe_t pgf)
 	size_t index = 0;
 	struct pfa_region *region = find_region(pgf);
 
-	dbg("freeing 0x%p", pgf);
+	dbg("freeing " PHYS_FMT, PHYS_ARG(pgf));
+	trace("pfa_free: " PHYS_FMT, PHYS_ARG(pgf));
 
 	if (region == NULL) {
 		panic("page frame does not belong to any region");
@@ -539,6 +613,44 @@ void pfa_free(pgframe_t pgf)
 	}
 }
 
+// ----------------------------------------------------------------------------
+
+/*
+ * Fills @stats with a summary of the page frames usage (walks every pagemap).
+ */
+
+void pfa_get_stats(struct pfa_stats *stats)
+{
+	struct pfa_region **regions = NULL;
+
+	memset(stats, 0, sizeof(*stats));
+
+	if (pfa_meta == NULL) {
+		return;
+	}
+
+	// indexing the zero-length array itself warns (-Wzero-length-bounds)
+	regions = pfa_meta->region_ptrs;
+	stats->nb_regions = pfa_meta->nb_regions;
+	for (size_t i = 0; i < pfa_meta->nb_regions; ++i) {
+		struct pfa_region *region = regions[i];
+		size_t free_pages = 0;
+
+		for (size_t page = 0; page < region->nb_pages; ++page) {
+			if (region->pagemap[page] == PAGE_FREE) {
+				free_pages++;
+			}
+		}
+
+		stats->nb_pages += region->nb_pages;
+		stats->free_pages += free_pages;
+		if (is_highmem(region)) {
+			stats->highmem_pages += region->nb_pages;
+			stats->highmem_free_pages += free_pages;
+		}
+	}
+}
+
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
@@ -4,8 +4,22 @@
  * Paging Memory management with a single level.
  *
  * For now, we use an Identity Paging policy. However, the page tables are
- * linearly mapped to [0xfffc0000 - 0xfffff000] (4MB) with the last one being
- * the page directory itself (PDE self-mapping).
+ * linearly mapped to [PAGE_TABLES_BASE - 0xffffffff] with the last one(s)
+ * being the page directory itself (PDE self-mapping).
+ *
+ * With CONFIG_PAE, the Physical Address Extension mode is used instead: the
+ * page directory is made of four (contiguous) page directories referenced by
+ * a Page-Directory-Pointer Table. Page table entries are 64-bit so page frames
+ * can be located above 4GB and data pages are marked no-execute (if the
+ * processor supports it).
+ *
+ * Fully populated page tables mapping a physically contiguous and aligned
+ * range with uniform flags can be collapsed into a single large page PDE
+ * (4MB, or 2MB with PAE) by paging_promote(). This saves the page table and,
+ * more importantly, TLB entries. A large page is split back into a page table
+ * when one of its pages needs to be changed (e.g. unmapped). Only the identity
+ * mapping is promoted: the vmem users (vfree(), COW) look their frames up in
+ * the page tables.
  *
  * Documentation:
  * - Intel (chapter 3 and 9)
@@ -14,14 +28,35 @@
  * - https://forum.osdev.org/viewtopic.php?f=15&t=19387 // PDE self-mapping
  * - https://wiki.osdev.org/TLB
  * - https://forum.osdev.org/viewtopic.php?f=1&t=18222 // TLB invalidation
+ * - https://wiki.osdev.org/Setting_Up_PAE // PAE
+ *
+ * New page tables are taken from a small reserve of pre-zeroed page frames, so
+ * map_page() does not need to call the PFA (nor clear a whole table) when it
+ * crosses into a new page table. The reserve is refilled out of the mapping
+ * paths with paging_reserve_refill(). The page tables of the most used
+ * regions (beginning of the vmem arena and the kmap region) are created at
+ * boot time.
+ *
+ * In addition, the [DEMAND_START - DEMAND_END] region is demand-paged: a
+ * reservation (managed by a vmem arena) only marks its PTEs with
+ * PTE_MASK_DEMAND (not present) and the page frames are allocated by the page
+ * fault handler on first access.
  */
 
 #include <mem/memory.h>
 #include <mem/pmm.h>
+#include <mem/vmem.h>
+#include <mem/kstack.h>
+#include <mem/cow.h>
 
 #include <kernel/log.h>
 
+#include <arch/cpu.h>
+#include <arch/cpuid.h>
 #include <arch/registers.h>
+#include <arch/tsc.h>
+
+#include <string.h>
 
 #define LOG_MODULE "paging"
 
@@ -29,16 +64,29 @@
 // ----------------------------------------------------------------------------
 // ============================================================================
 
-#define PD_INDEX(virt_addr) ((uint32_t)virt_addr >> 22) // highest 10-bits
-#define PT_INDEX(virt_addr) (((uint32_t)virt_addr >> 12) & 0x3ff) // middle 10-bits
+// with PAE, PD_INDEX() also includes the PDPT index (highest 2-bits)
+#define PD_INDEX(virt_addr) ((uint32_t)virt_addr >> PDE_SHIFT)
+#define PT_INDEX(virt_addr) \
+	(((uint32_t)virt_addr >> 12) & (PTRS_PER_TABLE - 1))
+
+// virtual address of a page table (paging must be enabled)
+#define PAGE_TABLE(pd_index) \
+	((pte_t*) (PAGE_TABLES_BASE + (pd_index) * PAGE_SIZE))
 
 #define PDE_PRESENT(pd_index) \
 	(!!((uint32_t)page_directory[pd_index] & PDE_MASK_PRESENT))
 
-// ----------------------------------------------------------------------------
+#define PDE_LARGE(pd_index) \
+	(!!((uint32_t)page_directory[pd_index] & PDE_MASK_PAGE_SIZE))
 
-inline static void invalidate_tlb(void);
-inline static void invalidate_tlb_page(uint32_t virt_addr);
+// PTE flags which does not prevent a large page promotion
+#define PTE_MASK_VOLATILE (PTE_MASK_ACCESSED | PTE_MASK_DIRTY)
+
+#define PT_RESERVE_SIZE		8 // pre-zeroed page tables
+#define PT_RESERVE_LOW		4 // refill below this level
+
+// page tables created at boot time, from VMEM_START
+#define PT_PREPOPULATE_VMEM_SIZE	(16 << 20)
 
 // ============================================================================
 // ----------------------------------------------------------------------------
@@ -51,12 +99,28 @@ static pde_t *page_directory = NULL;
 // spread all-over the kernel.
 static bool paging_enabled = false;
 
+static bool nx_enabled = false;
+
+static bool large_pages = false;
+
+#ifdef CONFIG_PAE
+// the Page-Directory-Pointer Table must be 32-bytes aligned and below 4GB
+static pdpte_t pdpt[NB_PAGE_DIRECTORIES] __attribute__((aligned(32)));
+#endif
+
+static pgframe_t pt_reserve[PT_RESERVE_SIZE];
+static size_t pt_reserve_count = 0;
+
+static struct vmem demand_vmem; // [DEMAND_START - DEMAND_END] arena
+static struct demand_stats demand_stats;
+
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
 
 /*
  * Loads a new page_directory located at @pg_dir (physical address) into CR3.
+ * With CONFIG_PAE, @pg_dir is the Page-Directory-Pointer Table instead.
  *
  * It left the CR3's flags untouched.
  *
@@ -67,6 +131,16 @@ static bool load_page_directory(uint32_t pgd_phys_addr)
 {
 	reg_t reg;
 
+#ifdef CONFIG_PAE
+	if (pgd_phys_addr & 0x1f) {
+		error("PDPT address is not 32-bytes aligned");
+		return false;
+	}
+
+	reg = read_cr3();
+
+	reg.val = (reg.val & 0x1f) | pgd_phys_addr;
+#else
 	if (PAGE_OFFSET(pgd_phys_addr) != 0) {
 		error("page directory address is not page-aligned");
 		return false;
@@ -75,6 +149,7 @@ static bool load_page_directory(uint32_t pgd_phys_addr)
 	reg = read_cr3();
 
 	reg.cr3.pdb = pgd_phys_addr >> 12;
+#endif
 
 	write_cr3(reg); // writing to CR3 invalidates the whole TLB cache
 
@@ -83,6 +158,74 @@ static bool load_page_directory(uint32_t pgd_phys_addr)
 
 // ----------------------------------------------------------------------------
 
+/*
+ * Enables no-execute pages if both the paging mode (PAE) and the processor
+ * support it. Otherwise, PTE_MASK_NO_EXECUTE is silently dropped by
+ * map_page().
+ */
+
+static void nx_setup(void)
+{
+#ifdef CONFIG_PAE
+	if (cpu_has_nx() == false) {
+		warn("no-execute pages are not supported by the processor");
+		return;
+	}
+
+	write_msr(MSR_EFER, read_msr(MSR_EFER) | MSR_EFER_NXE);
+	nx_enabled = true;
+
+	info("no-execute pages enabled");
+#endif
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Enables large pages (4MB) if the processor supports them. With PAE, large
+ * pages (2MB) are always available.
+ */
+
+static void pse_setup(void)
+{
+#ifndef CONFIG_PAE
+	reg_t reg;
+
+	if (cpu_has_pse() == false) {
+		warn("large pages are not supported by the processor");
+		return;
+	}
+
+	reg = read_cr4();
+	reg.cr4.pse = 1;
+	write_cr4(reg);
+#endif
+
+	large_pages = true;
+
+	info("large pages enabled (%u KB)", LARGE_PAGE_SIZE / 1024);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns @flags without the PTE flags unsupported by the current setup.
+ *
+ * NOTE: Setting PTE_MASK_NO_EXECUTE while it is not enabled is a reserved bit
+ * violation (page fault).
+ */
+
+static inline pte_t supported_flags(pte_t flags)
+{
+	if (nx_enabled == false) {
+		flags &= ~PTE_MASK_NO_EXECUTE;
+	}
+
+	return flags;
+}
+
+// ----------------------------------------------------------------------------
+
 /*
  * Identity maps critical memory region (kernel, VRAM, etc.) before enabling
  * paging, otherwise the kernel will instant crash.
@@ -96,18 +239,40 @@ static void bootstrap_mapping(void)
 		char name[16];
 		uint32_t start; // must be page aligned
 		uint32_t end;
+		pte_t flags;
 	};
 
 	struct bootstrap_range maps[] = {
 		{
-			.name	= "kernel",
+			.name	= "kernel code",
 			.start	= kernel_start,
+			.end	= kernel_rodata_start - 1,
+			.flags	= PTE_RWX_KERNEL_NOCACHE,
+		},
+		{
+			.name	= "kernel rodata",
+			.start	= kernel_rodata_start,
+			.end	= kernel_symtab_start - 1,
+			.flags	= PTE_RW_KERNEL_NOCACHE,
+		},
+		{
+			// cached, the symbol table is searched in place
+			.name	= "kernel symbols",
+			.start	= kernel_symtab_start,
+			.end	= kernel_symtab_end - 1,
+			.flags	= PTE_RO_KERNEL,
+		},
+		{
+			.name	= "kernel data",
+			.start	= page_align(kernel_symtab_end),
 			.end	= kernel_end,
+			.flags	= PTE_RW_KERNEL_NOCACHE,
 		},
 		{
 			.name	= "vram",
 			.start	= 0xa0000,
 			.end	= 0xfffff,
+			.flags	= PTE_RW_KERNEL_NOCACHE,
 		},
 	};
 
@@ -126,7 +291,7 @@ static void bootstrap_mapping(void)
 		dbg("mapping [%p - %p] %s", range->start, end - 1, range->name);
 
 		for (size_t addr = range->start; addr < end; addr += PAGE_SIZE) {
-			if (map_page(addr, addr, PTE_RW_KERNEL_NOCACHE) == false) {
+			if (map_page(addr, addr, range->flags) == false) {
 				// unrecoverable
 				panic("failed to map 0x%p", addr);
 			}
@@ -148,10 +313,10 @@ static void bootstrap_mapping(void)
 __attribute__((unused)) /* debugging function */
 static void dump_pde(pde_t pde)
 {
-	dbg("---[ dumping PDE: 0x%x ]---", pde);
+	dbg("---[ dumping PDE: " PHYS_FMT " ]---", PHYS_ARG(pde));
 
-	dbg("page table addr (phys) = 0x%p", pde & PDE_MASK_ADDR);
-	dbg("flags = 0x%x", pde & ~PDE_MASK_ADDR);
+	dbg("page table addr (phys) = " PHYS_FMT, PHYS_ARG(pde & PDE_MASK_ADDR));
+	dbg("flags = " PHYS_FMT, PHYS_ARG(pde & ~PDE_MASK_ADDR));
 
 	dbg("- present: %s", pde & PDE_MASK_PRESENT ? "yes" : "no");
 	dbg("- ro/rw: %s", pde & PDE_MASK_READWRITE ? "read/write" : "read-only");
@@ -161,7 +326,8 @@ static void dump_pde(pde_t pde)
 		pde & PDE_MASK_WRITE_THROUGH ? "write-through" : "write-back");
 	dbg("- cache: %s", pde & PDE_MASK_CACHE_DISABLED ? "disabled" : "enabled");
 	dbg("- accessed: %s", pde & PDE_MASK_ACCESSED ? "yes" : "no");
-	dbg("- page size: %s", pde & PDE_MASK_PAGE_SIZE ? "4MB" : "4KB");
+	dbg("- page size: %s", pde & PDE_MASK_PAGE_SIZE ? "large" : "4KB");
+	dbg("- no-execute: %s", pde & PTE_MASK_NO_EXECUTE ? "yes" : "no");
 	dbg("- global: %s", pde & PDE_MASK_GLOBAL_PAGE ? "yes" : "no");
 
 	dbg("---[ end of dump ]---");
@@ -176,10 +342,10 @@ static void dump_pde(pde_t pde)
 __attribute__((unused)) /* debugging function */
 static void dump_pte(pte_t pte)
 {
-	dbg("---[ dumping PTE: 0x%x ]---", pte);
+	dbg("---[ dumping PTE: " PHYS_FMT " ]---", PHYS_ARG(pte));
 
-	dbg("page addr (phys) = 0x%p", pte & PTE_MASK_ADDR);
-	dbg("flags = 0x%x", pte & ~PTE_MASK_ADDR);
+	dbg("page addr (phys) = " PHYS_FMT, PHYS_ARG(pte & PTE_MASK_ADDR));
+	dbg("flags = " PHYS_FMT, PHYS_ARG(pte & ~PTE_MASK_ADDR));
 
 	dbg("- present: %s", pte & PTE_MASK_PRESENT ? "yes" : "no");
 	dbg("- ro/rw: %s", pte & PTE_MASK_READWRITE ? "read/write" : "read-only");
@@ -192,6 +358,7 @@ static void dump_pte(pte_t pte)
 	dbg("- dirty: %s", pte & PTE_MASK_DIRTY ? "yes" : "no");
 	dbg("- PAT: %s", pte & PTE_MASK_PT_ATTRIBUTE_INDEX ? "enabled" : "disabled");
 	dbg("- global: %sTLB invalidation", pte & PTE_MASK_GLOBAL_PAGE?"no ":"");
+	dbg("- no-execute: %s", pte & PTE_MASK_NO_EXECUTE ? "yes" : "no");
 
 	dbg("---[ end of dump ]---");
 }
@@ -216,9 +383,9 @@ static void dump_page_table(pte_t *pg_table, bool only_present)
 		return;
 	}
 
-	for (size_t i = 0; i < 1024; ++i) {
+	for (size_t i = 0; i < PTRS_PER_TABLE; ++i) {
 		if (!only_present || (pg_table[i] & PTE_MASK_PRESENT)) {
-			dbg("  pt[%d] = 0x%x", i, pg_table[i]);
+			dbg("  pt[%d] = " PHYS_FMT, i, PHYS_ARG(pg_table[i]));
 			nb_presents++;
 		}
 	}
@@ -232,17 +399,42 @@ static void dump_page_table(pte_t *pg_table, bool only_present)
 
 // ----------------------------------------------------------------------------
 
+/*
+ * Takes a page frame for a new page table, from the reserve if possible. Sets
+ * @zeroed if the page frame is already cleared.
+ *
+ * Returns the page frame, or BAD_PAGE on error.
+ */
+
+static pgframe_t pt_reserve_take(bool *zeroed)
+{
+	if (pt_reserve_count > 0) {
+		*zeroed = true;
+		return pt_reserve[--pt_reserve_count];
+	}
+
+	// slow path: the reserve is empty (or not filled yet)
+	dbg("page-table reserve is empty");
+	*zeroed = false;
+
+	return pfa_alloc(1);
+}
+
+// ----------------------------------------------------------------------------
+
 /*
  * Allocates a new page table, marks all PTE non present and maps it.
  *
+ * The PDE is permissive (PDE_PERMISSIVE), the PTEs hold the actual flags.
+ *
  * Returns the created page table on success, NULL otherwise.
  */
 
-static pte_t* new_page_table(uint32_t pd_index, uint32_t flags)
+static pte_t* new_page_table(uint32_t pd_index)
 {
-	pde_t pde_flags = 0;
-	uint32_t new_pt_phys = 0;
+	pgframe_t new_pt_phys = BAD_PAGE;
 	pte_t *page_table = NULL;
+	bool zeroed = false;
 
 	dbg("creating new page table");
 
@@ -251,34 +443,32 @@ static pte_t* new_page_table(uint32_t pd_index, uint32_t flags)
 		return NULL;
 	}
 
-	if ((new_pt_phys = pfa_alloc(1)) == 0) {
+	if ((new_pt_phys = pt_reserve_take(&zeroed)) == BAD_PAGE) {
 		error("not enough memory");
 		return NULL;
 	}
 
-	// insert the new page directory entry (don't copy GLOBAL or PAT flags)
-	pde_flags  = flags & PG_CONSISTENT_MASK;
-	pde_flags |= PDE_MASK_PRESENT; // mark it present
-	page_directory[pd_index] = pde_flags | new_pt_phys;
+	// insert the new page directory entry
+	page_directory[pd_index] = new_pt_phys | PDE_PERMISSIVE | PDE_MASK_PRESENT;
 
 	// now let's retrieve its virtual address
 	if (paging_enabled) {
 		// using PDE self-mapping tricks
-		page_table = (pte_t*) (0xffc00000 + pd_index * PAGE_SIZE);
-		invalidate_tlb(); // XXX: faster to invalidate 1024 pages instead?
+		page_table = PAGE_TABLE(pd_index);
+		// the PDE was not present, so no translation of the page table range
+		// can be cached: only its page tables window entry needs a flush
+		invalidate_tlb_page((uint32_t) page_table);
 	} else {
 		// identity mapping
-		page_table = (pte_t*) new_pt_phys;
+		page_table = (pte_t*) (uint32_t) new_pt_phys;
 	}
 	dbg("page_table = %p", page_table);
 
-	// mark all entries as "not present" but set the other flags
-	for (size_t i = 0; i < 1024; ++i) {
-		page_table[i] = flags & ~PDE_MASK_PRESENT;
-	}
-
-	if (paging_enabled) {
-		invalidate_tlb(); // XXX: faster to invalidate 1024 pages instead?
+	if (zeroed == false) {
+		// mark all entries as "not present"
+		for (size_t i = 0; i < PTRS_PER_TABLE; ++i) {
+			page_table[i] = 0;
+		}
 	}
 
 	dbg("new page table created");
@@ -289,50 +479,118 @@ static pte_t* new_page_table(uint32_t pd_index, uint32_t flags)
 // ----------------------------------------------------------------------------
 
 /*
- * Invalidates the whole TLB cache.
+ * Marks the page at @virt_addr as "demand-paged" with @flags PTE flags. The
+ * page table is created if needed.
  *
- * NOTE: This is an EXPENSIVE operation and must be avoided if possible.
- *
- * In addition, this won't works on SMP as it only flush a single CPU TLB
- * cache. In SMP, this is more complexe, requires to send IPI, etc.
+ * Returns true on success, false otherwise.
  */
 
-inline static void invalidate_tlb(void)
+static bool demand_reserve_page(uint32_t virt_addr, pte_t flags)
 {
-	asm volatile("mov %%cr3, %%eax\n"
-				 "mov %%eax, %%cr3"
-				 : );
+	uint32_t pd_index = PD_INDEX(virt_addr);
+	uint32_t pt_index = PT_INDEX(virt_addr);
+	pte_t *page_table = NULL;
+
+	if (PDE_PRESENT(pd_index) == false) {
+		if ((page_table = new_page_table(pd_index)) == NULL) {
+			error("failed to create new page table");
+			return false;
+		}
+	} else {
+		page_table = PAGE_TABLE(pd_index);
+	}
+
+	if (page_table[pt_index] & (PTE_MASK_PRESENT | PTE_MASK_DEMAND)) {
+		panic("page 0x%p is already reserved", virt_addr);
+	}
+
+	// no TLB invalidation required, the page stays "not present"
+	page_table[pt_index] = supported_flags(flags) | PTE_MASK_DEMAND;
+
+	return true;
 }
 
 // ----------------------------------------------------------------------------
 
 /*
- * Invalidates a single TLB page table entry for virtual address @virt_addr.
- *
- * The CPU automatically retrieves the TLB PTE from the virtual address.
- *
- * Uses this version instead of invalidate_tlb() whenever possible.
- *
- * The TLB cache must be invalidated on page table operations (creation,
- * modification, deletion).
+ * Releases the demand-paged page at @virt_addr. Its page frame (if any) is
+ * unmapped and given back to the PFA.
+ */
+
+static void demand_release_page(uint32_t virt_addr)
+{
+	uint32_t pd_index = PD_INDEX(virt_addr);
+	uint32_t pt_index = PT_INDEX(virt_addr);
+	pte_t *page_table = PAGE_TABLE(pd_index);
+	pte_t pte = 0;
+
+	if (PDE_PRESENT(pd_index) == false) {
+		panic("releasing a non reserved page 0x%p", virt_addr);
+	}
+
+	pte = page_table[pt_index];
+	if ((pte & PTE_MASK_DEMAND) == 0) {
+		panic("releasing a non reserved page 0x%p", virt_addr);
+	}
+
+	page_table[pt_index] = 0;
+
+	if (pte & PTE_MASK_PRESENT) {
+		invalidate_tlb_page(virt_addr);
+		// the page frame might be shared with a snapshot
+		if (cow_put(pte & PTE_MASK_ADDR) == false) {
+			pfa_free(pte & PTE_MASK_ADDR);
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Tries to resolve a "not present" page fault at @fault_addr by backing a
+ * demand-paged page with a new (zeroed) page frame.
  *
- * NOTE: The "invlpg" only exists since i486 processors. For older cpu, it
- * falls back to a full TLB cache invalidation.
+ * Returns true if the fault has been handled, false otherwise.
  */
 
-inline static void invalidate_tlb_page(uint32_t virt_addr)
+static bool demand_fault(uint32_t fault_addr)
 {
-#if 0
-	// only for archictecture with a CPU lesser than i486 (not planned to
-	// support).
-	invalidate_tlb();
-#else
-	// we can use the 'invlpg' instruction
-	asm volatile("invlpg (%0)"
-				 : /* no output */
-				 :"r" (virt_addr)
-				 : "memory");
-#endif
+	const uint64_t start = rdtsc();
+	const uint32_t virt_addr = fault_addr & PAGE_MASK;
+	pte_t *pte = NULL;
+	pgframe_t pgf = BAD_PAGE;
+	uint64_t cycles = 0;
+
+	if ((virt_addr < DEMAND_START) || (virt_addr >= DEMAND_END)) {
+		return false;
+	}
+
+	if (((pte = lookup_pte(virt_addr)) == NULL) ||
+		((*pte & PTE_MASK_DEMAND) == 0))
+	{
+		// not reserved
+		return false;
+	}
+
+	if ((pgf = pfa_alloc_highmem(1)) == BAD_PAGE) {
+		error("not enough memory to back demand-paged page 0x%p", virt_addr);
+		return false;
+	}
+
+	// keep the PTE_MASK_DEMAND flag, demand_free() relies on it
+	*pte |= pgf | PTE_MASK_PRESENT;
+	invalidate_tlb_page(virt_addr);
+
+	memset((void*)virt_addr, 0, PAGE_SIZE);
+
+	cycles = rdtsc() - start;
+	demand_stats.nb_faults++;
+	demand_stats.total_cycles += cycles;
+	if (cycles > demand_stats.max_cycles) {
+		demand_stats.max_cycles = cycles;
+	}
+
+	return true;
 }
 
 // ============================================================================
@@ -342,8 +600,9 @@ inline static void invalidate_tlb_page(uint32_t virt_addr)
 /*
  * Handles Page Fault (#PF) exception.
  *
- * As there is no userland, no demand paging nor copy-on-write right now, page
- * faulting always crash the kernel.
+ * Faults on demand-paged pages and writes to copy-on-write pages are resolved,
+ * in that case the faulting instruction is restarted once we return. As there
+ * is no userland right now, any other page fault crashes the kernel.
  */
 
 void page_fault_handler(int error)
@@ -352,6 +611,23 @@ void page_fault_handler(int error)
 	uint32_t pd_index;
 	uint32_t pt_index;
 	pte_t *page_table = NULL; // virtual address
+	const char *owner = NULL;
+
+	// retrieve the faulty address
+	cr2 = read_cr2();
+
+	if (((error & 0x1) == 0) && demand_fault(cr2.val)) {
+		return;
+	}
+
+	// present + write
+	if (((error & 0x3) == 0x3) && cow_fault(cr2.val)) {
+		return;
+	}
+
+	if ((owner = kstack_guard_owner(cr2.val)) != NULL) {
+		panic("stack overflow in %s", owner);
+	}
 
 	info("\"Page Fault\" exception detected!");
 	info("");
@@ -359,9 +635,11 @@ void page_fault_handler(int error)
 	// pretty print error code
 	info("error code: %d (page %s, %s access)", error,
 		(error & 0x1) ? "present" : "not present",
-		(error & 0x2) ? "write" : "read");
+		(error & 0x10) ? "execute" : (error & 0x2) ? "write" : "read");
 	info("origin: %s mode", (error & 0x4) ? "user" : "supervisor");
-	// TODO: handle others error code when supporting PSE/PSA/NX
+	if (error & 0x8) {
+		info("reserved bit set in a paging-structure entry");
+	}
 	info("");
 
 	if (error & 0x1) {
@@ -369,8 +647,6 @@ void page_fault_handler(int error)
 		NOT_IMPLEMENTED();
 	}
 
-	// retrieve the faulty address
-	cr2 = read_cr2();
 	pd_index = PD_INDEX(cr2.val);
 	pt_index = PT_INDEX(cr2.val);
 
@@ -387,14 +663,18 @@ void page_fault_handler(int error)
 	dump_pde(page_directory[pd_index]);
 	dbg("");
 
+	if (PDE_LARGE(pd_index)) {
+		panic("page fault on a large page");
+	}
+
 	// retrieve the corresponding page table
-	page_table = (pte_t*) (0xffc00000 + pd_index * PAGE_SIZE);
+	page_table = PAGE_TABLE(pd_index);
 	info("page-table address (virt): 0x%p", page_table);
 	info("");
 
 	// we assume the page table is mapped, otherwise the page mapping code
 	// is seriously flawed
-	info("PTE: 0x%x", page_table[pt_index]);
+	info("PTE: " PHYS_FMT, PHYS_ARG(page_table[pt_index]));
 	info("");
 
 	if ((page_table[pt_index] & PTE_MASK_PRESENT) == 0) {
@@ -403,7 +683,7 @@ void page_fault_handler(int error)
 	dump_pte(page_table[pt_index]);
 	dbg("");
 
-	NOT_IMPLEMENTED(); // mostly protection fault or new feature (nx/pae/pse)
+	NOT_IMPLEMENTED(); // mostly protection fault or new feature
 }
 
 // ----------------------------------------------------------------------------
@@ -411,26 +691,25 @@ void page_fault_handler(int error)
 /*
  * Maps a single page for @phys_addr to @virt_addr using @flags PTE flags.
  *
- * If a PDE entry is present, it is expected that @flag is consistent with it
- * (both read/write, both supervisor, etc.).
- *
- * If there is no PDE, a new page table is allocated from the PFA and the PDE's
- * flags is based on @flags.
+ * If there is no PDE, a new page table is allocated from the PFA. The PDEs are
+ * permissive so @flags do not need to match the other pages of the same page
+ * table.
  *
  * Rewriting an existing PTE (i.e. page present) is not allowed with map_page().
  *
  * NOTE: @phys_addr can point to memory mapped I/O (e.g. VGA buffer). It does
  * not have to be real memory.
  *
+ * PTE_MASK_NO_EXECUTE is ignored if no-execute pages are not enabled.
+ *
  * Returns true on success, false otherwise.
  */
 
-bool map_page(uint32_t phys_addr, uint32_t virt_addr, uint32_t flags)
+bool map_page(phys_addr_t phys_addr, uint32_t virt_addr, pte_t flags)
 {
 	uint32_t pd_index = 0;
 	uint32_t pt_index = 0;
 	pte_t *page_table = NULL;
-	pde_t pde_flags = 0;
 
 	//dbg("phys_addr = 0x%x", phys_addr);
 	//dbg("virt_addr = 0x%x", virt_addr);
@@ -445,6 +724,8 @@ bool map_page(uint32_t phys_addr, uint32_t virt_addr, uint32_t flags)
 		return false;
 	}
 
+	flags = supported_flags(flags);
+
 	// compute page-directory and page-table index from virtual address
 	pd_index = PD_INDEX(virt_addr);
 	pt_index = PT_INDEX(virt_addr);
@@ -452,22 +733,20 @@ bool map_page(uint32_t phys_addr, uint32_t virt_addr, uint32_t flags)
 	// is the PDE present ?
 	if ((page_directory[pd_index] & PDE_MASK_PRESENT) == 0) {
 		// nope, we need to allocate a new page table and initialize it first
-		if ((page_table = new_page_table(pd_index, flags)) == NULL) {
+		if ((page_table = new_page_table(pd_index)) == NULL) {
 			panic("failed to create new page table");
 		}
 	} else {
-		// check for consistency between @flags and PDE's flags
-		pde_flags = page_directory[pd_index] & PG_CONSISTENT_MASK;
-		if ((flags & PG_CONSISTENT_MASK) != pde_flags) {
-			error("flags are not consistent with page-directory entry");
-			return false;
+		if (PDE_LARGE(pd_index)) {
+			panic("overwriting a large page mapping!");
 		}
 
 		if (paging_enabled) {
-			page_table = (pte_t*) (0xffc00000 + pd_index * PAGE_SIZE);
+			page_table = PAGE_TABLE(pd_index);
 		} else {
 			// identity mapping
-			page_table = (pte_t*) (page_directory[pd_index] & PDE_MASK_ADDR);
+			page_table = (pte_t*)
+				(uint32_t) (page_directory[pd_index] & PDE_MASK_ADDR);
 		}
 
 		// is there already a mapping present?
@@ -478,7 +757,8 @@ bool map_page(uint32_t phys_addr, uint32_t virt_addr, uint32_t flags)
 
 	// set the PTE
 	page_table[pt_index] = phys_addr | flags | PTE_MASK_PRESENT;
-	dbg("page 0x%x (phys) mapped to 0x%x (virt)", phys_addr, virt_addr);
+	dbg("page " PHYS_FMT " (phys) mapped to 0x%x (virt)",
+		PHYS_ARG(phys_addr), virt_addr);
 
 	invalidate_tlb_page(virt_addr);
 
@@ -512,7 +792,7 @@ bool unmap_page(uint32_t virt_addr)
 		return false;
 	}
 
-	if (pd_index == 1023) {
+	if (pd_index >= PDE_SELFMAP_INDEX) {
 		// this is a serious issue
 		panic("cannot unmap page table/directory");
 	}
@@ -522,12 +802,17 @@ bool unmap_page(uint32_t virt_addr)
 		return false;
 	}
 
+	if (PDE_LARGE(pd_index) && (paging_split(virt_addr) == false)) {
+		error("failed to split large page");
+		return false;
+	}
+
 	// retrieve page table address
 	if (paging_enabled) {
-		pg_table = (pte_t*) (0xffc00000 + pd_index * PAGE_SIZE);
+		pg_table = PAGE_TABLE(pd_index);
 	} else {
 		// identity mapping
-		pg_table = (pte_t*) (page_directory[pd_index] & PDE_MASK_ADDR);
+		pg_table = (pte_t*) (uint32_t) (page_directory[pd_index] & PDE_MASK_ADDR);
 	}
 	dbg("pg_table = 0x%p", pg_table);
 
@@ -551,6 +836,339 @@ bool unmap_page(uint32_t virt_addr)
 
 // ----------------------------------------------------------------------------
 
+/*
+ * Walks the page tables for @virt_addr. Paging must be enabled.
+ *
+ * Returns a pointer to the PTE (through the linear page tables window), or
+ * NULL if there is no page table for @virt_addr (including large pages). The
+ * PTE might not be present.
+ */
+
+pte_t* lookup_pte(uint32_t virt_addr)
+{
+	const uint32_t pd_index = PD_INDEX(virt_addr);
+
+	if ((PDE_PRESENT(pd_index) == false) || PDE_LARGE(pd_index)) {
+		return NULL;
+	}
+
+	return &PAGE_TABLE(pd_index)[PT_INDEX(virt_addr)];
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Replaces the PTE of @virt_addr with @pte (e.g. to change its permissions)
+ * and flushes its TLB entry. The page table must exist.
+ */
+
+void paging_update_pte(uint32_t virt_addr, pte_t pte)
+{
+	pte_t *entry = NULL;
+
+	if ((entry = lookup_pte(virt_addr)) == NULL) {
+		panic("no page table for 0x%p", virt_addr);
+	}
+
+	*entry = supported_flags(pte);
+	invalidate_tlb_page(virt_addr & PAGE_MASK);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Maps @pgf at the KMAP_SCRATCH fixed virtual page, so a page frame without
+ * mapping (e.g. highmem or a page table being built) can be accessed. Paging
+ * must be enabled. The mapping must be released with kunmap_scratch() before
+ * the next call.
+ *
+ * NOTE: There is a single scratch page, this is not re-entrant (do not use it
+ * from an interrupt handler).
+ *
+ * Returns the virtual address of @pgf.
+ */
+
+void* kmap_scratch(pgframe_t pgf)
+{
+	if (map_page(pgf, KMAP_SCRATCH, PTE_RW_KERNEL) == false) {
+		// the scratch page is already in use
+		panic("failed to map the scratch page");
+	}
+
+	return (void*) KMAP_SCRATCH;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Releases the scratch mapping set by kmap_scratch().
+ */
+
+void kunmap_scratch(void)
+{
+	if (unmap_page(KMAP_SCRATCH) == false) {
+		panic("failed to unmap the scratch page");
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Collapses the page table of @pd_index into a large page PDE if it maps a
+ * physically contiguous and aligned range, with every PTE present and the same
+ * flags (accessed/dirty excluded). The page table is given back to the PFA.
+ *
+ * Returns true if the page table has been promoted, false otherwise.
+ */
+
+static bool promote_page_table(uint32_t pd_index)
+{
+	const pte_t *page_table = PAGE_TABLE(pd_index);
+	const pgframe_t pt_phys = page_directory[pd_index] & PDE_MASK_ADDR;
+	const phys_addr_t base = page_table[0] & PTE_MASK_ADDR;
+	const pte_t flags = page_table[0] & ~(PTE_MASK_ADDR | PTE_MASK_VOLATILE);
+	pte_t volatile_flags = 0;
+
+	// fast path: most page tables are rejected by their first entry
+	if (((flags & PTE_MASK_PRESENT) == 0) ||
+		(base & (LARGE_PAGE_SIZE - 1)) ||
+		(flags & (PTE_MASK_PT_ATTRIBUTE_INDEX | PTE_MASK_SOFTWARE)))
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < PTRS_PER_TABLE; ++i) {
+		const pte_t pte = page_table[i];
+
+		if (((pte & ~(PTE_MASK_ADDR | PTE_MASK_VOLATILE)) != flags) ||
+			((pte & PTE_MASK_ADDR) != (base + i * PAGE_SIZE)))
+		{
+			return false;
+		}
+
+		volatile_flags |= pte & PTE_MASK_VOLATILE;
+	}
+
+	// same bit positions for a large page PDE (PAT excluded above)
+	page_directory[pd_index] =
+		base | flags | volatile_flags | PDE_MASK_PAGE_SIZE;
+
+	// the page table (and its paging-structure cache entries) are gone
+	invalidate_tlb();
+	pfa_free(pt_phys);
+
+	dbg("promoted [0x%p - 0x%p]", pd_index << PDE_SHIFT,
+		((pd_index + 1) << PDE_SHIFT) - 1);
+
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Large page promotion pass: collapses every eligible page table of the
+ * identity mapping (see promote_page_table()) into a large page. It can be
+ * run at any time, for instance once a large physically contiguous range has
+ * been mapped.
+ *
+ * Returns the number of promoted page tables.
+ */
+
+size_t paging_promote(void)
+{
+	size_t nb_promoted = 0;
+
+	if ((large_pages == false) || (paging_enabled == false)) {
+		return 0;
+	}
+
+	// vmem ranges keep their page tables, see lookup_pte() users
+	for (uint32_t pd_index = 0; pd_index < (IDENTITY_MAP_END >> PDE_SHIFT);
+		 ++pd_index)
+	{
+		if (PDE_PRESENT(pd_index) && (PDE_LARGE(pd_index) == false) &&
+			promote_page_table(pd_index))
+		{
+			nb_promoted++;
+		}
+	}
+
+	if (nb_promoted > 0) {
+		info("%u page tables promoted to large pages", nb_promoted);
+	}
+
+	return nb_promoted;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Splits the large page mapping @virt_addr back into a page table of 4KB
+ * pages with the same flags. Afterward, any of these pages can be changed
+ * individually.
+ *
+ * Returns true on success, false otherwise.
+ */
+
+bool paging_split(uint32_t virt_addr)
+{
+	const uint32_t pd_index = PD_INDEX(virt_addr);
+	const pde_t pde = page_directory[pd_index];
+	const phys_addr_t base = pde & PDE_MASK_LARGE_ADDR;
+	pte_t flags = 0;
+	pgframe_t pt_phys = BAD_PAGE;
+	pte_t *page_table = NULL;
+	bool zeroed = false;
+
+	if ((PDE_PRESENT(pd_index) == false) || (PDE_LARGE(pd_index) == false)) {
+		error("0x%p is not mapped by a large page", virt_addr);
+		return false;
+	}
+
+	// same bit positions for a PTE (except PAT which is never set)
+	flags = pde & ~(PDE_MASK_LARGE_ADDR | PDE_MASK_PAGE_SIZE |
+					PDE_MASK_LARGE_PAT);
+
+	// every entry is overwritten, a zeroed one does not matter
+	if ((pt_phys = pt_reserve_take(&zeroed)) == BAD_PAGE) {
+		error("not enough memory");
+		return false;
+	}
+
+	// build the page table aside, the large page is still in use
+	page_table = (pte_t*) kmap_scratch(pt_phys);
+	for (size_t i = 0; i < PTRS_PER_TABLE; ++i) {
+		page_table[i] = (base + i * PAGE_SIZE) | flags;
+	}
+	kunmap_scratch();
+
+	page_directory[pd_index] = pt_phys | PDE_PERMISSIVE | PDE_MASK_PRESENT;
+	invalidate_tlb();
+
+	dbg("split [0x%p - 0x%p]", pd_index << PDE_SHIFT,
+		((pd_index + 1) << PDE_SHIFT) - 1);
+
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Refills the page-table reserve with pre-zeroed page frames (cleared through
+ * the scratch mapping, so they can come from highmem). Paging must be enabled.
+ *
+ * This is meant to be called outside of the mapping paths (e.g. from the
+ * kernel main loop) and does nothing until the reserve drops below
+ * PT_RESERVE_LOW.
+ *
+ * Returns true on success, false otherwise (not enough memory).
+ */
+
+bool paging_reserve_refill(void)
+{
+	if (pt_reserve_count >= PT_RESERVE_LOW) {
+		return true;
+	}
+
+	while (pt_reserve_count < PT_RESERVE_SIZE) {
+		pgframe_t pgf = BAD_PAGE;
+
+		if ((pgf = pfa_alloc_highmem(1)) == BAD_PAGE) {
+			error("not enough memory");
+			return false;
+		}
+
+		// used later on, no need to have it in the caches
+		clear_page(kmap_scratch(pgf));
+		kunmap_scratch();
+
+		pt_reserve[pt_reserve_count++] = pgf;
+	}
+
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Creates the missing page tables covering [@start, @end - 1], so mapping a
+ * page there neither allocates nor fails for lack of a page table.
+ */
+
+static void prepopulate_page_tables(uint32_t start, uint32_t end)
+{
+	const uint32_t last = end - 1;
+
+	for (uint32_t pd_index = PD_INDEX(start); pd_index <= PD_INDEX(last);
+		 ++pd_index)
+	{
+		if (PDE_PRESENT(pd_index)) {
+			continue;
+		}
+
+		if (new_page_table(pd_index) == NULL) {
+			panic("failed to create new page table");
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Translates the virtual buffer [@buf, @buf + @len - 1] into a list of
+ * physically contiguous segments stored in @segs (up to @max_segs). Adjacent
+ * pages which are also physically adjacent are merged in a single segment.
+ *
+ * Returns the number of segments, or 0 on error (unmapped page or @segs is too
+ * small).
+ */
+
+size_t virt_to_sg(const void *buf, size_t len, struct sg_segment *segs,
+				  size_t max_segs)
+{
+	uint32_t virt_addr = (uint32_t)buf;
+	struct sg_segment *seg = NULL;
+	size_t nb_segs = 0;
+
+	if ((buf == NULL) || (len == 0) || (segs == NULL) || (max_segs == 0)) {
+		error("invalid argument");
+		return 0;
+	}
+
+	while (len > 0) {
+		// bytes until the end of the page (or the buffer)
+		size_t chunk = PAGE_SIZE - PAGE_OFFSET(virt_addr);
+		phys_addr_t phys_addr = virt_to_phys((void*)virt_addr);
+
+		if (chunk > len) {
+			chunk = len;
+		}
+
+		if (phys_addr == BAD_PHYS_ADDR) {
+			error("0x%p is not mapped", virt_addr);
+			return 0;
+		}
+
+		if ((seg != NULL) && ((seg->addr + seg->len) == phys_addr)) {
+			seg->len += chunk;
+		} else if (nb_segs < max_segs) {
+			seg = &segs[nb_segs++];
+			seg->addr = phys_addr;
+			seg->len = chunk;
+		} else {
+			error("more than %u segments are required", max_segs);
+			return 0;
+		}
+
+		virt_addr += chunk;
+		len -= chunk;
+	}
+
+	return nb_segs;
+}
+
+// ----------------------------------------------------------------------------
+
 /*
  * Setup an Identity Mapping for the first 4MB of memory and enable paging.
  */
@@ -559,19 +1177,27 @@ void paging_setup(void)
 {
 	reg_t reg;
 	pgframe_t pgd_phys_addr = 0;
+	uint32_t root_phys_addr = 0; // loaded into CR3
 	pde_t *pde = 0;
 
 	info("paging setup...");
 
-	if ((pgd_phys_addr = pfa_alloc(1)) == 0) {
+#ifdef CONFIG_PAE
+	if (cpu_has_pae() == false) {
+		panic("PAE is not supported by the processor");
+	}
+#endif
+
+	// the page directories are contiguous, so they can be indexed as one
+	if ((pgd_phys_addr = pfa_alloc(NB_PAGE_DIRECTORIES)) == BAD_PAGE) {
 		panic("cannot allocate page_directory");
 	}
-	dbg("pgd_phys_addr = 0x%p", pgd_phys_addr);
+	dbg("pgd_phys_addr = 0x%p", (uint32_t) pgd_phys_addr);
 
 	// first clear the whole page directory
-	for (size_t entry = 0; entry < (PAGE_SIZE/sizeof(pde_t)); ++entry) {
-		pde = (pde_t*)(pgd_phys_addr + entry * sizeof(*pde));
-		*pde = PDE_RW_KERNEL_NOCACHE;
+	for (size_t entry = 0; entry < NB_PDE; ++entry) {
+		pde = (pde_t*)(uint32_t)(pgd_phys_addr + entry * sizeof(*pde));
+		*pde = 0;
 	}
 
 	/*
@@ -588,44 +1214,194 @@ void paging_setup(void)
 	 *
 	 * Furthermore, because of this PDE self-mapping tricks, we can also
 	 * quickly retrieves ANY pagetable's virtual address. In order to do so,
-	 * we need to offset (virtual) address 0xfffc0000. That is, to get the
-	 * second pagetable virtual address, we need 0xfffc0000 + 1*PAGE_SIZE.
+	 * we need to offset (virtual) address 0xffc00000. That is, to get the
+	 * second pagetable virtual address, we need 0xffc00000 + 1*PAGE_SIZE.
 	 *
 	 * The MMU will first see the pd_index number 1023 and the 1023 entry
 	 * is the last PDE which points to itself. Next, the pt_index will be
 	 * 2, which points to our page table.
+	 *
+	 * With PAE, the same applies with the four last PDEs pointing to the
+	 * four page directories: page tables start at 0xff800000 and the page
+	 * directories are at 0xffffc000.
 	 */
 
-	// get the last entry physical address
-	uint32_t last_pde_offset = ((PAGE_SIZE/sizeof(pde_t)) - 1) * sizeof(pde_t);
-	pde = (pde_t*)(pgd_phys_addr + last_pde_offset);
-	dbg("pgd's pde = 0x%p", pde);
+	for (size_t i = 0; i < NB_PAGE_DIRECTORIES; ++i) {
+		pde = (pde_t*)(uint32_t)
+			(pgd_phys_addr + (PDE_SELFMAP_INDEX + i) * sizeof(*pde));
+		dbg("pgd's pde = 0x%p", pde);
 
-	// make it point to the page-directory itself
-	*pde = pgd_phys_addr | PDE_RW_KERNEL_NOCACHE | PDE_MASK_PRESENT;
+		// make it point to the page-directory itself (supervisor only, it
+		// also acts as the PTEs of the page tables window)
+		*pde = (pgd_phys_addr + i * PAGE_SIZE) |
+			PDE_RW_KERNEL | PDE_MASK_PRESENT;
+	}
+
+#ifdef CONFIG_PAE
+	// the PDPT is part of the kernel image (i.e. identity mapped)
+	for (size_t i = 0; i < NB_PAGE_DIRECTORIES; ++i) {
+		pdpt[i] = (pgd_phys_addr + i * PAGE_SIZE) | PDPTE_MASK_PRESENT;
+	}
+	root_phys_addr = (uint32_t) pdpt;
+#else
+	root_phys_addr = pgd_phys_addr;
+#endif
+
+	// must be enabled before any no-execute mapping
+	nx_setup();
+	pse_setup();
 
 	// here we lie to map_page() because paging is actually not enabled yet.
-	page_directory = (pde_t*) pgd_phys_addr;
+	page_directory = (pde_t*) (uint32_t) pgd_phys_addr;
 	bootstrap_mapping();
 
 	// loads the physical address of page-directory into CR3
-	if (load_page_directory(pgd_phys_addr) == false) {
+	if (load_page_directory(root_phys_addr) == false) {
 		panic("failed to load the new page directory");
 	}
 
 	// finally, update page_directory to its correct virtual address
-	page_directory = (pde_t*) 0xfffff000; // the very last virtual page
+	page_directory = (pde_t*) PAGE_DIRECTORY_BASE;
+
+#ifdef CONFIG_PAE
+	// the PDPT entries are loaded when paging gets enabled
+	reg = read_cr4();
+	reg.cr4.pae = 1;
+	write_cr4(reg);
+#endif
 
-	// enable paging
+	// enable paging, read-only pages are also enforced in supervisor mode
+	// (copy-on-write)
 	reg = read_cr0();
 	reg.cr0.pg = 1;
+	reg.cr0.wp = 1;
 	write_cr0(reg);
 
 	paging_enabled = true;
 
+	// the scratch page (used by the refill) must not need a page table
+	prepopulate_page_tables(KMAP_START, KMAP_END);
+	prepopulate_page_tables(VMEM_START, VMEM_START + PT_PREPOPULATE_VMEM_SIZE);
+
+	if (paging_reserve_refill() == false) {
+		panic("failed to fill the page-table reserve");
+	}
+
+	if (vmem_init(&demand_vmem, "demand", DEMAND_START,
+				  DEMAND_END - DEMAND_START, PAGE_SIZE, 0) == false)
+	{
+		panic("failed to create demand-paged arena");
+	}
+
 	success("paging setup succeed");
 }
 
+// ----------------------------------------------------------------------------
+
+/*
+ * Reserves @size bytes (rounded up to PAGE_SIZE) in the demand-paged region.
+ *
+ * No page frame is allocated here. Instead, they are allocated (and zeroed)
+ * by the page fault handler the first time a page is accessed. That is, a
+ * large sparse object only pays for the pages it actually touches (plus the
+ * page tables).
+ *
+ * Returns the (page-aligned) reserved area, or NULL on error.
+ */
+
+void* demand_alloc(size_t size)
+{
+	uint32_t start = 0;
+	uint32_t addr = 0;
+
+	if (paging_enabled == false) {
+		error("paging is not enabled yet");
+		return NULL;
+	}
+
+	if ((start = vmem_alloc(&demand_vmem, size)) == 0) {
+		error("cannot reserve %u bytes", size);
+		return NULL;
+	}
+	size = vmem_size(&demand_vmem, start);
+
+	dbg("reserving %u bytes at 0x%p", size, start);
+
+	for (addr = start; addr < (start + size); addr += PAGE_SIZE) {
+		if (demand_reserve_page(addr, PTE_RW_KERNEL) == false) {
+			error("failed to reserve page 0x%p", addr);
+			goto rollback;
+		}
+	}
+
+	return (void*)start;
+
+rollback:
+	while (addr > start) {
+		addr -= PAGE_SIZE;
+		demand_release_page(addr);
+	}
+	vmem_free(&demand_vmem, start);
+
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Releases the demand-paged area at @ptr (allocated with demand_alloc()).
+ * Every page frame that has been faulted in is unmapped and given back to the
+ * PFA.
+ */
+
+void demand_free(void *ptr)
+{
+	uint32_t start = (uint32_t)ptr;
+	size_t size = 0;
+
+	if ((start < DEMAND_START) || (start >= DEMAND_END) ||
+		((size = vmem_size(&demand_vmem, start)) == 0))
+	{
+		panic("ptr (0x%p) has not been demand_alloc()'ed", ptr);
+	}
+
+	dbg("releasing %u bytes at 0x%p", size, ptr);
+
+	for (uint32_t addr = start; addr < (start + size); addr += PAGE_SIZE) {
+		demand_release_page(addr);
+	}
+
+	vmem_free(&demand_vmem, start);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns true if [@ptr, @ptr + @size - 1] lies within a single
+ * demand_alloc()'ed area, false otherwise.
+ */
+
+bool demand_contains(const void *ptr, size_t size)
+{
+	return vmem_contains(&demand_vmem, (uint32_t)ptr, size);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Retrieves the demand paging statistics.
+ */
+
+void demand_get_stats(struct demand_stats *stats)
+{
+	if (stats == NULL) {
+		error("invalid argument");
+		return;
+	}
+
+	*stats = demand_stats;
+}
+
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
@@ -32,6 +32,10 @@
  * Available memory past the "initrd" can (and must) be used by the page
  * frame allocator.
  *
+ * Available regions crossing IDENTITY_MAP_END are split there, so each region
+ * is either entirely identity mappable or not ("highmem"). Memory above 4GB
+ * is only kept with CONFIG_PAE.
+ *
  * Finally, once the phys mem map initialization is complete, the @mbi as well
  * as other multiboot structures are trashed and shouldn't be dereferenced
  * anymore.
@@ -137,8 +141,8 @@ static void dump_phys_mem_map(struct phys_mmap *pmm)
 			default: type = "UNKNOWN"; break;
 		}
 
-		dbg("[0x%08x - 0x%08x] %s",
-			pmme->addr, (uint32_t)pmme->addr + pmme->len - 1, type);
+		dbg("[" PHYS_FMT " - " PHYS_FMT "] %s",
+			PHYS_ARG(pmme->addr), PHYS_ARG(pmme->addr + pmme->len - 1), type);
 	}
 
 	dbg("----------------------------------");
@@ -156,7 +160,7 @@ static void dump_phys_mem_map(struct phys_mmap *pmm)
  * Returns true on success, false otherwise.
  */
 
-static bool split_region(struct phys_mmap *pmm, size_t entry, uint32_t addr)
+static bool split_region(struct phys_mmap *pmm, size_t entry, phys_addr_t addr)
 {
 	struct phys_mmap_entry *pmme = NULL;
 	struct phys_mmap_entry *next = NULL;
@@ -273,6 +277,9 @@ static size_t phys_mem_map_size(multiboot_info_t *mbi)
 	// ...some more if there is a module.
 	nb_entries += !!(mbi->flags & MULTIBOOT_INFO_MODS);
 
+	// ...one more if an available region crosses IDENTITY_MAP_END...
+	nb_entries += 1;
+
 	// in the worst scenario case, each "reserve" will split an available
 	// region in three parts (two availables, one reserved). Make room for
 	// them.
@@ -392,9 +399,8 @@ static uint32_t find_pmm_location(multiboot_info_t *mbi, struct phys_mmap *mbr,
 			continue;
 		}
 
-		// beyond the 4GB limit ?
+		// beyond the 4GB limit ? (the phys mem map must be identity mapped)
 		if (mmap->addr >> 32) {
-			warn("memory above 4GB is not supported");
 			continue;
 		}
 
@@ -544,6 +550,8 @@ static bool identify_multiboot_regions(multiboot_info_t *mbi,
 
 /*
  * Fills @pmm from the @mbi's memory map.
+ *
+ * Available regions crossing IDENTITY_MAP_END are split in two entries.
  */
 
 static void fill_phys_mmap(multiboot_info_t *mbi, struct phys_mmap *pmm)
@@ -554,22 +562,41 @@ static void fill_phys_mmap(multiboot_info_t *mbi, struct phys_mmap *pmm)
 	mmap_for_each(mmap, mbi) {
 		struct phys_mmap_entry *pmme = &pmm->entries[entry];
 
+#ifdef CONFIG_PAE
+		pmme->addr = mmap->addr;
+		pmme->len = mmap->len;
+#else
 		if (mmap->addr >> 32) {
-			warn("ignoring memory above 4GB");
+			warn("ignoring memory above 4GB (requires PAE)");
 			continue;
 		}
 
 		pmme->addr = (uint32_t)(mmap->addr & 0xffffffff);
 
-		 // more than 4GB available?
-		if (mmap->len >> 32) {
+		 // goes beyond 4GB?
+		if ((mmap->addr + mmap->len) > 0x100000000ULL) {
 			// shrink it
-			pmme->len = 0xffffffff -pmme->addr + 1;
+			pmme->len = 0xffffffff - pmme->addr + 1;
 		} else {
 			pmme->len = (uint32_t) (mmap->len & 0xffffffff);
 		}
+#endif
 
 		pmme->type = mmap->type;
+
+		// available memory is either lowmem or highmem, not both
+		if ((pmme->type == MMAP_TYPE_AVAILABLE) &&
+			(pmme->addr < IDENTITY_MAP_END) &&
+			(pmme->len > (IDENTITY_MAP_END - pmme->addr)))
+		{
+			struct phys_mmap_entry *high = &pmm->entries[++entry];
+
+			high->addr = IDENTITY_MAP_END;
+			high->len = pmme->len - (IDENTITY_MAP_END - pmme->addr);
+			high->type = pmme->type;
+			pmme->len = IDENTITY_MAP_END - pmme->addr;
+		}
+
 		entry++;
 	}
 
@@ -723,7 +750,8 @@ bool phys_mem_map_map_module(void)
 		 addr < ((uint32_t)module_addr + module_len);
 		 addr += PAGE_SIZE)
 	{
-		if (map_page(addr, addr, PTE_RW_KERNEL_NOCACHE) == false) {
+		// cached: the symbol table is searched in place
+		if (map_page(addr, addr, PTE_RW_KERNEL) == false) {
 			// unrecoverable error
 			panic("failed to map page 0x%p", addr);
 		}
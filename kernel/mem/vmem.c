@@ -0,0 +1,718 @@
+/*
+ * vmem.c
+ *
+ * Kernel Virtual Address Space Allocator.
+ *
+ * This is a (simplified) implementation of the "vmem" resource allocator from
+ * Bonwick & Adams. It only deals with virtual address ranges, it never
+ * allocates nor maps any page frame by itself. That is, the virtual layout no
+ * longer depends on where the page frames are located (physical
+ * fragmentation).
+ *
+ * DESIGN:
+ *
+ * An arena is made of segments (boundary tags) describing either a free or an
+ * allocated range. All segments are linked together in an address-ordered
+ * list, so coalescing a freed segment with its neighbours is O(1).
+ *
+ * Free segments are also kept in power-of-two freelists: freelists[N] holds
+ * segments of size [2^N, 2^(N+1) - 1]. An allocation of @size bytes picks the
+ * first segment of the first non-empty freelist strictly above its size class
+ * ("instant-fit"), any of them is guaranteed to be large enough. A bitmap of
+ * the non-empty freelists makes it a single "bsf" instruction. Only when all
+ * the freelists above are empty, the freelist of its own size class is
+ * scanned linearly for a segment which is large enough (first-fit).
+ *
+ * Allocated segments are kept in a hash table indexed by their starting
+ * address, so freeing does not require the size.
+ *
+ * Finally, small allocations (up to VMEM_QCACHE_MAX quanta) are served by
+ * "quantum caches": stacks of recently freed ranges of the same size which
+ * do not go back to the arena. This avoids segment splitting/coalescing (and
+ * boundary tags allocation) for the most common requests (e.g. stacks).
+ *
+ * Documentation:
+ * - Bonwick & Adams, "Magazines and Vmem: Extending the Slab Allocator to
+ *   Many CPUs and Arbitrary Resources" (USENIX 2001)
+ */
+
+#include <mem/vmem.h>
+#include <mem/memory.h>
+#include <mem/cow.h>
+
+#include <kernel/log.h>
+
+#define LOG_MODULE "vmem"
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#define SEG_FREE	((uint8_t) 0)
+#define SEG_ALLOC	((uint8_t) 1)
+#define SEG_CACHED	((uint8_t) 2) // freed, but held by a quantum cache
+
+// ----------------------------------------------------------------------------
+
+// boundary tag
+struct vmem_seg {
+	uint32_t start;
+	size_t size;
+	uint8_t type;
+	struct vm_area *area; // vmalloc()'ed area (allocated segments) or NULL
+	struct list seg_list; // pointer in arena's 'seg_list' (address ordered)
+	struct list list; // pointer in a freelist or a hash chain
+};
+
+// ----------------------------------------------------------------------------
+
+// vmalloc()'ed area, the page frames are not contiguous
+struct vm_area {
+	uint32_t addr;
+	size_t nb_pages;
+	pgframe_t frames[0]; // variable size
+};
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+struct vmem kernel_vmem;
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Returns floor(log2(@x)), @x must not be zero.
+ */
+
+static inline size_t flog2(size_t x)
+{
+	return 31 - __builtin_clz(x);
+}
+
+// ----------------------------------------------------------------------------
+
+static inline struct list* hash_bucket(struct vmem *vm, uint32_t addr)
+{
+	// multiplicative hashing (Knuth)
+	uint32_t key = (addr / vm->quantum) * 2654435761u;
+
+	return &vm->hash[key >> (32 - __builtin_ctz(VMEM_HASH_SIZE))];
+}
+
+// ----------------------------------------------------------------------------
+
+static void freelist_insert(struct vmem *vm, struct vmem_seg *seg)
+{
+	size_t index = flog2(seg->size);
+
+	seg->type = SEG_FREE;
+	list_add(&seg->list, &vm->freelists[index]);
+	vm->freemap |= (1 << index);
+}
+
+// ----------------------------------------------------------------------------
+
+static void freelist_remove(struct vmem *vm, struct vmem_seg *seg)
+{
+	size_t index = flog2(seg->size);
+
+	list_del(&seg->list);
+	if (list_empty(&vm->freelists[index])) {
+		vm->freemap &= ~(1 << index);
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Finds a free segment of at least @size bytes (@size is quantum aligned).
+ *
+ * Returns the segment (still in its freelist), or NULL if none is found.
+ */
+
+static struct vmem_seg* find_free_seg(struct vmem *vm, size_t size)
+{
+	struct vmem_seg *seg = NULL;
+	size_t index = flog2(size);
+	uint32_t map = 0;
+
+	// instant-fit: any segment from a higher size class is large enough
+	if ((index + 1) < VMEM_NB_FREELISTS) {
+		map = vm->freemap & ~((1 << (index + 1)) - 1);
+	}
+
+	if (map != 0) {
+		struct list *freelist = &vm->freelists[__builtin_ctz(map)];
+		return list_entry(freelist->next, struct vmem_seg, list);
+	}
+
+	// fallback: some segment of the same size class might fit (linear scan)
+	list_for_each_entry(seg, &vm->freelists[index], list) {
+		if (seg->size >= size) {
+			return seg;
+		}
+	}
+
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+
+static struct vmem_seg* hash_lookup(struct vmem *vm, uint32_t addr)
+{
+	struct vmem_seg *seg = NULL;
+	struct list *bucket = hash_bucket(vm, addr);
+
+	list_for_each_entry(seg, bucket, list) {
+		if (seg->start == addr) {
+			return seg;
+		}
+	}
+
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns the allocated segment containing the whole [@addr, @addr + @size - 1]
+ * range, or NULL if there is none.
+ *
+ * NOTE: This walks the segment list, it is meant for argument checking only.
+ */
+
+static struct vmem_seg* find_alloc_seg(struct vmem *vm, uint32_t addr,
+									   size_t size)
+{
+	struct vmem_seg *seg = NULL;
+
+	list_for_each_entry(seg, &vm->seg_list, seg_list) {
+		if ((addr - seg->start) < seg->size) {
+			if ((seg->type != SEG_ALLOC) ||
+				(size > (seg->size - (addr - seg->start))))
+			{
+				return NULL;
+			}
+			return seg;
+		}
+	}
+
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns the quantum cache serving @size bytes, or NULL if there is none.
+ */
+
+static struct vmem_qcache* get_qcache(struct vmem *vm, size_t size)
+{
+	size_t index = (size / vm->quantum) - 1;
+
+	return (index < vm->nb_qcaches) ? &vm->qcaches[index] : NULL;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Allocates @size bytes (quantum aligned) from the arena itself.
+ *
+ * Returns the starting address, or 0 on error.
+ */
+
+static uint32_t arena_alloc(struct vmem *vm, size_t size)
+{
+	struct vmem_seg *seg = NULL;
+	struct vmem_seg *remain = NULL;
+
+	if ((seg = find_free_seg(vm, size)) == NULL) {
+		return 0;
+	}
+
+	if (seg->size > size) {
+		// split it, the remaining part stays free
+		remain = (struct vmem_seg*) kmalloc(sizeof(*remain));
+		if (remain == NULL) {
+			error("not enough memory for boundary tag");
+			return 0;
+		}
+	}
+
+	freelist_remove(vm, seg);
+
+	if (remain != NULL) {
+		remain->start = seg->start + size;
+		remain->size = seg->size - size;
+		list_add(&remain->seg_list, &seg->seg_list); // right after 'seg'
+		freelist_insert(vm, remain);
+		seg->size = size;
+	}
+
+	seg->type = SEG_ALLOC;
+	seg->area = NULL;
+	list_add(&seg->list, hash_bucket(vm, seg->start));
+
+	return seg->start;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Gives the allocated segment @seg back to the arena and coalesces it with its
+ * free neighbours.
+ */
+
+static void arena_free(struct vmem *vm, struct vmem_seg *seg)
+{
+	struct vmem_seg *prev = NULL;
+	struct vmem_seg *next = NULL;
+
+	list_del(&seg->list); // remove from hash
+
+	if (seg->seg_list.next != &vm->seg_list) {
+		next = list_entry(seg->seg_list.next, struct vmem_seg, seg_list);
+		if (next->type == SEG_FREE) {
+			freelist_remove(vm, next);
+			seg->size += next->size;
+			list_del(&next->seg_list);
+			kfree(next);
+		}
+	}
+
+	if (seg->seg_list.prev != &vm->seg_list) {
+		prev = list_entry(seg->seg_list.prev, struct vmem_seg, seg_list);
+		if (prev->type == SEG_FREE) {
+			freelist_remove(vm, prev);
+			prev->size += seg->size;
+			list_del(&seg->seg_list);
+			kfree(seg);
+			seg = prev;
+		}
+	}
+
+	freelist_insert(vm, seg);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Gives every range held by the quantum caches back to the arena.
+ *
+ * Returns true if at least one range has been released, false otherwise.
+ */
+
+static bool qcache_purge(struct vmem *vm)
+{
+	bool purged = false;
+
+	for (size_t i = 0; i < vm->nb_qcaches; ++i) {
+		struct vmem_qcache *qc = &vm->qcaches[i];
+
+		while (qc->nb_cached > 0) {
+			arena_free(vm, qc->segs[--qc->nb_cached]);
+			purged = true;
+		}
+	}
+
+	return purged;
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Initializes the @vm arena to manage [@base, @base + @size - 1] with a
+ * @quantum granularity. Allocations up to @nb_qcaches quanta are served by
+ * quantum caches (zero disables them).
+ *
+ * NOTE: @base must not be zero (it is used as an error value).
+ *
+ * Returns true on success, false otherwise.
+ */
+
+bool vmem_init(struct vmem *vm, const char *name, uint32_t base, size_t size,
+			   size_t quantum, size_t nb_qcaches)
+{
+	struct vmem_seg *seg = NULL;
+
+	dbg("creating arena <%s> [0x%p - 0x%p]", name, base, base + size - 1);
+
+	if ((vm == NULL) || (base == 0) || (size == 0) || (quantum == 0) ||
+		(quantum & (quantum - 1)) || (base % quantum) || (size % quantum) ||
+		(nb_qcaches > VMEM_QCACHE_MAX))
+	{
+		error("invalid argument");
+		return false;
+	}
+
+	vm->name = name;
+	vm->base = base;
+	vm->size = size;
+	vm->quantum = quantum;
+	vm->in_use = 0;
+	vm->freemap = 0;
+	vm->nb_qcaches = nb_qcaches;
+
+	INIT_LIST_HEAD(&vm->seg_list);
+	for (size_t i = 0; i < VMEM_NB_FREELISTS; ++i) {
+		INIT_LIST_HEAD(&vm->freelists[i]);
+	}
+	for (size_t i = 0; i < VMEM_HASH_SIZE; ++i) {
+		INIT_LIST_HEAD(&vm->hash[i]);
+	}
+	for (size_t i = 0; i < VMEM_QCACHE_MAX; ++i) {
+		vm->qcaches[i].nb_cached = 0;
+	}
+
+	// the whole range is a single free segment
+	if ((seg = (struct vmem_seg*) kmalloc(sizeof(*seg))) == NULL) {
+		error("not enough memory");
+		return false;
+	}
+	seg->start = base;
+	seg->size = size;
+	list_add(&seg->seg_list, &vm->seg_list);
+	freelist_insert(vm, seg);
+
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Allocates a range of @size bytes (rounded up to the arena quantum) from
+ * the @vm arena.
+ *
+ * Returns the starting address of the range, or 0 on error.
+ */
+
+uint32_t vmem_alloc(struct vmem *vm, size_t size)
+{
+	struct vmem_qcache *qc = NULL;
+	struct vmem_seg *seg = NULL;
+	uint32_t addr = 0;
+
+	if ((vm == NULL) || (size == 0) || (size > vm->size)) {
+		error("invalid argument");
+		return 0;
+	}
+
+	// round up to the quantum
+	size = (size + vm->quantum - 1) & ~(vm->quantum - 1);
+
+	if (((qc = get_qcache(vm, size)) != NULL) && (qc->nb_cached > 0)) {
+		seg = qc->segs[--qc->nb_cached];
+		seg->type = SEG_ALLOC;
+		addr = seg->start;
+	} else if ((addr = arena_alloc(vm, size)) == 0) {
+		// the cached ranges might prevent coalescing, retry without them
+		if ((qcache_purge(vm) == false) ||
+			((addr = arena_alloc(vm, size)) == 0))
+		{
+			error("<%s> cannot allocate %u bytes", vm->name, size);
+			return 0;
+		}
+	}
+
+	vm->in_use += size;
+	dbg("<%s> allocated [0x%p - 0x%p]", vm->name, addr, addr + size - 1);
+
+	return addr;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Releases the range starting at @addr, previously allocated with
+ * vmem_alloc() from the @vm arena.
+ *
+ * Returns the size of the released range.
+ */
+
+size_t vmem_free(struct vmem *vm, uint32_t addr)
+{
+	struct vmem_seg *seg = NULL;
+	struct vmem_qcache *qc = NULL;
+	size_t size = 0;
+
+	if ((seg = hash_lookup(vm, addr)) == NULL) {
+		panic("<%s> 0x%p has not been allocated", vm->name, addr);
+	}
+	if (seg->type == SEG_CACHED) {
+		panic("<%s> 0x%p has already been freed", vm->name, addr);
+	}
+
+	size = seg->size;
+	seg->area = NULL;
+	vm->in_use -= size;
+	dbg("<%s> freeing [0x%p - 0x%p]", vm->name, addr, addr + size - 1);
+
+	if (((qc = get_qcache(vm, size)) != NULL) &&
+		(qc->nb_cached < VMEM_QCACHE_DEPTH))
+	{
+		// keep it allocated from the arena point of view (still hashed)
+		seg->type = SEG_CACHED;
+		qc->segs[qc->nb_cached++] = seg;
+		return size;
+	}
+
+	arena_free(vm, seg);
+
+	return size;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns the size of the allocated range starting at @addr, or 0 if @addr
+ * does not start an allocated range (including a freed range held by a
+ * quantum cache).
+ */
+
+size_t vmem_size(struct vmem *vm, uint32_t addr)
+{
+	struct vmem_seg *seg = hash_lookup(vm, addr);
+
+	return ((seg != NULL) && (seg->type == SEG_ALLOC)) ? seg->size : 0;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns true if [@addr, @addr + @size - 1] lies within a single range
+ * allocated from the @vm arena, false otherwise.
+ */
+
+bool vmem_contains(struct vmem *vm, uint32_t addr, size_t size)
+{
+	return (size != 0) && (find_alloc_seg(vm, addr, size) != NULL);
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Creates the kernel arena [VMEM_START - VMEM_END].
+ *
+ * Paging (and kmalloc) must be ready. This must never failed.
+ */
+
+void vmem_setup(void)
+{
+	info("kernel virtual address space setup...");
+
+	if (vmem_init(&kernel_vmem, "kernel", VMEM_START, VMEM_END - VMEM_START,
+				  PAGE_SIZE, VMEM_QCACHE_MAX) == false)
+	{
+		panic("failed to create kernel arena");
+	}
+
+	success("kernel virtual address space setup succeed");
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Allocates @size bytes of virtually contiguous memory. Unlike big kmalloc()
+ * allocations, the page frames do not need to be physically contiguous.
+ *
+ * Returns the allocated memory area, or NULL on error.
+ */
+
+void* vmalloc(size_t size)
+{
+	struct vm_area *area = NULL;
+	size_t nb_pages = 0;
+	uint32_t addr = 0;
+	size_t mapped = 0;
+
+	if ((size == 0) || (size > (VMEM_END - VMEM_START))) {
+		error("invalid argument");
+		return NULL;
+	}
+
+	nb_pages = page_align(size) / PAGE_SIZE;
+
+	area = (struct vm_area*)
+		kmalloc(sizeof(*area) + nb_pages * sizeof(area->frames[0]));
+	if (area == NULL) {
+		error("not enough memory for metadata");
+		return NULL;
+	}
+
+	if ((addr = vmem_alloc(&kernel_vmem, nb_pages * PAGE_SIZE)) == 0) {
+		kfree(area);
+		return NULL;
+	}
+
+	area->addr = addr;
+	area->nb_pages = nb_pages;
+
+	for (mapped = 0; mapped < nb_pages; ++mapped) {
+		uint32_t virt_addr = addr + mapped * PAGE_SIZE;
+
+		if ((area->frames[mapped] = pfa_alloc_highmem(1)) == BAD_PAGE) {
+			error("not enough memory");
+			goto rollback;
+		}
+
+		if (map_page(area->frames[mapped], virt_addr, PTE_RW_KERNEL) == false) {
+			error("failed to map 0x%p", virt_addr);
+			pfa_free(area->frames[mapped]);
+			goto rollback;
+		}
+	}
+
+	// vfree() finds it through the segment hash
+	hash_lookup(&kernel_vmem, addr)->area = area;
+
+	return (void*)addr;
+
+rollback:
+	while (mapped-- > 0) {
+		unmap_page(addr + mapped * PAGE_SIZE);
+		pfa_free(area->frames[mapped]);
+	}
+	vmem_free(&kernel_vmem, addr);
+	kfree(area);
+
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Frees the memory area pointed by @ptr (allocated with vmalloc()).
+ */
+
+void vfree(void *ptr)
+{
+	struct vmem_seg *seg = hash_lookup(&kernel_vmem, (uint32_t)ptr);
+	struct vm_area *area = NULL;
+
+	if ((seg == NULL) || (seg->type != SEG_ALLOC) || (seg->area == NULL)) {
+		panic("ptr (0x%p) has not been vmalloc()'ed", ptr);
+	}
+	area = seg->area;
+
+	for (size_t i = 0; i < area->nb_pages; ++i) {
+		uint32_t virt_addr = area->addr + i * PAGE_SIZE;
+		// not area->frames[i] if a copy-on-write fault replaced it
+		pgframe_t pgf = *lookup_pte(virt_addr) & PTE_MASK_ADDR;
+
+		if (unmap_page(virt_addr) == false) {
+			// this must not failed
+			panic("failed to unmap 0x%p", virt_addr);
+		}
+
+		// the page frame might be shared with a snapshot
+		if (cow_put(pgf) == false) {
+			pfa_free(pgf);
+		}
+	}
+
+	vmem_free(&kernel_vmem, area->addr);
+	kfree(area);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns true if [@ptr, @ptr + @size - 1] lies within a single vmalloc()'ed
+ * area, false otherwise.
+ */
+
+bool vmalloc_contains(const void *ptr, size_t size)
+{
+	struct vmem_seg *seg = NULL;
+
+	if (size == 0) {
+		return false;
+	}
+	seg = find_alloc_seg(&kernel_vmem, (uint32_t)ptr, size);
+
+	return (seg != NULL) && (seg->area != NULL);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Maps @size bytes of memory mapped I/O located at @phys_addr (uncached).
+ *
+ * Returns the virtual address corresponding to @phys_addr, or NULL on error.
+ */
+
+void* ioremap(phys_addr_t phys_addr, size_t size)
+{
+	const uint32_t offset = PAGE_OFFSET(phys_addr);
+	size_t nb_pages = 0;
+	uint32_t addr = 0;
+	size_t mapped = 0;
+
+	if ((size == 0) || (size > (VMEM_END - VMEM_START))) {
+		error("invalid argument");
+		return NULL;
+	}
+
+	nb_pages = page_align(offset + size) / PAGE_SIZE;
+
+	if ((addr = vmem_alloc(&kernel_vmem, nb_pages * PAGE_SIZE)) == 0) {
+		return NULL;
+	}
+
+	for (mapped = 0; mapped < nb_pages; ++mapped) {
+		phys_addr_t page = (phys_addr & PAGE_MASK) + mapped * PAGE_SIZE;
+
+		if (map_page(page, addr + mapped * PAGE_SIZE,
+					 PTE_RW_KERNEL_NOCACHE) == false)
+		{
+			error("failed to map " PHYS_FMT, PHYS_ARG(page));
+			goto rollback;
+		}
+	}
+
+	return (void*)(addr + offset);
+
+rollback:
+	while (mapped-- > 0) {
+		unmap_page(addr + mapped * PAGE_SIZE);
+	}
+	vmem_free(&kernel_vmem, addr);
+
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Unmaps a memory mapped I/O area previously mapped with ioremap().
+ */
+
+void iounmap(void *ptr)
+{
+	const uint32_t addr = (uint32_t)ptr & PAGE_MASK;
+	size_t size = vmem_size(&kernel_vmem, addr);
+
+	if (size == 0) {
+		panic("ptr (0x%p) has not been ioremap()'ed", ptr);
+	}
+
+	for (uint32_t page = addr; page < (addr + size); page += PAGE_SIZE) {
+		if (unmap_page(page) == false) {
+			// this must not failed
+			panic("failed to unmap 0x%p", page);
+		}
+	}
+
+	vmem_free(&kernel_vmem, addr);
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
@@ -0,0 +1,50 @@
+/*
+ * dispatch.c
+ *
+ * memcpy(), memset() and memcmp() jump through these pointers to the variant
+ * suited to the processor: the generic ones until the kernel enabled SSE
+ * and called __string_use_sse2().
+ */
+
+#include <string.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+// implemented in [arch/i386/string/*.S]
+void* __memcpy_rep(void* __restrict, const void* __restrict, size_t);
+void* __memcpy_sse2(void* __restrict, const void* __restrict, size_t);
+void* __memset_rep(void*, int, size_t);
+void* __memset_sse2(void*, int, size_t);
+int __memcmp_words(const void*, const void*, size_t);
+int __memcmp_sse2(const void*, const void*, size_t);
+
+void* (*__memcpy_impl)(void* __restrict, const void* __restrict, size_t) =
+	__memcpy_rep;
+void* (*__memset_impl)(void*, int, size_t) = __memset_rep;
+int (*__memcmp_impl)(const void*, const void*, size_t) = __memcmp_words;
+
+// from this size, the SSE2 variants bypass the caches (non-temporal stores)
+size_t __string_nt_size = (size_t) -1;
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Selects the SSE2 variants. Those larger than @nt_size (i.e. the last level
+ * cache) use non-temporal stores.
+ */
+
+void __string_use_sse2(size_t nt_size)
+{
+	__string_nt_size = nt_size;
+	__memcpy_impl = __memcpy_sse2;
+	__memset_impl = __memset_sse2;
+	__memcmp_impl = __memcmp_sse2;
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
@@ -3,6 +3,7 @@
 
 #include <sys/cdefs.h>
 #include <stdarg.h>
+#include <stddef.h>
 
 #define EOF (-1)
 
@@ -12,10 +13,15 @@ extern "C" {
 
 int printf(const char* __restrict, ...);
 int vsprintf(char *buf, const char *fmt, va_list args);
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list args);
 int sprintf(char *buf, const char *fmt, ...);
+int snprintf(char *buf, size_t size, const char *fmt, ...);
 int putchar(int);
 int puts(const char*);
 
+/* libc internal: writes a whole buffer to the console (libk) */
+int __stdio_write(const char *buf, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
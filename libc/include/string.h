@@ -20,6 +20,9 @@ char *strncpy(char *dest, const char *src, size_t n);
 int strcmp(const char *s1, const char *s2);
 char *strchr(const char *s, int c);
 
+/* libc internal: selects the SSE2 variants, once SSE is enabled (libk, i386) */
+void __string_use_sse2(size_t nt_size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,13 +9,19 @@
  * ----------------------------------------------------------------------- */
 
 /*
- * Oh, it's a waste of space, but oh-so-yummy for debugging.  This
- * version of printf() does not include 64-bit support.  "Live with
- * it."
+ * Oh, it's a waste of space, but oh-so-yummy for debugging.
+ *
+ * 64-bit integers are printed with the "ll" (or "L") qualifier. They
+ * are converted without any 64-bit division (no libgcc helper): the
+ * decimal digits are computed from 16-bit limbs, see put_dec().
+ *
+ * Everything is formatted by vsnprintf(), which never writes past the
+ * end of the buffer (vsprintf() is the unbounded version).
  *
  */
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -41,19 +47,112 @@ static int skip_atoi(const char **s)
 #define SMALL	32		/* Must be 32 == 0x20 */
 #define SPECIAL	64		/* 0x */
 
-#define __do_div(n, base) ({ \
-int __res; \
-__res = ((unsigned long) n) % (unsigned) base; \
-n = ((unsigned long) n) / (unsigned) base; \
-__res; })
+/* "00" to "99": two decimal digits per division */
+static const char digit_pairs[200] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
 
-static char *number(char *str, long num, int base, int size, int precision,
-		    int type)
+/*
+ * Stores the decimal digits of num in tmp, least significant first,
+ * and returns their number.
+ */
+static int put_dec32(char *tmp, unsigned int num)
+{
+	int i = 0;
+
+	while (num >= 100) {
+		unsigned int q = num / 100;	/* a multiplication */
+		unsigned int r = num - q * 100;
+
+		tmp[i++] = digit_pairs[2 * r + 1];
+		tmp[i++] = digit_pairs[2 * r];
+		num = q;
+	}
+	if (num >= 10) {
+		tmp[i++] = digit_pairs[2 * num + 1];
+		tmp[i++] = digit_pairs[2 * num];
+	} else
+		tmp[i++] = '0' + num;
+	return i;
+}
+
+/*
+ * Stores the 4 lowest decimal digits of num in tmp (least significant
+ * first, zero padded) and returns the upper part (num / 10000).
+ */
+static unsigned int put_dec4(char *tmp, unsigned int num)
+{
+	unsigned int q = num / 10000;
+	unsigned int r = num - q * 10000;
+	unsigned int hi = r / 100;
+
+	r -= hi * 100;
+	tmp[0] = digit_pairs[2 * r + 1];
+	tmp[1] = digit_pairs[2 * r];
+	tmp[2] = digit_pairs[2 * hi + 1];
+	tmp[3] = digit_pairs[2 * hi];
+	return q;
+}
+
+/*
+ * Same as put_dec32() for a 64-bit num, without 64-bit divisions.
+ *
+ * num = d3 * 2^48 + d2 * 2^32 + d1 * 2^16 + d0 (16-bit limbs), where
+ *	2^16 =               6 5536
+ *	2^32 =         42 9496 7296
+ *	2^48 = 281 4749 7671 0656
+ * so every group of 4 decimal digits is the sum of the limbs times the
+ * matching group of those powers, plus the carry of the previous group.
+ * All of them fit in 32 bits.
+ */
+static int put_dec(char *tmp, unsigned long long num)
+{
+	unsigned int d0, d1, d2, d3, q;
+	int i = 12;
+
+	if ((num >> 32) == 0)
+		return put_dec32(tmp, (unsigned int)num);
+
+	d0 = num & 0xffff;
+	d1 = (num >> 16) & 0xffff;
+	d2 = (num >> 32) & 0xffff;
+	d3 = num >> 48;
+
+	q = put_dec4(tmp, 656 * d3 + 7296 * d2 + 5536 * d1 + d0);
+	q = put_dec4(tmp + 4, q + 7671 * d3 + 9496 * d2 + 6 * d1);
+	q = put_dec4(tmp + 8, q + 4749 * d3 + 42 * d2);
+	q += 281 * d3;
+
+	if (q != 0)
+		return i + put_dec32(tmp + i, q);
+
+	/* num has at least 10 digits, drop the zero padding */
+	while (tmp[i - 1] == '0')
+		i--;
+	return i;
+}
+
+/*
+ * Stores @c at @str if it is below @end, the output is counted anyway (the
+ * return value of vsnprintf() is the length of the whole output).
+ */
+#define PUTC(c)				\
+	do {				\
+		if (str < end)		\
+			*str = (c);	\
+		++str;			\
+	} while (0)
+
+static char *number(char *str, char *end, unsigned long long num, int base,
+		    int size, int precision, int type)
 {
 	/* we are called with base 8, 10 or 16, only, thus don't need "G..."  */
 	static const char digits[16] = "0123456789ABCDEF"; /* "GHIJKLMNOPQRSTUVWXYZ"; */
 
-	char tmp[66];
+	char tmp[24];	/* 22 octal digits at most */
 	char c, sign, locase;
 	int i;
 
@@ -62,14 +161,14 @@ static char *number(char *str, long num, int base, int size, int precision,
 	locase = (type & SMALL);
 	if (type & LEFT)
 		type &= ~ZEROPAD;
-	if (base < 2 || base > 16)
-		return NULL;
+	if (base != 8 && base != 10 && base != 16)
+		return str;
 	c = (type & ZEROPAD) ? '0' : ' ';
 	sign = 0;
 	if (type & SIGN) {
-		if (num < 0) {
+		if ((signed long long)num < 0) {
 			sign = '-';
-			num = -num;
+			num = -(signed long long)num;
 			size--;
 		} else if (type & PLUS) {
 			sign = '+';
@@ -85,46 +184,58 @@ static char *number(char *str, long num, int base, int size, int precision,
 		else if (base == 8)
 			size--;
 	}
-	i = 0;
-	if (num == 0)
-		tmp[i++] = '0';
-	else
-		while (num != 0)
-			tmp[i++] = (digits[__do_div(num, base)] | locase);
+	if (base == 10)
+		i = put_dec(tmp, num);
+	else {
+		/* a digit is 3 or 4 bits */
+		int shift = (base == 16) ? 4 : 3;
+
+		i = 0;
+		do {
+			tmp[i++] = (digits[num & (base - 1)] | locase);
+			num >>= shift;
+		} while (num != 0);
+	}
 	if (i > precision)
 		precision = i;
 	size -= precision;
 	if (!(type & (ZEROPAD + LEFT)))
 		while (size-- > 0)
-			*str++ = ' ';
+			PUTC(' ');
 	if (sign)
-		*str++ = sign;
+		PUTC(sign);
 	if (type & SPECIAL) {
 		if (base == 8)
-			*str++ = '0';
+			PUTC('0');
 		else if (base == 16) {
-			*str++ = '0';
-			*str++ = ('X' | locase);
+			PUTC('0');
+			PUTC('X' | locase);
 		}
 	}
 	if (!(type & LEFT))
 		while (size-- > 0)
-			*str++ = c;
+			PUTC(c);
 	while (i < precision--)
-		*str++ = '0';
+		PUTC('0');
 	while (i-- > 0)
-		*str++ = tmp[i];
+		PUTC(tmp[i]);
 	while (size-- > 0)
-		*str++ = ' ';
+		PUTC(' ');
 	return str;
 }
 
-int vsprintf(char *buf, const char *fmt, va_list args)
+/*
+ * Formats at most @size bytes (the null terminator included) in @buf.
+ *
+ * Returns the length of the whole output, as if @size was large enough: the
+ * output has been truncated if this is @size or more.
+ */
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list args)
 {
 	int len;
-	unsigned long num;
+	unsigned long long num;
 	int i, base;
-	char *str;
+	char *str, *end;
 	const char *s;
 
 	int flags;		/* flags to number() */
@@ -132,11 +243,16 @@ int vsprintf(char *buf, const char *fmt, va_list args)
 	int field_width;	/* width of output field */
 	int precision;		/* min. # of digits for integers; max
 				   number of chars for from string */
-	int qualifier;		/* 'h', 'l', or 'L' for integer fields */
+	int qualifier;		/* 'h', 'l', or 'L' ("ll") for integer fields */
+
+	/* make sure end is always >= buf */
+	if ((uintptr_t)buf + size < (uintptr_t)buf)
+		size = UINTPTR_MAX - (uintptr_t)buf;
+	end = buf + size;
 
 	for (str = buf; *fmt; ++fmt) {
 		if (*fmt != '%') {
-			*str++ = *fmt;
+			PUTC(*fmt);
 			continue;
 		}
 
@@ -196,6 +312,10 @@ int vsprintf(char *buf, const char *fmt, va_list args)
 		if (*fmt == 'h' || *fmt == 'l' || *fmt == 'L') {
 			qualifier = *fmt;
 			++fmt;
+			if (qualifier == 'l' && *fmt == 'l') {
+				qualifier = 'L';
+				++fmt;
+			}
 		}
 
 		/* default base */
@@ -205,10 +325,10 @@ int vsprintf(char *buf, const char *fmt, va_list args)
 		case 'c':
 			if (!(flags & LEFT))
 				while (--field_width > 0)
-					*str++ = ' ';
-			*str++ = (unsigned char)va_arg(args, int);
+					PUTC(' ');
+			PUTC((unsigned char)va_arg(args, int));
 			while (--field_width > 0)
-				*str++ = ' ';
+				PUTC(' ');
 			continue;
 
 		case 's':
@@ -217,11 +337,11 @@ int vsprintf(char *buf, const char *fmt, va_list args)
 
 			if (!(flags & LEFT))
 				while (len < field_width--)
-					*str++ = ' ';
+					PUTC(' ');
 			for (i = 0; i < len; ++i)
-				*str++ = *s++;
+				PUTC(*s++);
 			while (len < field_width--)
-				*str++ = ' ';
+				PUTC(' ');
 			continue;
 
 		case 'p':
@@ -229,13 +349,16 @@ int vsprintf(char *buf, const char *fmt, va_list args)
 				field_width = 2 * sizeof(void *);
 				flags |= ZEROPAD;
 			}
-			str = number(str,
+			str = number(str, end,
 				     (unsigned long)va_arg(args, void *), 16,
 				     field_width, precision, flags);
 			continue;
 
 		case 'n':
-			if (qualifier == 'l') {
+			if (qualifier == 'L') {
+				long long *ip = va_arg(args, long long *);
+				*ip = (str - buf);
+			} else if (qualifier == 'l') {
 				long *ip = va_arg(args, long *);
 				*ip = (str - buf);
 			} else {
@@ -245,7 +368,7 @@ int vsprintf(char *buf, const char *fmt, va_list args)
 			continue;
 
 		case '%':
-			*str++ = '%';
+			PUTC('%');
 			continue;
 
 			/* integer number formats - set up the flags and "break" */
@@ -267,16 +390,20 @@ int vsprintf(char *buf, const char *fmt, va_list args)
 			break;
 
 		default:
-			*str++ = '%';
+			PUTC('%');
 			if (*fmt)
-				*str++ = *fmt;
+				PUTC(*fmt);
 			else
 				--fmt;
 			continue;
 		}
-		if (qualifier == 'l')
+		if (qualifier == 'L')
+			num = va_arg(args, unsigned long long);
+		else if (qualifier == 'l') {
 			num = va_arg(args, unsigned long);
-		else if (qualifier == 'h') {
+			if (flags & SIGN)
+				num = (long)num;
+		} else if (qualifier == 'h') {
 			num = (unsigned short)va_arg(args, int);
 			if (flags & SIGN)
 				num = (short)num;
@@ -284,12 +411,34 @@ int vsprintf(char *buf, const char *fmt, va_list args)
 			num = va_arg(args, int);
 		else
 			num = va_arg(args, unsigned int);
-		str = number(str, num, base, field_width, precision, flags);
+		str = number(str, end, num, base, field_width, precision, flags);
+	}
+	/* the terminator is always written, even if the output is truncated */
+	if (size > 0) {
+		if (str < end)
+			*str = '\0';
+		else
+			end[-1] = '\0';
 	}
-	*str = '\0';
 	return str - buf;
 }
 
+int vsprintf(char *buf, const char *fmt, va_list args)
+{
+	return vsnprintf(buf, __INT_MAX__, fmt, args);
+}
+
+int snprintf(char *buf, size_t size, const char *fmt, ...)
+{
+	va_list args;
+	int i;
+
+	va_start(args, fmt);
+	i = vsnprintf(buf, size, fmt, args);
+	va_end(args);
+	return i;
+}
+
 int sprintf(char *buf, const char *fmt, ...)
 {
 	va_list args;
@@ -308,11 +457,15 @@ int printf(const char *fmt, ...)
 	int printed;
 
 	va_start(args, fmt);
-	printed = vsprintf(printf_buf, fmt, args);
+	printed = vsnprintf(printf_buf, sizeof(printf_buf), fmt, args);
 	va_end(args);
 
-	for (int i = 0; i < printed; ++i)
-		putchar(printf_buf[i]);
+	/* longer messages are truncated */
+	if (printed >= (int)sizeof(printf_buf))
+		printed = sizeof(printf_buf) - 1;
+
+	/* the whole buffer at once, not one putchar() per byte */
+	__stdio_write(printf_buf, printed);
 
 	return printed;
 }
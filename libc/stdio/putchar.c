@@ -1,17 +1,8 @@
 #include <stdio.h>
 
-#if defined(__is_libk)
-#include <drivers/terminal.h>
-#include <drivers/serial.h>
-#endif
-
 int putchar(int ic) {
-#if defined(__is_libk)
 	char c = (char) ic;
-	terminal_write(&c, sizeof(c));
-	serial_write(&c, sizeof(c));
-#else
-	// TODO: Implement stdio and the write system call.
-#endif
+
+	__stdio_write(&c, sizeof(c));
 	return ic;
 }
@@ -1,5 +1,23 @@
 #include <stdio.h>
+#include <string.h>
 
 int puts(const char* string) {
-	return printf("%s\n", string);
+	const size_t len = strlen(string);
+	const char *tail = string;
+	char buf[256];
+	size_t left = len;
+
+	// no formatting (nor printf() buffer limit): the string is written as is,
+	// and the newline is appended to its last chunk so that a string shorter
+	// than the buffer is a single write
+	while (left >= sizeof(buf)) {
+		__stdio_write(tail, sizeof(buf));
+		tail += sizeof(buf);
+		left -= sizeof(buf);
+	}
+	memcpy(buf, tail, left);
+	buf[left] = '\n';
+	__stdio_write(buf, left + 1);
+
+	return (int) len + 1;
 }
@@ -1,13 +1,48 @@
+/*
+ * memcmp.c
+ *
+ * LIBC implementation of memcmp(), a word at a time when both buffers are
+ * equally aligned (see "swar.h").
+ */
+
 #include <string.h>
 
-int memcmp(const void* aptr, const void* bptr, size_t size) {
+#include "swar.h"
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+int memcmp(const void* aptr, const void* bptr, size_t size)
+{
 	const unsigned char* a = (const unsigned char*) aptr;
 	const unsigned char* b = (const unsigned char*) bptr;
-	for (size_t i = 0; i < size; i++) {
-		if (a[i] < b[i])
-			return -1;
-		else if (b[i] < a[i])
-			return 1;
+
+	if ((((uintptr_t) a ^ (uintptr_t) b) & WORD_MASK) == 0) {
+		// up to a word boundary, then skip the equal words
+		for (; (size > 0) && !word_aligned(a); ++a, ++b, --size) {
+			if (*a != *b) {
+				return (*a < *b) ? -1 : 1;
+			}
+		}
+		for (; size >= WORD_SIZE; a += WORD_SIZE, b += WORD_SIZE,
+			 size -= WORD_SIZE)
+		{
+			if (*(const word_t*) a != *(const word_t*) b) {
+				break;
+			}
+		}
 	}
+
+	for (; size > 0; ++a, ++b, --size) {
+		if (*a != *b) {
+			return (*a < *b) ? -1 : 1;
+		}
+	}
+
 	return 0;
 }
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
@@ -1,25 +1,52 @@
 /*
  * strchr.c
+ *
+ * LIBC implementation of strchr(), a word at a time (see "swar.h").
  */
 
-#include <stddef.h>
+#include <string.h>
+
+#include "swar.h"
 
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
 
+/*
+ * Returns the first occurrence of @c in @s, or NULL. The terminating null
+ * byte is part of the string (i.e. strchr(s, '\0') returns its end).
+ */
+
 char *strchr(const char *s, int c)
 {
-	char *p = (char*) s;
+	const char ch = (char) c;
+	const word_t pattern = word_repeat((unsigned char) c);
+	const word_t *word = NULL;
 
-	while (*p) {
-		if (*p == (char)c) {
-			return p;
+	// up to a word boundary
+	for (; !word_aligned(s); ++s) {
+		if (*s == ch) {
+			return (char*) s;
+		} else if (*s == '\0') {
+			return NULL;
 		}
-		p++;
 	}
 
-	return NULL;
+	// stops on the word holding @c or the terminating byte
+	for (word = (const word_t*) s;
+		 !word_has_zero(*word) && !word_has_zero(*word ^ pattern);
+		 ++word)
+	{
+		continue;
+	}
+
+	for (s = (const char*) word; ; ++s) {
+		if (*s == ch) {
+			return (char*) s;
+		} else if (*s == '\0') {
+			return NULL;
+		}
+	}
 }
 
 // ============================================================================
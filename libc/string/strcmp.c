@@ -1,13 +1,40 @@
 /*
  * strcmp.c
  *
- * LIBC implementation of strcmp().
+ * LIBC implementation of strcmp(), a word at a time (see "swar.h").
  */
 
+#include <string.h>
+
+#include "swar.h"
+
 // ============================================================================
 // ----------------------------------------------------------------------------
 // ============================================================================
 
+/*
+ * Compares the bytes as unsigned chars, from the first one of @s1 and @s2
+ * that differs, or the end of @s1.
+ */
+
+static int strcmp_bytes(const unsigned char *s1, const unsigned char *s2)
+{
+	while ((*s1 != '\0') && (*s1 == *s2)) {
+		s1++;
+		s2++;
+	}
+
+	if (*s1 < *s2) {
+		return -1;
+	} else if (*s1 > *s2) {
+		return 1;
+	} else {
+		return 0;
+	}
+}
+
+// ----------------------------------------------------------------------------
+
 /*
 	NAME
 		strcmp - compare two strings
@@ -26,22 +53,64 @@ RETURN VALUE
 		The strcmp() functions return an integer less than, equal to, or greater
 		than zero if s1 is found, respectively, to be  less  than,  to  match, or
 		be greater than s2.
+
+	NOTES
+		Bytes are compared as unsigned chars. @s1 is word aligned first: if
+		@s2 is not aligned as well, its words are built from the two aligned
+		words they span. The second one is only read once the first has no
+		terminating byte, so it belongs to the string.
 */
 
 int strcmp(const char *s1, const char *s2)
 {
-	while (*s1 && *s1 == *s2) {
-		s1++;
-		s2++;
+	const unsigned char *p1 = (const unsigned char*) s1;
+	const unsigned char *p2 = (const unsigned char*) s2;
+	const word_t *w1 = NULL;
+	const word_t *w2 = NULL;
+	uint32_t shift = 0;
+	word_t lo = 0;
+	word_t hi = 0;
+
+	// up to a word boundary of @s1
+	for (; !word_aligned(p1); ++p1, ++p2) {
+		if ((*p1 == '\0') || (*p1 != *p2)) {
+			return strcmp_bytes(p1, p2);
+		}
 	}
 
-	if (*s1 < *s2) {
-		return -1;
-	} else if (*s1 > *s2) {
-		return 1;
-	} else {
-		return 0;
+	w1 = (const word_t*) p1;
+
+	if (word_aligned(p2)) {
+		for (w2 = (const word_t*) p2;
+			 (*w1 == *w2) && !word_has_zero(*w1);
+			 ++w1, ++w2)
+		{
+			continue;
+		}
+		return strcmp_bytes((const unsigned char*) w1,
+							(const unsigned char*) w2);
 	}
+
+	// the bytes of @s2 are the upper part of 'lo', the lower part of 'hi'
+	shift = ((uintptr_t) p2 & WORD_MASK) * 8;
+	w2 = (const word_t*)((uintptr_t) p2 & ~WORD_MASK);
+	lo = *w2;
+
+	// the bytes below @p2 (lower part of 'lo') are not tested
+	while (!word_has_zero(lo | (((word_t) 1 << shift) - 1))) {
+		hi = *(w2 + 1);
+		if ((*w1 != ((lo >> shift) | (hi << (32 - shift)))) ||
+			word_has_zero(*w1))
+		{
+			break;
+		}
+		w1++;
+		w2++;
+		p2 += WORD_SIZE;
+		lo = hi;
+	}
+
+	return strcmp_bytes((const unsigned char*) w1, p2);
 }
 
 // ============================================================================
@@ -1,8 +1,41 @@
+/*
+ * strlen.c
+ *
+ * LIBC implementation of strlen(), a word at a time (see "swar.h").
+ */
+
 #include <string.h>
 
-size_t strlen(const char* str) {
-	size_t len = 0;
-	while (str[len])
-		len++;
-	return len;
+#include "swar.h"
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+size_t strlen(const char* str)
+{
+	const char *ptr = str;
+	const word_t *word = NULL;
+
+	// up to a word boundary
+	for (; !word_aligned(ptr); ++ptr) {
+		if (*ptr == '\0') {
+			return ptr - str;
+		}
+	}
+
+	for (word = (const word_t*) ptr; !word_has_zero(*word); ++word) {
+		continue;
+	}
+
+	// the terminating byte is in this word
+	for (ptr = (const char*) word; *ptr != '\0'; ++ptr) {
+		continue;
+	}
+
+	return ptr - str;
 }
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
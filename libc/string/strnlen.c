@@ -7,7 +7,8 @@
 size_t strnlen(const char *s, size_t maxlen)
 {
 	size_t len = 0;
-	while (*s++ && len < maxlen)
+	// never reads s[maxlen] (the buffer might end right before)
+	while (len < maxlen && s[len])
 		len++;
 	return len;
 }
@@ -0,0 +1,67 @@
+/*
+ * swar.h
+ *
+ * Word-at-a-time helpers for the string functions (SIMD Within A Register):
+ * 4 bytes are tested at once, with the classic "has a zero byte" trick.
+ *
+ * Words are only read from aligned addresses: an aligned word never crosses
+ * a page boundary, so the bytes read past the end of a string (up to the end
+ * of its last word) are always mapped.
+ *
+ * NOTE: The byte order within a word is assumed to be little endian.
+ */
+
+#ifndef _LIBC_STRING_SWAR_H
+#define _LIBC_STRING_SWAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+// may alias the bytes it is read from
+typedef uint32_t __attribute__((may_alias)) word_t;
+
+#define WORD_SIZE	(sizeof(word_t))
+#define WORD_MASK	(WORD_SIZE - 1)
+
+#define WORD_ONES	((word_t) 0x01010101)
+#define WORD_HIGHS	((word_t) 0x80808080)
+
+// ----------------------------------------------------------------------------
+
+static inline int word_aligned(const void *ptr)
+{
+	return ((uintptr_t) ptr & WORD_MASK) == 0;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns non-zero if @w has a zero byte. Only the flag of the first zero byte
+ * (in memory order) is exact, a borrow can flag the following ones.
+ */
+
+static inline word_t word_has_zero(word_t w)
+{
+	return (w - WORD_ONES) & ~w & WORD_HIGHS;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns a word with @c in every byte.
+ */
+
+static inline word_t word_repeat(unsigned char c)
+{
+	return WORD_ONES * c;
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* !_LIBC_STRING_SWAR_H */
@@ -0,0 +1,100 @@
+/*
+ * ahos.h
+ *
+ * The libc routines built for the host (see Makefile).
+ *
+ * This header is forced into every libc source (AHOS_LIBC_SOURCE defined):
+ * the routines get an "ahos_" prefix so that they don't clash with the host
+ * libc, which is the reference. The tests and benchmarks include it to get
+ * the prototypes of the prefixed routines.
+ *
+ * The i386 assembly routines (arch/i386/string) are preprocessed with it too,
+ * their variants and dispatch pointers get the same prefix.
+ */
+
+#ifndef LIBC_TEST_AHOS_H_
+#define LIBC_TEST_AHOS_H_
+
+#if defined(AHOS_LIBC_SOURCE)
+
+#define memcmp ahos_memcmp
+#define memcpy ahos_memcpy
+#define memmove ahos_memmove
+#define memset ahos_memset
+#define strlen ahos_strlen
+#define strnlen ahos_strnlen
+#define strcpy ahos_strcpy
+#define strncpy ahos_strncpy
+#define strcmp ahos_strcmp
+#define strchr ahos_strchr
+
+#define vsnprintf ahos_vsnprintf
+#define vsprintf ahos_vsprintf
+#define snprintf ahos_snprintf
+#define sprintf ahos_sprintf
+#define printf ahos_printf
+#define __stdio_write ahos___stdio_write
+
+#define __memcpy_impl ahos___memcpy_impl
+#define __memset_impl ahos___memset_impl
+#define __memcmp_impl ahos___memcmp_impl
+#define __memcpy_rep ahos___memcpy_rep
+#define __memcpy_sse2 ahos___memcpy_sse2
+#define __memset_rep ahos___memset_rep
+#define __memset_sse2 ahos___memset_sse2
+#define __memcmp_words ahos___memcmp_words
+#define __memcmp_sse2 ahos___memcmp_sse2
+#define __string_nt_size ahos___string_nt_size
+#define __string_use_sse2 ahos___string_use_sse2
+
+#else
+
+#include <stdarg.h>
+#include <stddef.h>
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+int ahos_memcmp(const void *s1, const void *s2, size_t n);
+void *ahos_memcpy(void *dest, const void *src, size_t n);
+void *ahos_memmove(void *dest, const void *src, size_t n);
+void *ahos_memset(void *s, int c, size_t n);
+size_t ahos_strlen(const char *s);
+size_t ahos_strnlen(const char *s, size_t maxlen);
+char *ahos_strcpy(char *dest, const char *src);
+char *ahos_strncpy(char *dest, const char *src, size_t n);
+int ahos_strcmp(const char *s1, const char *s2);
+char *ahos_strchr(const char *s, int c);
+
+int ahos_vsnprintf(char *buf, size_t size, const char *fmt, va_list args);
+int ahos_snprintf(char *buf, size_t size, const char *fmt, ...);
+int ahos_sprintf(char *buf, const char *fmt, ...);
+
+// printf() output, defined by the test/benchmark program
+int ahos___stdio_write(const char *buf, size_t len);
+
+#if defined(LIBCTEST_I386)
+
+// ----------------------------------------------------------------------------
+
+// arch/i386/string variants (see dispatch.c)
+extern void *(*ahos___memcpy_impl)(void*, const void*, size_t);
+extern void *(*ahos___memset_impl)(void*, int, size_t);
+extern int (*ahos___memcmp_impl)(const void*, const void*, size_t);
+extern size_t ahos___string_nt_size;
+
+void *ahos___memcpy_rep(void *dest, const void *src, size_t n);
+void *ahos___memset_rep(void *s, int c, size_t n);
+int ahos___memcmp_words(const void *s1, const void *s2, size_t n);
+void ahos___string_use_sse2(size_t nt_size);
+
+#endif /* LIBCTEST_I386 */
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#endif /* !AHOS_LIBC_SOURCE */
+
+#endif /* !LIBC_TEST_AHOS_H_ */
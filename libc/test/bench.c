@@ -0,0 +1,315 @@
+//
+// THIS IS INTENTED TO RUN ON "HOST/DEV" SYSTEM!
+//
+// Benchmarks the libc routines (built for the host, see ahos.h) against the
+// host libc, in bytes per cycle: bytes processed (copied, set, compared,
+// scanned) for the string functions, bytes output for printf().
+//
+// Every measure is the best of several runs, each one calling the routine
+// enough times to process about BENCH_BYTES bytes. Buffers are 64-byte
+// aligned and stay in the cache between calls. Cycles are TSC cycles (they
+// only match the core cycles if the frequency is fixed), or nanoseconds on
+// other architectures.
+//
+// usage: libcbench
+//
+
+#include "ahos.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#define BENCH_MAX_SIZE	65536
+#define BENCH_BYTES		(256 * 1024) // per run
+#define BENCH_RUNS		15
+
+#if defined(__i386__) || defined(__x86_64__)
+#define UNIT "cycle"
+#else
+#define UNIT "ns"
+#endif
+
+static uint8_t src[BENCH_MAX_SIZE + 1] __attribute__((aligned(64)));
+static uint8_t dst[2 * BENCH_MAX_SIZE + 1] __attribute__((aligned(64)));
+
+// the host routines are called through pointers, so that they are never
+// inlined nor removed by the compiler
+static int (*volatile host_memcmp)(const void*, const void*, size_t) = memcmp;
+static void *(*volatile host_memcpy)(void*, const void*, size_t) = memcpy;
+static void *(*volatile host_memmove)(void*, const void*, size_t) = memmove;
+static void *(*volatile host_memset)(void*, int, size_t) = memset;
+static size_t (*volatile host_strlen)(const char*) = strlen;
+static size_t (*volatile host_strnlen)(const char*, size_t) = strnlen;
+static char *(*volatile host_strcpy)(char*, const char*) = strcpy;
+static char *(*volatile host_strncpy)(char*, const char*, size_t) = strncpy;
+static int (*volatile host_strcmp)(const char*, const char*) = strcmp;
+static char *(*volatile host_strchr)(const char*, int) = strchr;
+static int (*volatile host_snprintf)(char*, size_t, const char*, ...) =
+	snprintf;
+
+static volatile uintptr_t sink; // results are kept
+
+// ----------------------------------------------------------------------------
+
+int ahos___stdio_write(const char *buf, size_t len)
+{
+	(void) buf;
+	return (int) len;
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+static inline uint64_t cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Calls a routine (the host one if @host) on @size bytes.
+ */
+
+typedef void (*run_fn)(int host, size_t size);
+
+static void run_memcpy(int host, size_t size)
+{
+	sink = (uintptr_t)(host ? host_memcpy(dst, src, size) :
+		ahos_memcpy(dst, src, size));
+}
+
+// overlapping, the destination above (backward copy)
+static void run_memmove(int host, size_t size)
+{
+	sink = (uintptr_t)(host ? host_memmove(dst + size / 2, dst, size) :
+		ahos_memmove(dst + size / 2, dst, size));
+}
+
+static void run_memset(int host, size_t size)
+{
+	sink = (uintptr_t)(host ? host_memset(dst, 0x5a, size) :
+		ahos_memset(dst, 0x5a, size));
+}
+
+// equal buffers, every byte is compared
+static void run_memcmp(int host, size_t size)
+{
+	sink = (uintptr_t)(host ? host_memcmp(dst, src, size) :
+		ahos_memcmp(dst, src, size));
+}
+
+static void run_strlen(int host, size_t size)
+{
+	(void) size;
+	sink = host ? host_strlen((char*) src) : ahos_strlen((char*) src);
+}
+
+static void run_strnlen(int host, size_t size)
+{
+	sink = host ? host_strnlen((char*) src, size + 1) :
+		ahos_strnlen((char*) src, size + 1);
+}
+
+// not found, the whole string is scanned
+static void run_strchr(int host, size_t size)
+{
+	(void) size;
+	sink = (uintptr_t)(host ? host_strchr((char*) src, 'z') :
+		ahos_strchr((char*) src, 'z'));
+}
+
+// equal strings
+static void run_strcmp(int host, size_t size)
+{
+	(void) size;
+	sink = host ? host_strcmp((char*) dst, (char*) src) :
+		ahos_strcmp((char*) dst, (char*) src);
+}
+
+static void run_strcpy(int host, size_t size)
+{
+	(void) size;
+	sink = (uintptr_t)(host ? host_strcpy((char*) dst, (char*) src) :
+		ahos_strcpy((char*) dst, (char*) src));
+}
+
+static void run_strncpy(int host, size_t size)
+{
+	sink = (uintptr_t)(host ? host_strncpy((char*) dst, (char*) src, size) :
+		ahos_strncpy((char*) dst, (char*) src, size));
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Prepares the buffers for a @size bytes run: @src is a string of @size
+ * bytes, @dst a copy of it (for the comparisons).
+ */
+
+static void setup(size_t size)
+{
+	memset(src, 'a', size);
+	src[size] = '\0';
+	memcpy(dst, src, size + 1);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns the number of cycles of the best run, @reps calls each.
+ */
+
+static uint64_t measure(run_fn run, int host, size_t size, unsigned reps)
+{
+	uint64_t best = UINT64_MAX;
+
+	for (unsigned i = 0; i < BENCH_RUNS; ++i) {
+		const uint64_t start = cycles();
+		uint64_t elapsed;
+
+		for (unsigned n = 0; n < reps; ++n) {
+			run(host, size);
+		}
+		elapsed = cycles() - start;
+		if (elapsed < best) {
+			best = elapsed;
+		}
+	}
+
+	return best ? best : 1;
+}
+
+// ----------------------------------------------------------------------------
+
+static void bench_string(const char *name, run_fn run)
+{
+	static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 16384, 65536 };
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		const size_t size = sizes[i];
+		const unsigned reps = (size < BENCH_BYTES) ? BENCH_BYTES / size : 1;
+		uint64_t ahos, host;
+		double ahos_bpc, host_bpc;
+
+		setup(size);
+		ahos = measure(run, 0, size, reps);
+		setup(size);
+		host = measure(run, 1, size, reps);
+
+		ahos_bpc = (double) size * reps / ahos;
+		host_bpc = (double) size * reps / host;
+		printf("%-8s %6zu %10.2f %10.2f %7.2f\n", name, size, ahos_bpc,
+			host_bpc, ahos_bpc / host_bpc);
+	}
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+static const struct
+{
+	const char *fmt;
+	enum { ARG_UINT, ARG_ULLONG, ARG_STR, ARG_LOG } type;
+} formats[] = {
+	{ "%u", ARG_UINT },
+	{ "%08x", ARG_UINT },
+	{ "%llu", ARG_ULLONG },
+	{ "%-24s", ARG_STR },
+	{ "[%s] WARN: %s %d (0x%08x)\n", ARG_LOG }, // a log line
+};
+
+static size_t cur_format;
+
+// ----------------------------------------------------------------------------
+
+static void run_printf(int host, size_t size)
+{
+	int (*fn)(char*, size_t, const char*, ...) =
+		host ? host_snprintf : ahos_snprintf;
+	const char *fmt = formats[cur_format].fmt;
+	char buf[128];
+
+	switch (formats[cur_format].type) {
+	case ARG_UINT:
+		sink = fn(buf, sizeof(buf), fmt, 3141592653u + (unsigned) size);
+		break;
+	case ARG_ULLONG:
+		sink = fn(buf, sizeof(buf), fmt, 18446744073709551557ULL - size);
+		break;
+	case ARG_STR:
+		sink = fn(buf, sizeof(buf), fmt, "kmalloc");
+		break;
+	case ARG_LOG:
+		sink = fn(buf, sizeof(buf), fmt, "pfa", "frame leaked", -12,
+			0xc0100000u);
+		break;
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static void bench_printf(void)
+{
+	for (cur_format = 0; cur_format < sizeof(formats) / sizeof(formats[0]);
+		 ++cur_format)
+	{
+		const unsigned reps = 20000;
+		char fmt[40];
+		uint64_t ahos, host;
+		double ahos_bpc, host_bpc;
+		size_t len;
+
+		// every call outputs the same number of bytes
+		run_printf(1, 0);
+		len = sink;
+
+		ahos = measure(run_printf, 0, 0, reps);
+		host = measure(run_printf, 1, 0, reps);
+
+		ahos_bpc = (double) len * reps / ahos;
+		host_bpc = (double) len * reps / host;
+		snprintf(fmt, sizeof(fmt), "%s", formats[cur_format].fmt);
+		fmt[strcspn(fmt, "\n")] = '\0'; // one line per format
+		printf("printf   %-30s %3zu %10.3f %10.3f %7.2f\n", fmt, len, ahos_bpc,
+			host_bpc, ahos_bpc / host_bpc);
+	}
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+int main(void)
+{
+	printf("%-8s %6s %10s %10s %7s   (bytes/%s)\n", "routine", "size", "ahos",
+		"host", "ratio", UNIT);
+
+	bench_string("memcpy", run_memcpy);
+	bench_string("memmove", run_memmove);
+	bench_string("memset", run_memset);
+	bench_string("memcmp", run_memcmp);
+	bench_string("strlen", run_strlen);
+	bench_string("strnlen", run_strnlen);
+	bench_string("strchr", run_strchr);
+	bench_string("strcmp", run_strcmp);
+	bench_string("strcpy", run_strcpy);
+	bench_string("strncpy", run_strncpy);
+	bench_printf();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,909 @@
+//
+// THIS IS INTENTED TO RUN ON "HOST/DEV" SYSTEM!
+//
+// Differential tests of the libc routines (built for the host, see ahos.h)
+// against the host libc: every routine is called with randomized sizes,
+// alignments and contents, and must give the same result and leave the
+// same bytes around its destination.
+//
+// The inputs end right before a PROT_NONE page whenever possible, so any
+// read past the end of a buffer (e.g. a word-at-a-time read crossing a page)
+// faults.
+//
+// printf() is tested with random single conversions (flags, width,
+// precision, qualifier) and random buffer sizes (truncation). The known
+// differences with the host printf() are not generated (see gen_format()).
+//
+// With -b, the word-at-a-time routines (memcmp, strlen, strchr and strcmp,
+// see string/swar.h) are compared with plain byte loops instead of the host
+// libc ones.
+//
+// The i386 build (libctest32, LIBCTEST_I386 defined) checks the assembly
+// memcpy/memset/memmove/memcmp (arch/i386/string) instead of the C ones: the
+// generic variants first, then the SSE2 ones with a small non-temporal
+// threshold (NT_SIZE) so that both store paths are covered.
+//
+// usage: libctest [-b] [iterations [seed]]
+//
+
+#include "ahos.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define MAX_SIZE	16384 // largest buffer
+#define MAX_ALIGN	16 // alignments tested: 0 to MAX_ALIGN - 1
+#define SLACK		64 // guard bytes around a destination
+#define NT_SIZE		8192 // non-temporal threshold of the SSE2 variants
+
+// page sized and followed by a PROT_NONE page
+struct area
+{
+	uint8_t *base;
+	size_t size;
+};
+
+static struct area area_src;
+static struct area area_src2;
+static struct area area_dst;
+static struct area area_ref;
+
+static uint64_t rng_state;
+static unsigned long nb_failures = 0;
+static unsigned long nb_checks = 0;
+static const char *current = NULL; // routine being checked
+
+// references, the host libc by default (see use_byte_references())
+static int (*ref_memcmp)(const void*, const void*, size_t) = memcmp;
+static size_t (*ref_strlen)(const char*) = strlen;
+static char *(*ref_strchr)(const char*, int) = strchr;
+static int (*ref_strcmp)(const char*, const char*) = strcmp;
+
+// ----------------------------------------------------------------------------
+
+int ahos___stdio_write(const char *buf, size_t len)
+{
+	(void) buf;
+	return (int) len;
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+static uint64_t rnd(void)
+{
+	// xorshift64*
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+
+	return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+// ----------------------------------------------------------------------------
+
+static size_t rnd_below(size_t n)
+{
+	return (n == 0) ? 0 : (size_t)(rnd() % n);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Mostly small sizes (the common case, and where the head/tail handling is),
+ * some around the thresholds of the i386 variants, some up to MAX_SIZE.
+ */
+
+static size_t rnd_size(void)
+{
+	static const size_t edges[] = { 16, 64, 128, 2048, NT_SIZE };
+
+	switch (rnd_below(5)) {
+	case 0:
+	case 1:
+		return rnd_below(65);
+	case 2:
+		return rnd_below(1025);
+	case 3:
+		return edges[rnd_below(sizeof(edges) / sizeof(edges[0]))] - 16 +
+			rnd_below(33);
+	default:
+		return rnd_below(MAX_SIZE + 1);
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static void rnd_fill(uint8_t *buf, size_t len)
+{
+	for (size_t i = 0; i < len; ++i) {
+		buf[i] = (uint8_t) rnd();
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Fills @buf with @len non-null bytes, from a small alphabet if @small (so
+ * that a searched character is likely found), high bytes included.
+ */
+
+static void rnd_string(char *buf, size_t len, int small)
+{
+	static const char alphabet[] = "ab\x7f\x80\xfe";
+
+	for (size_t i = 0; i < len; ++i) {
+		if (small) {
+			buf[i] = alphabet[rnd_below(sizeof(alphabet) - 1)];
+		} else {
+			buf[i] = (char)(1 + rnd_below(255));
+		}
+	}
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Byte at a time references of the word at a time routines.
+ */
+
+static int byte_memcmp(const void *s1, const void *s2, size_t n)
+{
+	const unsigned char *p1 = s1;
+	const unsigned char *p2 = s2;
+
+	for (size_t i = 0; i < n; ++i) {
+		if (p1[i] != p2[i]) {
+			return p1[i] - p2[i];
+		}
+	}
+
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+
+static size_t byte_strlen(const char *s)
+{
+	size_t len = 0;
+
+	while (s[len] != '\0') {
+		len++;
+	}
+
+	return len;
+}
+
+// ----------------------------------------------------------------------------
+
+static char *byte_strchr(const char *s, int c)
+{
+	for (;; ++s) {
+		if (*s == (char) c) {
+			return (char*) s;
+		}
+		if (*s == '\0') {
+			return NULL;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static int byte_strcmp(const char *s1, const char *s2)
+{
+	const unsigned char *p1 = (const unsigned char*) s1;
+	const unsigned char *p2 = (const unsigned char*) s2;
+
+	while ((*p1 != '\0') && (*p1 == *p2)) {
+		p1++;
+		p2++;
+	}
+
+	return *p1 - *p2;
+}
+
+// ----------------------------------------------------------------------------
+
+static void use_byte_references(void)
+{
+	ref_memcmp = byte_memcmp;
+	ref_strlen = byte_strlen;
+	ref_strchr = byte_strchr;
+	ref_strcmp = byte_strcmp;
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+static void area_init(struct area *area, size_t size)
+{
+	const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+	uint8_t *base = NULL;
+
+	size = (size + page - 1) & ~(page - 1);
+	base = mmap(NULL, size + page, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if ((base == MAP_FAILED) || (mprotect(base + size, page, PROT_NONE) != 0)) {
+		perror("libctest: mmap");
+		exit(EXIT_FAILURE);
+	}
+
+	area->base = base;
+	area->size = size;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns where a @len bytes buffer starts in @area: right before the guard
+ * page (with the lowest bits of @align), or at @align from the start.
+ */
+
+static uint8_t *area_place(const struct area *area, size_t len, size_t align)
+{
+	if (rnd_below(2)) {
+		uint8_t *end = area->base + area->size;
+		uintptr_t start = (uintptr_t)(end - len);
+
+		// keeps the alignment, as close to the guard page as possible
+		start = (start & ~(uintptr_t)(MAX_ALIGN - 1)) + align;
+		if (start + len > (uintptr_t) end) {
+			start -= MAX_ALIGN;
+		}
+		return (uint8_t*) start;
+	}
+
+	return area->base + align;
+}
+
+// ----------------------------------------------------------------------------
+
+static void failure(const char *func, const char *fmt, ...)
+{
+	va_list args;
+
+	if (nb_failures++ >= 20) {
+		return; // enough to start with
+	}
+
+	fprintf(stderr, "FAIL %s: ", func);
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * A buffer was accessed past its end (the guard page).
+ */
+
+static void segv_handler(int signum)
+{
+	static const char msg[] = "FAIL: out-of-bounds access in ";
+
+	(void) signum;
+	if (write(STDERR_FILENO, msg, sizeof(msg) - 1) < 0 ||
+		write(STDERR_FILENO, current, strlen(current)) < 0 ||
+		write(STDERR_FILENO, "\n", 1) < 0)
+	{
+		// nothing else to do
+	}
+	_exit(EXIT_FAILURE);
+}
+
+// ----------------------------------------------------------------------------
+
+static int sign(int value)
+{
+	return (value > 0) - (value < 0);
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+/*
+ * Prepares the destination area and the reference one identically (@len
+ * bytes at @align, with SLACK random guard bytes on each side), for the
+ * routine and the host one.
+ */
+
+static uint8_t *dst_buf;
+static uint8_t *ref_buf;
+static size_t dst_len;
+
+static void dst_prepare(size_t len, size_t align, uint8_t **dst, uint8_t **ref)
+{
+	dst_len = len + 2 * SLACK + MAX_ALIGN;
+	rnd_fill(area_dst.base, dst_len);
+	memcpy(area_ref.base, area_dst.base, dst_len);
+
+	*dst = dst_buf = area_dst.base + SLACK + align;
+	*ref = ref_buf = area_ref.base + SLACK + align;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Compares the return values (relative to their buffer) and the areas
+ * prepared by dst_prepare().
+ */
+
+static void dst_check(const char *func, const void *ret_ahos,
+					  const void *ret_ref, const char *fmt, ...)
+{
+	char params[128];
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(params, sizeof(params), fmt, args);
+	va_end(args);
+
+	nb_checks++;
+	if (((const uint8_t*) ret_ahos - dst_buf) !=
+		((const uint8_t*) ret_ref - ref_buf))
+	{
+		failure(func, "bad return value, %s", params);
+	} else if (memcmp(area_dst.base, area_ref.base, dst_len) != 0) {
+		failure(func, "bad output, %s", params);
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static void check_memcpy(void)
+{
+	const size_t len = rnd_size();
+	const size_t salign = rnd_below(MAX_ALIGN);
+	const size_t dalign = rnd_below(MAX_ALIGN);
+	uint8_t *src = area_place(&area_src, len, salign);
+	uint8_t *dst, *ref;
+
+	rnd_fill(src, len);
+	dst_prepare(len, dalign, &dst, &ref);
+	dst_check("memcpy", ahos_memcpy(dst, src, len), memcpy(ref, src, len),
+		"len=%zu salign=%zu dalign=%zu", len, salign, dalign);
+}
+
+// ----------------------------------------------------------------------------
+
+static void check_memmove(void)
+{
+	const size_t len = rnd_size();
+	const size_t span = 2 * len + MAX_ALIGN;
+	const size_t from = rnd_below(span - len);
+	const size_t to = rnd_below(span - len);
+
+	uint8_t *dst, *ref;
+
+	// overlapping moves (either way) within the destination area
+	dst_prepare(span, 0, &dst, &ref);
+	dst_check("memmove", ahos_memmove(dst + to, dst + from, len),
+		memmove(ref + to, ref + from, len), "len=%zu from=%zu to=%zu",
+		len, from, to);
+}
+
+// ----------------------------------------------------------------------------
+
+static void check_memset(void)
+{
+	const size_t len = rnd_size();
+	const size_t dalign = rnd_below(MAX_ALIGN);
+	const int value = (int) rnd(); // only its lowest byte is used
+	uint8_t *dst, *ref;
+
+	dst_prepare(len, dalign, &dst, &ref);
+	dst_check("memset", ahos_memset(dst, value, len), memset(ref, value, len),
+		"len=%zu dalign=%zu value=0x%x", len, dalign, value);
+}
+
+// ----------------------------------------------------------------------------
+
+static void check_memcmp(void)
+{
+	const size_t len = rnd_size();
+	const size_t align1 = rnd_below(MAX_ALIGN);
+	const size_t align2 = rnd_below(MAX_ALIGN);
+	uint8_t *s1 = area_place(&area_src, len, align1);
+	uint8_t *s2 = area_place(&area_src2, len, align2);
+	size_t diff = len;
+	int res, expected;
+
+	rnd_fill(s1, len);
+	memcpy(s2, s1, len);
+	if ((len > 0) && rnd_below(4)) {
+		diff = rnd_below(len);
+		s2[diff] ^= (uint8_t)(1 + rnd_below(255));
+	}
+
+	res = ahos_memcmp(s1, s2, len);
+	expected = ref_memcmp(s1, s2, len);
+	nb_checks++;
+	if (sign(res) != sign(expected)) {
+		failure("memcmp", "got %d, expected %d, len=%zu align1=%zu align2=%zu "
+			"diff=%zu", res, expected, len, align1, align2, diff);
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static void check_strlen(void)
+{
+	const size_t len = rnd_size();
+	const size_t align = rnd_below(MAX_ALIGN);
+	char *s = (char*) area_place(&area_src, len + 1, align);
+	size_t res, expected;
+
+	rnd_string(s, len, 0);
+	s[len] = '\0';
+
+	res = ahos_strlen(s);
+	expected = ref_strlen(s);
+	nb_checks++;
+	if ((res != len) || (res != expected)) {
+		failure("strlen", "got %zu, expected %zu, align=%zu", res, expected,
+			align);
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static void check_strnlen(void)
+{
+	const size_t len = rnd_size();
+	const size_t align = rnd_below(MAX_ALIGN);
+	const size_t maxlen = rnd_below(2) ? rnd_below(len + 2) : rnd_size();
+	// the string is not terminated if maxlen is reached before
+	const size_t size = (maxlen <= len) ? maxlen : len + 1;
+	char *s = (char*) area_place(&area_src, size, align);
+	size_t res;
+
+	rnd_string(s, size, 0);
+	if (size > len) {
+		s[len] = '\0';
+	}
+
+	res = ahos_strnlen(s, maxlen);
+	nb_checks++;
+	if (res != ((len < maxlen) ? len : maxlen)) {
+		failure("strnlen", "got %zu, len=%zu maxlen=%zu align=%zu", res, len,
+			maxlen, align);
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static void check_strchr(void)
+{
+	const size_t len = rnd_size();
+	const size_t align = rnd_below(MAX_ALIGN);
+	char *s = (char*) area_place(&area_src, len + 1, align);
+	static const int chars[] = { 'a', 'b', 0x7f, 0x80, 0xfe, -2, 'c', '\0',
+								 0x100 + 'a' };
+	const int c = chars[rnd_below(sizeof(chars) / sizeof(chars[0]))];
+	char *res, *expected;
+
+	rnd_string(s, len, 1);
+	s[len] = '\0';
+
+	res = ahos_strchr(s, c);
+	expected = ref_strchr(s, c);
+	nb_checks++;
+	if (res != expected) {
+		failure("strchr", "got %td, expected %td, len=%zu align=%zu c=0x%x",
+			res ? res - s : -1, expected ? expected - s : -1, len, align, c);
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static void check_strcmp(void)
+{
+	const size_t len = rnd_size();
+	const size_t align1 = rnd_below(MAX_ALIGN);
+	const size_t align2 = rnd_below(MAX_ALIGN);
+	char *s1 = (char*) area_place(&area_src, len + 1, align1);
+	char *s2 = (char*) area_place(&area_src2, len + 1, align2);
+	size_t diff = len;
+	int res, expected;
+
+	rnd_string(s1, len, rnd_below(2));
+	s1[len] = '\0';
+	memcpy(s2, s1, len + 1);
+	if ((len > 0) && rnd_below(4)) {
+		diff = rnd_below(len);
+		// either a different byte, or a shorter string
+		s2[diff] = rnd_below(4) ? (char)(1 + rnd_below(255)) : '\0';
+	}
+
+	res = ahos_strcmp(s1, s2);
+	expected = ref_strcmp(s1, s2);
+	nb_checks++;
+	if (sign(res) != sign(expected)) {
+		failure("strcmp", "got %d, expected %d, len=%zu align1=%zu align2=%zu "
+			"diff=%zu", res, expected, len, align1, align2, diff);
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static void check_strcpy(void)
+{
+	const size_t len = rnd_size();
+	const size_t salign = rnd_below(MAX_ALIGN);
+	const size_t dalign = rnd_below(MAX_ALIGN);
+	char *src = (char*) area_place(&area_src, len + 1, salign);
+	uint8_t *dst, *ref;
+
+	rnd_string(src, len, 0);
+	src[len] = '\0';
+
+	dst_prepare(len + 1, dalign, &dst, &ref);
+	dst_check("strcpy", ahos_strcpy((char*) dst, src),
+		strcpy((char*) ref, src), "len=%zu salign=%zu dalign=%zu",
+		len, salign, dalign);
+}
+
+// ----------------------------------------------------------------------------
+
+static void check_strncpy(void)
+{
+	const size_t len = rnd_size();
+	const size_t n = rnd_below(2) ? rnd_below(len + 2) : rnd_size();
+	const size_t salign = rnd_below(MAX_ALIGN);
+	const size_t dalign = rnd_below(MAX_ALIGN);
+	const size_t size = (n <= len) ? n : len + 1;
+	char *src = (char*) area_place(&area_src, size, salign);
+	uint8_t *dst, *ref;
+
+	rnd_string(src, size, 0);
+	if (size > len) {
+		src[len] = '\0';
+	}
+
+	dst_prepare(n, dalign, &dst, &ref);
+	dst_check("strncpy", ahos_strncpy((char*) dst, src, n),
+		strncpy((char*) ref, src, n), "len=%zu n=%zu salign=%zu dalign=%zu",
+		len, n, salign, dalign);
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+enum arg_type { ARG_INT, ARG_LONG, ARG_LLONG, ARG_STR };
+
+/*
+ * Generates a format with a single conversion, surrounded by some text, and
+ * returns the type of its argument.
+ *
+ * The kernel printf() (Linux boot code heritage) differs from the C standard
+ * in a few corner cases, which are not generated:
+ * - "%p" (no "0x" prefix) and "%hh" (not supported)
+ * - the '0' flag with a precision (still zero-pads the field)
+ * - '#' or a zero precision with a zero value (prints "0x0", "00" and "0")
+ * - '#' with a precision in octal (one more leading zero)
+ * - '+' and ' ' only apply to signed conversions, '#' to 'o'/'x'/'X'
+ */
+
+static enum arg_type gen_format(char *fmt, size_t size, int zero_value)
+{
+	static const char convs[] = "diuxXocs%";
+	const char conv = convs[rnd_below(sizeof(convs) - 1)];
+	const int is_int = (strchr("diuxXo", conv) != NULL);
+	const int is_signed = (conv == 'd') || (conv == 'i');
+	enum arg_type type = ARG_INT;
+	int precision = -1;
+	size_t len = 0;
+
+	len += snprintf(fmt + len, size - len, "<%s", rnd_below(2) ? "x" : "");
+	fmt[len++] = '%';
+
+	if (conv == '%') {
+		fmt[len++] = '%';
+		snprintf(fmt + len, size - len, ">");
+		return ARG_INT; // not used
+	}
+
+	if (is_int && rnd_below(3) == 0) {
+		precision = rnd_below(3) ? (int) rnd_below(25) : 0;
+		if (zero_value && (precision == 0)) {
+			precision = 1;
+		}
+	}
+
+	// flags
+	if (rnd_below(3) == 0) {
+		fmt[len++] = '-';
+	}
+	if (is_signed && rnd_below(3) == 0) {
+		fmt[len++] = rnd_below(2) ? '+' : ' ';
+	}
+	if (is_int && !is_signed && (conv != 'u') && !zero_value &&
+		!((conv == 'o') && (precision >= 0)) && rnd_below(3) == 0)
+	{
+		fmt[len++] = '#';
+	}
+	if (is_int && (precision < 0) && rnd_below(3) == 0) {
+		fmt[len++] = '0';
+	}
+
+	// width and precision
+	if (rnd_below(2)) {
+		len += snprintf(fmt + len, size - len, "%zu", 1 + rnd_below(30));
+	}
+	if (precision >= 0) {
+		len += snprintf(fmt + len, size - len, ".%d", precision);
+	} else if ((conv == 's') && rnd_below(3) == 0) {
+		len += snprintf(fmt + len, size - len, ".%zu", rnd_below(20));
+	}
+
+	// qualifier
+	if (is_int) {
+		switch (rnd_below(4)) {
+		case 0:
+			fmt[len++] = 'h';
+			break;
+		case 1:
+			fmt[len++] = 'l';
+			type = ARG_LONG;
+			break;
+		case 2:
+			fmt[len++] = 'l';
+			fmt[len++] = 'l';
+			type = ARG_LLONG;
+			break;
+		}
+	} else if (conv == 's') {
+		type = ARG_STR;
+	}
+
+	fmt[len++] = conv;
+	snprintf(fmt + len, size - len, "%s>", rnd_below(2) ? "y" : "");
+
+	return type;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Random integer, with a random number of significant bits (so that every
+ * number of digits is covered).
+ */
+
+static unsigned long long rnd_value(void)
+{
+	const unsigned bits = rnd_below(65);
+
+	return (bits == 0) ? 0 : rnd() >> (64 - bits);
+}
+
+// ----------------------------------------------------------------------------
+
+static void check_printf(void)
+{
+	const int zero_value = (rnd_below(8) == 0);
+	unsigned long long value = zero_value ? 0 : rnd_value();
+	char str[24];
+	char fmt[64];
+	char out[256];
+	char expected[256];
+	const enum arg_type type = gen_format(fmt, sizeof(fmt), zero_value);
+	size_t size = 0;
+	int res = 0, ref = 0;
+
+	// not zero either once truncated to a short (the "%h" conversions)
+	if (!zero_value && ((value & 0xffff) == 0)) {
+		value |= 1ULL << rnd_below(16);
+	}
+
+	rnd_string(str, rnd_below(sizeof(str)), 0);
+	str[rnd_below(sizeof(str))] = '\0';
+
+	// whole output, or truncated
+	size = rnd_below(2) ? sizeof(out) : rnd_below(48);
+
+	memset(out, 0x55, sizeof(out));
+	memset(expected, 0x55, sizeof(expected));
+
+	switch (type) {
+	case ARG_INT:
+		res = ahos_snprintf(out, size, fmt, (int) value);
+		ref = snprintf(expected, size, fmt, (int) value);
+		break;
+	case ARG_LONG:
+		res = ahos_snprintf(out, size, fmt, (long) value);
+		ref = snprintf(expected, size, fmt, (long) value);
+		break;
+	case ARG_LLONG:
+		res = ahos_snprintf(out, size, fmt, value);
+		ref = snprintf(expected, size, fmt, value);
+		break;
+	case ARG_STR:
+		res = ahos_snprintf(out, size, fmt, str);
+		ref = snprintf(expected, size, fmt, str);
+		break;
+	}
+
+	nb_checks++;
+	if ((res != ref) || (memcmp(out, expected, sizeof(out)) != 0)) {
+		failure("snprintf", "format \"%s\" value 0x%llx size %zu: got %d "
+			"\"%.*s\", expected %d \"%.*s\"", fmt, value, size, res,
+			(int) size, out, ref, (int) size, expected);
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * A few fixed formats with several conversions, and sprintf().
+ */
+
+static void check_printf_fixed(void)
+{
+	char out[256];
+	char expected[256];
+	int res, ref;
+
+	res = ahos_sprintf(out, "[%s] %-8s|%5d|%-5u|%08x|%#o|%c|%%|%lld|%llx",
+		"log", "module", -42, 42u, 0xdeadbeefu, 8, '!', -1234567890123LL,
+		0xfedcba9876543210ULL);
+	ref = sprintf(expected, "[%s] %-8s|%5d|%-5u|%08x|%#o|%c|%%|%lld|%llx",
+		"log", "module", -42, 42u, 0xdeadbeefu, 8, '!', -1234567890123LL,
+		0xfedcba9876543210ULL);
+	nb_checks++;
+	if ((res != ref) || (strcmp(out, expected) != 0)) {
+		failure("sprintf", "got \"%s\", expected \"%s\"", out, expected);
+	}
+
+	res = ahos_snprintf(out, sizeof(out), "%*d|%-*s|%.*s|%hd|%hu",
+		6, 12, 4, "ab", 3, "abcdef", 70000, 70000);
+	ref = snprintf(expected, sizeof(expected), "%*d|%-*s|%.*s|%hd|%hu",
+		6, 12, 4, "ab", 3, "abcdef", 70000, 70000);
+	nb_checks++;
+	if ((res != ref) || (strcmp(out, expected) != 0)) {
+		failure("snprintf", "got \"%s\", expected \"%s\"", out, expected);
+	}
+}
+
+// ============================================================================
+// ----------------------------------------------------------------------------
+// ============================================================================
+
+#if defined(LIBCTEST_I386)
+
+/*
+ * Runs @check with the SSE2 variants selected, then goes back to the generic
+ * ones (dispatch.c has no way back, the kernel never needs one).
+ */
+
+static void with_sse2(void (*check)(void))
+{
+	ahos___string_use_sse2(NT_SIZE);
+	check();
+
+	ahos___memcpy_impl = ahos___memcpy_rep;
+	ahos___memset_impl = ahos___memset_rep;
+	ahos___memcmp_impl = ahos___memcmp_words;
+	ahos___string_nt_size = (size_t) -1;
+}
+
+// ----------------------------------------------------------------------------
+
+static void check_memcpy_sse2(void)
+{
+	with_sse2(check_memcpy);
+}
+
+static void check_memmove_sse2(void)
+{
+	with_sse2(check_memmove); // forward moves go through memcpy()
+}
+
+static void check_memset_sse2(void)
+{
+	with_sse2(check_memset);
+}
+
+static void check_memcmp_sse2(void)
+{
+	with_sse2(check_memcmp);
+}
+
+#endif /* LIBCTEST_I386 */
+
+// ----------------------------------------------------------------------------
+
+static const struct
+{
+	const char *name;
+	void (*check)(void);
+} checks[] = {
+	{ "memcpy", check_memcpy },
+	{ "memmove", check_memmove },
+	{ "memset", check_memset },
+	{ "memcmp", check_memcmp },
+#if defined(LIBCTEST_I386)
+	{ "memcpy/sse2", check_memcpy_sse2 },
+	{ "memmove/sse2", check_memmove_sse2 },
+	{ "memset/sse2", check_memset_sse2 },
+	{ "memcmp/sse2", check_memcmp_sse2 },
+#endif
+	{ "strlen", check_strlen },
+	{ "strnlen", check_strnlen },
+	{ "strchr", check_strchr },
+	{ "strcmp", check_strcmp },
+	{ "strcpy", check_strcpy },
+	{ "strncpy", check_strncpy },
+	{ "printf", check_printf },
+};
+
+// ----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+	unsigned long iterations = 20000;
+	uint64_t seed = 0x5eed;
+	int bytes = 0;
+
+	if ((argc > 1) && (strcmp(argv[1], "-b") == 0)) {
+		use_byte_references();
+		bytes = 1;
+		argc--;
+		argv++;
+	}
+	if (argc > 3) {
+		fprintf(stderr, "usage: libctest [-b] [iterations [seed]]\n");
+		return EXIT_FAILURE;
+	}
+	if (argc > 1) {
+		iterations = strtoul(argv[1], NULL, 0);
+	}
+	if (argc > 2) {
+		seed = strtoull(argv[2], NULL, 0);
+	}
+	rng_state = seed ? seed : 1;
+
+	// the destination holds the largest memmove() span
+	area_init(&area_src, MAX_SIZE + MAX_ALIGN + 1);
+	area_init(&area_src2, MAX_SIZE + MAX_ALIGN + 1);
+	area_init(&area_dst, 2 * MAX_SIZE + 2 * MAX_ALIGN + 2 * SLACK);
+	area_init(&area_ref, 2 * MAX_SIZE + 2 * MAX_ALIGN + 2 * SLACK);
+
+	printf("libctest: %lu iterations, seed 0x%llx, %s references\n",
+		iterations, (unsigned long long) seed, bytes ? "byte" : "host libc");
+
+	signal(SIGSEGV, segv_handler);
+	fflush(stdout);
+
+	current = "printf";
+	check_printf_fixed();
+	for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); ++i) {
+		const unsigned long before = nb_failures;
+
+		current = checks[i].name;
+		for (unsigned long n = 0; n < iterations; ++n) {
+			checks[i].check();
+		}
+		printf("%-12s %s\n", checks[i].name,
+			(nb_failures == before) ? "ok" : "FAILED");
+		fflush(stdout);
+	}
+
+	printf("libctest: %lu checks, %lu failures\n", nb_checks, nb_failures);
+
+	return (nb_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -6,4 +6,5 @@ qemu-system-$(./target-triplet-to-arch.sh $HOST) \
 	-cdrom ahos.iso \
 	-d guest_errors \
 	-serial stdio \
+	-debugcon file:debugcon.log \
 	-no-reboot
@@ -2,4 +2,4 @@
 set -e
 . ./build.sh
 
-qemu-system-$(./target-triplet-to-arch.sh $HOST) -kernel sysroot/boot/ahos.kernel -d guest_errors -serial stdio -no-reboot
+qemu-system-$(./target-triplet-to-arch.sh $HOST) -kernel sysroot/boot/ahos.kernel -d guest_errors -serial stdio -debugcon file:debugcon.log -no-reboot
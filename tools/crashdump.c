@@ -0,0 +1,349 @@
+//
+// THIS IS INTENTED TO RUN ON "HOST/DEV" SYSTEM!
+//
+// Decodes the binary crash dump that panic() streams over the serial port
+// (see kernel/include/kernel/crashdump.h) and prints a readable report. The
+// dump is searched in the captured serial output, so the text around it does
+// not matter. Addresses are symbolized with 'symbols.map' (if given).
+//
+// build: cc -I../kernel/include -o crashdump crashdump.c
+// usage: crashdump [-s symbols.map] <serial.log>
+//
+// NOTE: the dump is little endian, so is the host expected to be.
+
+#include <kernel/crashdump.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+struct sym
+{
+	uint32_t addr;
+	uint32_t len;
+	char *name;
+};
+
+static struct sym *syms = NULL;
+static size_t nb_syms = 0;
+
+// ----------------------------------------------------------------------------
+
+static void load_symbols(const char *path)
+{
+	char line[512];
+	FILE *fp = NULL;
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		char *name = strtok(line, " \n");
+		char *type = strtok(NULL, " \n");
+		char *addr = strtok(NULL, " \n");
+		char *len = strtok(NULL, " \n");
+
+		if ((name == NULL) || (type == NULL) || (addr == NULL)) {
+			continue;
+		}
+
+		syms = realloc(syms, (nb_syms + 1) * sizeof(*syms));
+		if (syms == NULL) {
+			fprintf(stderr, "crashdump: out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		syms[nb_syms].addr = strtoul(addr, NULL, 16);
+		syms[nb_syms].len = len ? strtoul(len, NULL, 16) : 0;
+		syms[nb_syms].name = strdup(name);
+		if (nb_syms > 0) {
+			// every symbol but the last one spans up to the next one
+			syms[nb_syms - 1].len = syms[nb_syms].addr - syms[nb_syms - 1].addr;
+		}
+		nb_syms++;
+	}
+
+	fclose(fp);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Prints @addr as "symbol+offset/len" if it belongs to a known symbol.
+ */
+
+static void print_addr(uint32_t addr)
+{
+	size_t lo = 0;
+	size_t hi = nb_syms;
+
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+
+		if (syms[mid].addr > addr) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	printf("0x%08x", addr);
+	if ((lo > 0) && ((syms[lo - 1].len == 0) ||
+		(addr - syms[lo - 1].addr < syms[lo - 1].len)))
+	{
+		printf(" %s+0x%x/0x%x", syms[lo - 1].name, addr - syms[lo - 1].addr,
+			syms[lo - 1].len);
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static uint32_t crc32(const uint8_t *data, size_t len)
+{
+	uint32_t crc = 0xffffffff;
+
+	for (size_t i = 0; i < len; ++i) {
+		crc ^= data[i];
+		for (size_t bit = 0; bit < 8; ++bit) {
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		}
+	}
+
+	return crc ^ 0xffffffff;
+}
+
+// ----------------------------------------------------------------------------
+
+static void print_regs(const struct crashdump_regs *r)
+{
+	printf("Registers:\n");
+	printf("  eax=%08x ebx=%08x ecx=%08x edx=%08x\n", r->eax, r->ebx, r->ecx,
+		r->edx);
+	printf("  esi=%08x edi=%08x ebp=%08x esp=%08x\n", r->esi, r->edi, r->ebp,
+		r->esp);
+	printf("  eip=");
+	print_addr(r->eip);
+	printf("\n  eflags=%08x\n", r->eflags);
+	printf("  cs=%04x ds=%04x es=%04x fs=%04x gs=%04x ss=%04x\n", r->cs, r->ds,
+		r->es, r->fs, r->gs, r->ss);
+	printf("  cr0=%08x cr2=%08x cr3=%08x cr4=%08x\n\n", r->cr0, r->cr2, r->cr3,
+		r->cr4);
+}
+
+// ----------------------------------------------------------------------------
+
+static void print_stack(const uint8_t *data, uint32_t len)
+{
+	uint32_t base = 0;
+
+	if (len < sizeof(base)) {
+		return;
+	}
+	memcpy(&base, data, sizeof(base));
+	data += sizeof(base);
+	len -= sizeof(base);
+
+	printf("Stack (%u bytes):\n", len);
+	for (uint32_t off = 0; off < len; off += 16) {
+		printf("  %08x:", base + off);
+		for (uint32_t i = off; (i < off + 16) && (i + 4 <= len); i += 4) {
+			uint32_t word;
+
+			memcpy(&word, data + i, sizeof(word));
+			printf(" %08x", word);
+		}
+		printf("\n");
+	}
+	printf("\n");
+}
+
+// ----------------------------------------------------------------------------
+
+static void print_mem(const struct crashdump_mem *m)
+{
+	printf("Memory:\n");
+	printf("  pfa: %u regions, %u/%u pages free (highmem %u/%u)\n",
+		m->pfa_regions, m->pfa_free_pages, m->pfa_pages,
+		m->pfa_highmem_free_pages, m->pfa_highmem_pages);
+	printf("  kmalloc: %u blocks, %u used chunks (%u bytes), %u free chunks\n",
+		m->kmalloc_blocks, m->kmalloc_used_chunks, m->kmalloc_used_bytes,
+		m->kmalloc_free_chunks);
+	printf("  kmalloc: %u big allocations (%u bytes)\n\n", m->kmalloc_big,
+		m->kmalloc_big_bytes);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Decodes the dump at @buf (@len bytes available).
+ *
+ * Returns the number of bytes consumed, zero if this is not a dump.
+ */
+
+static size_t decode(const uint8_t *buf, size_t len)
+{
+	struct crashdump_header hdr;
+	size_t off = sizeof(hdr);
+
+	if (len < sizeof(hdr)) {
+		return 0;
+	}
+	memcpy(&hdr, buf, sizeof(hdr));
+	if ((hdr.magic != CRASHDUMP_MAGIC) || (hdr.version != CRASHDUMP_VERSION)) {
+		return 0;
+	}
+
+	printf("=== crash dump (tick %u) ===\n\n", hdr.tick);
+
+	for (;;) {
+		struct crashdump_section sec;
+		const uint8_t *data = NULL;
+
+		if (off + sizeof(sec) > len) {
+			printf("error: truncated dump\n\n");
+			return off;
+		}
+		memcpy(&sec, buf + off, sizeof(sec));
+		data = buf + off + sizeof(sec);
+
+		if (off + sizeof(sec) + sec.len > len) {
+			printf("error: truncated dump (section %u)\n\n", sec.type);
+			return off;
+		}
+
+		switch (sec.type) {
+		case CD_MSG:
+			printf("Panic: %.*s\n\n", (int) sec.len, (const char*) data);
+			break;
+
+		case CD_REGS:
+			if (sec.len >= sizeof(struct crashdump_regs)) {
+				struct crashdump_regs regs;
+
+				memcpy(&regs, data, sizeof(regs));
+				print_regs(&regs);
+			}
+			break;
+
+		case CD_CALLCHAIN:
+			printf("Call trace:\n");
+			for (uint32_t i = 0; i + sizeof(struct crashdump_frame) <= sec.len;
+				 i += sizeof(struct crashdump_frame))
+			{
+				struct crashdump_frame frame;
+
+				memcpy(&frame, data + i, sizeof(frame));
+				printf("  (ebp=0x%08x) ", frame.ebp);
+				print_addr(frame.eip);
+				printf("\n");
+			}
+			printf("\n");
+			break;
+
+		case CD_STACK:
+			print_stack(data, sec.len);
+			break;
+
+		case CD_LOG:
+			printf("Log:\n%.*s\n", (int) sec.len, (const char*) data);
+			break;
+
+		case CD_TRACE:
+			printf("Trace: %u bytes (decode it with tracedump)\n\n", sec.len);
+			break;
+
+		case CD_MEM:
+			if (sec.len >= sizeof(struct crashdump_mem)) {
+				struct crashdump_mem mem;
+
+				memcpy(&mem, data, sizeof(mem));
+				print_mem(&mem);
+			}
+			break;
+
+		case CD_END:
+			if (sec.len >= sizeof(uint32_t)) {
+				uint32_t crc;
+
+				memcpy(&crc, data, sizeof(crc));
+				if (crc != crc32(buf, off + sizeof(sec))) {
+					printf("error: bad checksum, the dump is corrupted\n\n");
+				} else {
+					printf("(checksum ok)\n\n");
+				}
+			}
+			return off + sizeof(sec) + sec.len;
+
+		default:
+			printf("(skipping unknown section %u, %u bytes)\n\n", sec.type,
+				sec.len);
+			break;
+		}
+
+		off += sizeof(sec) + sec.len;
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+	uint8_t *buf = NULL;
+	size_t len = 0;
+	size_t cap = 0;
+	size_t nb_dumps = 0;
+	FILE *fp = NULL;
+
+	if ((argc == 4) && (strcmp(argv[1], "-s") == 0)) {
+		load_symbols(argv[2]);
+		argv += 2;
+		argc -= 2;
+	}
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: crashdump [-s symbols.map] <serial.log>\n");
+		return EXIT_FAILURE;
+	}
+
+	if ((fp = fopen(argv[1], "rb")) == NULL) {
+		perror(argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	for (;;) {
+		size_t nread;
+
+		if (len == cap) {
+			cap = cap ? 2 * cap : 65536;
+			if ((buf = realloc(buf, cap)) == NULL) {
+				fprintf(stderr, "crashdump: out of memory\n");
+				return EXIT_FAILURE;
+			}
+		}
+		if ((nread = fread(buf + len, 1, cap - len, fp)) == 0) {
+			break;
+		}
+		len += nread;
+	}
+	fclose(fp);
+
+	for (size_t off = 0; off + sizeof(uint32_t) <= len; ) {
+		size_t used = decode(buf + off, len - off);
+
+		if (used > 0) {
+			nb_dumps++;
+			off += used;
+		} else {
+			off++;
+		}
+	}
+
+	if (nb_dumps == 0) {
+		fprintf(stderr, "crashdump: no crash dump found\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,299 @@
+//
+// THIS IS INTENTED TO RUN ON "HOST/DEV" SYSTEM!
+//
+// Converts the kernel 'symbols.map' file (nm -f posix --numeric-sort output)
+// into the binary symbol table used in place by the kernel (see
+// kernel/include/kernel/symtab.h for the format).
+//
+// usage: mksymtab [-n] <symbols.map> <symbols.bin>
+//
+//	-n	do not emit the name hash table
+
+#include <kernel/symtab.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+struct entry
+{
+	uint32_t addr;
+	uint32_t size; // from nm (only used for the last symbol)
+	uint32_t index; // line number, keeps the sort stable
+	uint32_t name; // offset in the string blob
+};
+
+static struct entry *entries = NULL;
+static size_t nb_entries = 0;
+
+static char *strtab = NULL;
+static size_t strtab_size = 0;
+static size_t strtab_cap = 0;
+
+// string blob deduplication (open addressing, strtab offsets + 1)
+static uint32_t *dedup = NULL;
+static size_t dedup_size = 0;
+
+// ----------------------------------------------------------------------------
+
+static void *xrealloc(void *ptr, size_t size)
+{
+	if ((ptr = realloc(ptr, size)) == NULL) {
+		fprintf(stderr, "mksymtab: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return ptr;
+}
+
+// ----------------------------------------------------------------------------
+
+static void dedup_insert(uint32_t off)
+{
+	size_t i = symtab_hash(strtab + off) & (dedup_size - 1);
+
+	while (dedup[i] != 0) {
+		i = (i + 1) & (dedup_size - 1);
+	}
+	dedup[i] = off + 1;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns the offset of @name in the string blob (added if not found).
+ */
+
+static uint32_t intern(const char *name)
+{
+	const size_t len = strlen(name) + 1;
+	size_t i = 0;
+
+	// keep the load factor under 1/2
+	if (2 * (nb_entries + 1) > dedup_size) {
+		uint32_t *old = dedup;
+		size_t old_size = dedup_size;
+
+		dedup_size = dedup_size ? 2 * dedup_size : 1024;
+		dedup = calloc(dedup_size, sizeof(*dedup));
+		if (dedup == NULL) {
+			fprintf(stderr, "mksymtab: out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		for (size_t j = 0; j < old_size; ++j) {
+			if (old[j] != 0) {
+				dedup_insert(old[j] - 1);
+			}
+		}
+		free(old);
+	}
+
+	i = symtab_hash(name) & (dedup_size - 1);
+	while (dedup[i] != 0) {
+		if (strcmp(strtab + dedup[i] - 1, name) == 0) {
+			return dedup[i] - 1;
+		}
+		i = (i + 1) & (dedup_size - 1);
+	}
+
+	while (strtab_size + len > strtab_cap) {
+		strtab_cap = strtab_cap ? 2 * strtab_cap : 4096;
+		strtab = xrealloc(strtab, strtab_cap);
+	}
+	memcpy(strtab + strtab_size, name, len);
+	dedup[i] = strtab_size + 1;
+	strtab_size += len;
+
+	return dedup[i] - 1;
+}
+
+// ----------------------------------------------------------------------------
+
+static int cmp_entry(const void *a, const void *b)
+{
+	const struct entry *ea = a;
+	const struct entry *eb = b;
+
+	if (ea->addr != eb->addr) {
+		return (ea->addr < eb->addr) ? -1 : 1;
+	}
+
+	return (ea->index < eb->index) ? -1 : (ea->index > eb->index);
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Parses one "SYMBOL_NAME SYMBOL_TYPE SYMBOL_ADDR [SYMBOL_LEN]" line.
+ */
+
+static int parse_line(char *line, size_t lineno)
+{
+	char *name = strtok(line, " \n");
+	char *type = strtok(NULL, " \n");
+	char *addr = strtok(NULL, " \n");
+	char *size = strtok(NULL, " \n");
+	struct entry *e = NULL;
+
+	if (name == NULL) {
+		return 0; // empty line
+	}
+
+	if ((type == NULL) || (addr == NULL)) {
+		fprintf(stderr, "mksymtab: line %zu: malformed symbol\n", lineno);
+		return -1;
+	}
+
+	if ((nb_entries & (nb_entries - 1)) == 0) {
+		entries = xrealloc(entries,
+			(nb_entries ? 2 * nb_entries : 1) * sizeof(*entries));
+	}
+
+	e = &entries[nb_entries];
+	e->addr = strtoul(addr, NULL, 16);
+	e->size = size ? strtoul(size, NULL, 16) : 0;
+	e->index = nb_entries;
+	e->name = intern(name);
+	nb_entries++;
+
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+
+static void write_u32(FILE *fp, uint32_t val)
+{
+	const uint8_t bytes[4] = {
+		val & 0xff, (val >> 8) & 0xff, (val >> 16) & 0xff, (val >> 24) & 0xff
+	};
+
+	fwrite(bytes, sizeof(bytes), 1, fp);
+}
+
+// ----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+	struct symtab_header hdr;
+	uint32_t *hash_heads = NULL;
+	uint32_t *hash_next = NULL;
+	char *line = NULL;
+	size_t line_cap = 0;
+	size_t lineno = 0;
+	int with_hash = 1;
+	FILE *in = NULL;
+	FILE *out = NULL;
+
+	if ((argc > 1) && (strcmp(argv[1], "-n") == 0)) {
+		with_hash = 0;
+		argc--;
+		argv++;
+	}
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: mksymtab [-n] <symbols.map> <symbols.bin>\n");
+		return EXIT_FAILURE;
+	}
+
+	if ((in = fopen(argv[1], "r")) == NULL) {
+		perror(argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	while (getline(&line, &line_cap, in) != -1) {
+		if (parse_line(line, ++lineno) != 0) {
+			return EXIT_FAILURE;
+		}
+	}
+	fclose(in);
+	free(line);
+
+	// already sorted by nm, but the kernel relies on it
+	qsort(entries, nb_entries, sizeof(*entries), cmp_entry);
+
+	// every symbol but the last one spans up to the next one
+	for (size_t i = 0; i + 1 < nb_entries; ++i) {
+		entries[i].size = entries[i + 1].addr - entries[i].addr;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = SYMTAB_MAGIC;
+	hdr.version = SYMTAB_VERSION;
+	hdr.nb_syms = nb_entries;
+
+	if (nb_entries == 0) {
+		fprintf(stderr, "mksymtab: no symbol found in %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	if (with_hash) {
+		hdr.hash_size = 1;
+		while (hdr.hash_size < nb_entries) {
+			hdr.hash_size <<= 1;
+		}
+
+		hash_heads = xrealloc(NULL, hdr.hash_size * sizeof(uint32_t));
+		hash_next = xrealloc(NULL, nb_entries * sizeof(uint32_t));
+		for (size_t i = 0; i < hdr.hash_size; ++i) {
+			hash_heads[i] = SYMTAB_HASH_END;
+		}
+
+		// insert at head, from the last symbol down to the first one
+		for (size_t i = nb_entries; i-- > 0; ) {
+			const uint32_t bucket =
+				symtab_hash(strtab + entries[i].name) & (hdr.hash_size - 1);
+
+			hash_next[i] = hash_heads[bucket];
+			hash_heads[bucket] = i;
+		}
+	}
+
+	// pad the string blob so that the whole table is 4-byte aligned
+	strtab = xrealloc(strtab, strtab_size + 4);
+	while ((strtab_size & 3) != 0) {
+		strtab[strtab_size++] = '\0';
+	}
+	hdr.strtab_size = strtab_size;
+
+	hdr.size = sizeof(hdr) + sizeof(uint32_t) *
+		(3 * hdr.nb_syms + hdr.hash_size + (hdr.hash_size ? hdr.nb_syms : 0)) +
+		hdr.strtab_size;
+
+	if ((out = fopen(argv[2], "wb")) == NULL) {
+		perror(argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	write_u32(out, hdr.magic);
+	write_u32(out, hdr.version);
+	write_u32(out, hdr.nb_syms);
+	write_u32(out, hdr.hash_size);
+	write_u32(out, hdr.strtab_size);
+	write_u32(out, hdr.size);
+	for (size_t i = 0; i < nb_entries; ++i) {
+		write_u32(out, entries[i].addr);
+	}
+	for (size_t i = 0; i < nb_entries; ++i) {
+		write_u32(out, entries[i].size);
+	}
+	for (size_t i = 0; i < nb_entries; ++i) {
+		write_u32(out, entries[i].name);
+	}
+	if (hdr.hash_size > 0) {
+		for (size_t i = 0; i < hdr.hash_size; ++i) {
+			write_u32(out, hash_heads[i]);
+		}
+		for (size_t i = 0; i < nb_entries; ++i) {
+			write_u32(out, hash_next[i]);
+		}
+	}
+	fwrite(strtab, 1, strtab_size, out);
+
+	if (fclose(out) != 0) {
+		perror(argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+#!/bin/sh
+#
+# THIS IS INTENTED TO RUN ON "HOST/DEV" SYSTEM!
+#
+# Symbolizes the profiler samples ("PROF ..." lines of the serial output, see
+# kernel/kernel/profile.c) with the kernel 'symbols.map' file and prints
+# folded stacks, one "root;...;leaf <count>" line per distinct stack. The
+# output can be fed to flamegraph.pl.
+#
+# usage: profile-fold.sh <symbols.map> [serial.log]
+
+set -e
+
+if [ $# -lt 1 ] || [ $# -gt 2 ]; then
+	echo "usage: $0 <symbols.map> [serial.log]" >&2
+	exit 1
+fi
+
+awk '
+function hex(str,    i, c, val)
+{
+	val = 0
+	sub(/^0[xX]/, "", str)
+	str = tolower(str)
+	for (i = 1; i <= length(str); i++) {
+		c = index("0123456789abcdef", substr(str, i, 1))
+		if (c == 0) {
+			break
+		}
+		val = val * 16 + c - 1
+	}
+	return val
+}
+
+# last symbol at or before @addr (binary search, the map is sorted)
+function symbolize(addr,    lo, hi, mid)
+{
+	lo = 1
+	hi = nb_syms + 1
+	while (lo < hi) {
+		mid = int((lo + hi) / 2)
+		if (sym_addr[mid] > addr) {
+			hi = mid
+		} else {
+			lo = mid + 1
+		}
+	}
+	if ((lo == 1) || ((sym_len[lo - 1] > 0) &&
+		(addr >= sym_addr[lo - 1] + sym_len[lo - 1])))
+	{
+		return sprintf("0x%x", addr)
+	}
+	return sym_name[lo - 1]
+}
+
+# symbols.map: "NAME TYPE ADDR [LEN]"
+FNR == NR {
+	nb_syms++
+	sym_name[nb_syms] = $1
+	sym_addr[nb_syms] = hex($3)
+	sym_len[nb_syms] = (NF >= 4) ? hex($4) : 0
+	if (nb_syms > 1) {
+		# every symbol but the last one spans up to the next one
+		sym_len[nb_syms - 1] = sym_addr[nb_syms] - sym_addr[nb_syms - 1]
+	}
+	next
+}
+
+# the serial output might have a carriage return
+{ sub(/\r$/, "") }
+
+$1 == "PROF" && $2 ~ /^0x/ {
+	stack = ""
+	# return addresses point after the call, look up the call itself
+	for (i = NF; i >= 2; i--) {
+		addr = hex($i)
+		frame = symbolize((i == 2) ? addr : addr - 1)
+		stack = (stack == "") ? frame : stack ";" frame
+	}
+	count[stack]++
+	next
+}
+
+$1 == "PROF" && $2 ~ /^dropped=/ {
+	dropped = substr($2, 9)
+}
+
+END {
+	for (stack in count) {
+		print stack, count[stack]
+	}
+	if (dropped > 0) {
+		printf("warning: %d samples dropped\n", dropped) > "/dev/stderr"
+	}
+}
+' "$1" "${2:--}" | sort
@@ -0,0 +1,365 @@
+//
+// THIS IS INTENTED TO RUN ON "HOST/DEV" SYSTEM!
+//
+// Decodes the binary trace events (see kernel/include/kernel/tracefmt.h)
+// found in the captured serial output: the ones streamed with the "trace"
+// boot option and the ones in crash dumps. The format strings are read from
+// the kernel ELF file, at the address recorded in each event.
+//
+// Events are printed in timestamp order (cycles since the first one), the
+// duplicates (streamed and then dumped) are printed once.
+//
+// build: cc -I../kernel/include -o tracedump tracedump.c
+// usage: tracedump <ahos.kernel> <serial.log>
+//
+// NOTE: the trace is little endian, so is the host expected to be.
+
+#include <kernel/tracefmt.h>
+
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+struct section
+{
+	uint32_t addr;
+	uint32_t size;
+	const char *data;
+};
+
+struct event
+{
+	uint64_t tsc;
+	uint32_t context;
+	struct trace_event raw;
+};
+
+static struct section *sections = NULL;
+static size_t nb_sections = 0;
+
+static struct event *events = NULL;
+static size_t nb_events = 0;
+
+static const char *context_names[TRACE_CONTEXTS] = {
+	[TRACE_CTX_THREAD] = "thread",
+	[TRACE_CTX_IRQ] = "irq",
+	[TRACE_CTX_NESTED] = "nested",
+};
+
+// ----------------------------------------------------------------------------
+
+static void *xrealloc(void *ptr, size_t size)
+{
+	if ((ptr = realloc(ptr, size)) == NULL) {
+		fprintf(stderr, "tracedump: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return ptr;
+}
+
+// ----------------------------------------------------------------------------
+
+static char *read_file(const char *path, size_t *len)
+{
+	char *buf = NULL;
+	size_t cap = 0;
+	FILE *fp = NULL;
+
+	if ((fp = fopen(path, "rb")) == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	*len = 0;
+	for (;;) {
+		size_t nread;
+
+		if (*len == cap) {
+			cap = cap ? 2 * cap : 65536;
+			buf = xrealloc(buf, cap);
+		}
+		if ((nread = fread(buf + *len, 1, cap - *len, fp)) == 0) {
+			break;
+		}
+		*len += nread;
+	}
+	fclose(fp);
+
+	return buf;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Keeps the sections of the kernel image which have a content at runtime
+ * (where the format strings are).
+ */
+
+static void load_kernel(const char *path)
+{
+	size_t len = 0;
+	const char *elf = read_file(path, &len);
+	Elf32_Ehdr ehdr;
+
+	if (len < sizeof(ehdr)) {
+		fprintf(stderr, "tracedump: %s: not an ELF file\n", path);
+		exit(EXIT_FAILURE);
+	}
+	memcpy(&ehdr, elf, sizeof(ehdr));
+	if ((memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0) ||
+		(ehdr.e_ident[EI_CLASS] != ELFCLASS32) ||
+		(ehdr.e_shentsize != sizeof(Elf32_Shdr)) ||
+		(ehdr.e_shoff + (size_t) ehdr.e_shnum * sizeof(Elf32_Shdr) > len))
+	{
+		fprintf(stderr, "tracedump: %s: not a 32-bit ELF file\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	for (size_t i = 0; i < ehdr.e_shnum; ++i) {
+		Elf32_Shdr shdr;
+
+		memcpy(&shdr, elf + ehdr.e_shoff + i * sizeof(shdr), sizeof(shdr));
+		if (((shdr.sh_flags & SHF_ALLOC) == 0) ||
+			(shdr.sh_type == SHT_NOBITS) ||
+			(shdr.sh_offset + (size_t) shdr.sh_size > len))
+		{
+			continue;
+		}
+
+		sections = xrealloc(sections, (nb_sections + 1) * sizeof(*sections));
+		sections[nb_sections].addr = shdr.sh_addr;
+		sections[nb_sections].size = shdr.sh_size;
+		sections[nb_sections].data = elf + shdr.sh_offset;
+		nb_sections++;
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Returns the null terminated string at @addr in the kernel image, or NULL.
+ */
+
+static const char *kernel_string(uint32_t addr)
+{
+	for (size_t i = 0; i < nb_sections; ++i) {
+		const struct section *sec = &sections[i];
+
+		if ((addr >= sec->addr) && (addr - sec->addr < sec->size)) {
+			const uint32_t off = addr - sec->addr;
+
+			if (memchr(sec->data + off, '\0', sec->size - off) == NULL) {
+				return NULL;
+			}
+			return sec->data + off;
+		}
+	}
+
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Formats @event with its format string (the kernel printf() conversions).
+ */
+
+static void print_event(const struct trace_event *event)
+{
+	const char *fmt = kernel_string(event->fmt);
+	size_t arg = 0;
+
+	if (fmt == NULL) {
+		printf("<unknown format 0x%08x>", event->fmt);
+		return;
+	}
+
+	while (*fmt != '\0') {
+		char spec[32];
+		size_t len = 0;
+		uint32_t val = 0;
+		const char *str = NULL;
+
+		if (*fmt != '%') {
+			putchar(*fmt++);
+			continue;
+		}
+
+		// flags, field width, precision and qualifier
+		spec[len++] = *fmt++;
+		while ((*fmt != '\0') && (strchr("-+ #0123456789.hlL", *fmt) != NULL) &&
+			   (len < sizeof(spec) - 4))
+		{
+			if (strchr("hlL", *fmt) == NULL) {
+				spec[len++] = *fmt;
+			}
+			fmt++;
+		}
+
+		if (*fmt == '\0') {
+			break;
+		} else if (*fmt == '%') {
+			putchar('%');
+			fmt++;
+			continue;
+		}
+
+		if (arg < TRACE_MAX_ARGS) {
+			val = event->args[arg++];
+		} else {
+			printf("<missing>");
+			fmt++;
+			continue;
+		}
+
+		switch (*fmt) {
+		case 'd':
+		case 'i':
+			spec[len++] = 'd';
+			spec[len] = '\0';
+			printf(spec, (int32_t) val);
+			break;
+
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+		case 'c':
+			spec[len++] = *fmt;
+			spec[len] = '\0';
+			printf(spec, val);
+			break;
+
+		case 'p': // as the kernel does: hex, 8 digits
+			printf("%08x", val);
+			break;
+
+		case 's':
+			if ((str = kernel_string(val)) != NULL) {
+				spec[len++] = 's';
+				spec[len] = '\0';
+				printf(spec, str);
+			} else {
+				printf("<string 0x%08x>", val);
+			}
+			break;
+
+		default:
+			printf("<%%%c 0x%x>", *fmt, val);
+			break;
+		}
+		fmt++;
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Collects the events of the chunk at @buf (@len bytes available).
+ *
+ * Returns the number of bytes consumed, zero if this is not a chunk.
+ */
+
+static size_t parse_chunk(const uint8_t *buf, size_t len)
+{
+	struct trace_chunk chunk;
+	size_t size = 0;
+
+	if (len < sizeof(chunk)) {
+		return 0;
+	}
+	memcpy(&chunk, buf, sizeof(chunk));
+	if ((chunk.magic != TRACE_MAGIC) || (chunk.version != TRACE_VERSION) ||
+		(chunk.context >= TRACE_CONTEXTS))
+	{
+		return 0;
+	}
+
+	size = sizeof(chunk) +
+		(size_t) chunk.nb_events * sizeof(struct trace_event);
+	if (size > len) {
+		fprintf(stderr, "tracedump: truncated chunk (%s)\n",
+			context_names[chunk.context]);
+		return 0;
+	}
+
+	if (chunk.lost > 0) {
+		fprintf(stderr, "tracedump: %u %s events lost\n", chunk.lost,
+			context_names[chunk.context]);
+	}
+
+	events = xrealloc(events, (nb_events + chunk.nb_events) * sizeof(*events));
+	for (size_t i = 0; i < chunk.nb_events; ++i) {
+		struct event *event = &events[nb_events++];
+
+		memcpy(&event->raw, buf + sizeof(chunk) + i * sizeof(event->raw),
+			sizeof(event->raw));
+		event->context = chunk.context;
+		event->tsc = ((uint64_t) event->raw.tsc_hi << 32) | event->raw.tsc_lo;
+	}
+
+	return size;
+}
+
+// ----------------------------------------------------------------------------
+
+static int cmp_event(const void *a, const void *b)
+{
+	const struct event *ea = a;
+	const struct event *eb = b;
+
+	if (ea->tsc != eb->tsc) {
+		return (ea->tsc < eb->tsc) ? -1 : 1;
+	}
+	if (ea->context != eb->context) {
+		return (ea->context < eb->context) ? -1 : 1;
+	}
+
+	return memcmp(&ea->raw, &eb->raw, sizeof(ea->raw));
+}
+
+// ----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+	const uint8_t *log = NULL;
+	size_t len = 0;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: tracedump <ahos.kernel> <serial.log>\n");
+		return EXIT_FAILURE;
+	}
+
+	load_kernel(argv[1]);
+	log = (const uint8_t*) read_file(argv[2], &len);
+
+	for (size_t off = 0; off + sizeof(uint32_t) <= len; ) {
+		size_t used = parse_chunk(log + off, len - off);
+
+		off += (used > 0) ? used : 1;
+	}
+
+	if (nb_events == 0) {
+		fprintf(stderr, "tracedump: no trace event found\n");
+		return EXIT_FAILURE;
+	}
+
+	qsort(events, nb_events, sizeof(*events), cmp_event);
+
+	for (size_t i = 0; i < nb_events; ++i) {
+		if ((i > 0) && (cmp_event(&events[i - 1], &events[i]) == 0)) {
+			continue; // streamed, then dumped
+		}
+
+		printf("%14llu %-6s ",
+			(unsigned long long)(events[i].tsc - events[0].tsc),
+			context_names[events[i].context]);
+		print_event(&events[i].raw);
+		putchar('\n');
+	}
+
+	return EXIT_SUCCESS;
+}